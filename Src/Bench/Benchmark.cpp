@@ -0,0 +1,47 @@
+#include <cstdio>
+#include <cstring>
+#include "Benchmark.h"
+
+namespace WIP3D
+{
+    volatile uint64_t Benchmark::sSink = 0;
+
+    Benchmark::Registrar::Registrar(const char* name, Func func)
+    {
+        getRegistry().push_back({ name, func });
+    }
+
+    std::vector<Benchmark::Entry>& Benchmark::getRegistry()
+    {
+        static std::vector<Entry> registry;
+        return registry;
+    }
+
+    uint32_t Benchmark::runAll(const char* filter)
+    {
+        uint32_t runCount = 0;
+        for (const Entry& entry : getRegistry())
+        {
+            if (filter && strstr(entry.name, filter) == nullptr) continue;
+
+            printf("%s\n", entry.name);
+            Benchmark bench;
+            entry.func(bench);
+            runCount++;
+        }
+        return runCount;
+    }
+
+    void Benchmark::report(const std::string& label, uint64_t opCount, double seconds)
+    {
+        double nsPerOp = seconds * 1e9 / (double)opCount;
+        printf("    %-48s %10.2f ns/op %10.2f Mop/s\n", label.c_str(), nsPerOp, (double)opCount / seconds * 1e-6);
+    }
+}
+
+/** Usage: WIP3DBench [filter]
+*/
+int main(int argc, char** argv)
+{
+    return WIP3D::Benchmark::runAll(argc > 1 ? argv[1] : nullptr) ? 0 : 1;
+}
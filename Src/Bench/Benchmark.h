@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WIP3D
+{
+    /** Minimal benchmark runner for the device-free cores, the benchmarks are built into WIP3DBench.
+        Benchmarks register themselves with BENCHMARK() and print one line per measured case with report(). Build them in Release, the numbers of a Debug build are meaningless.
+    */
+    class Benchmark
+    {
+    public:
+        using Func = void(*)(Benchmark& bench);
+        using Clock = std::chrono::high_resolution_clock;
+
+        struct Registrar
+        {
+            Registrar(const char* name, Func func);
+        };
+
+        /** Run the registered benchmarks.
+            \param[in] filter Only run the benchmarks whose name contains this string. nullptr runs every benchmark.
+            \return The number of benchmarks that ran.
+        */
+        static uint32_t runAll(const char* filter);
+
+        /** Print the result of a case.
+            \param[in] label Description of the case.
+            \param[in] opCount Number of operations timed.
+            \param[in] seconds Time the operations took.
+        */
+        void report(const std::string& label, uint64_t opCount, double seconds);
+
+        static double getSeconds(Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); }
+
+        /** Keep a value alive so the compiler can't drop the work producing it. Not thread-safe, worker threads should hand their values to the benchmark thread
+        */
+        static void keep(uint64_t value) { sSink += value; }
+
+    private:
+        struct Entry
+        {
+            const char* name;
+            Func func;
+        };
+        static std::vector<Entry>& getRegistry();
+        static volatile uint64_t sSink;
+    };
+}
+
+#define BENCHMARK(name_) \
+    static void name_(WIP3D::Benchmark& bench_); \
+    static WIP3D::Benchmark::Registrar name_##Registrar(#name_, name_); \
+    static void name_(WIP3D::Benchmark& bench_)
@@ -0,0 +1,65 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Benchmark.h"
+#include "../DescriptorAllocator.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    // Each thread keeps a window of live ranges and replaces a random one per iteration, like descriptor sets being created and released while recording
+    void runAllocateRelease(Benchmark& bench, uint32_t threadCount, uint32_t minSize, uint32_t maxSize, const char* sizeLabel)
+    {
+        const uint32_t kIterations = 1000000;
+        const uint32_t kLiveCount = 1024;
+        DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(16 * 1024 * 1024);
+        std::atomic<uint32_t> readyCount(0);
+        std::atomic<bool> go(false);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            std::mt19937 rng(threadIndex);
+            std::vector<uint32_t> sizes(4096);
+            for (auto& size : sizes) size = minSize + rng() % (maxSize - minSize + 1);
+            std::vector<uint32_t> victims(kIterations);
+            for (auto& v : victims) v = rng() % kLiveCount;
+
+            std::vector<DescriptorAllocator::Handle> live(kLiveCount);
+            for (uint32_t i = 0; i < kLiveCount; i++) live[i] = pAllocator->allocate(sizes[i]);
+
+            readyCount++;
+            while (go.load() == false) std::this_thread::yield();
+            for (uint32_t i = 0; i < kIterations; i++)
+            {
+                DescriptorAllocator::Handle& h = live[victims[i]];
+                pAllocator->release(h);
+                h = pAllocator->allocate(sizes[i % sizes.size()]);
+            }
+            for (auto h : live) pAllocator->release(h);
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++) threads.emplace_back(worker, t);
+        while (readyCount.load() != threadCount) std::this_thread::yield();
+
+        auto start = Benchmark::Clock::now();
+        go = true;
+        for (auto& thread : threads) thread.join();
+        double seconds = Benchmark::getSeconds(start);
+        bench.report(std::to_string(threadCount) + " threads, " + sizeLabel + ", release + allocate", (uint64_t)kIterations * threadCount, seconds);
+    }
+}
+
+BENCHMARK(DescriptorAllocator_FreeLists)
+{
+    // Descriptor-set sized ranges, served by the lock-free free lists after warm-up
+    for (uint32_t threadCount : { 1u, 2u, 4u, 8u }) runAllocateRelease(bench_, threadCount, 1, DescriptorAllocator::kCachedRangeSize, "1-64 entries");
+}
+
+BENCHMARK(DescriptorAllocator_Locked)
+{
+    // Ranges larger than kCachedRangeSize always take the locked TLSF path
+    for (uint32_t threadCount : { 1u, 2u, 4u, 8u }) runAllocateRelease(bench_, threadCount, DescriptorAllocator::kCachedRangeSize + 1, 1024, "65-1024 entries");
+}
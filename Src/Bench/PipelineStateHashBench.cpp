@@ -0,0 +1,92 @@
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "../D3D12/D3D12PipelineStateHash.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint32_t kHashCount = 1000;
+
+    std::vector<uint8_t> makeBytecode(size_t size, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> bytecode(size);
+        for (auto& b : bytecode) b = (uint8_t)rng();
+        return bytecode;
+    }
+
+    // A typical forward pass: position, normal and texcoord, one render target and a depth buffer
+    const D3D12_INPUT_ELEMENT_DESC kInputElements[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC makeGraphicsDesc(const std::vector<uint8_t>& vs, const std::vector<uint8_t>& ps)
+    {
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+        desc.VS = { vs.data(), vs.size() };
+        desc.PS = { ps.data(), ps.size() };
+        for (auto& rt : desc.BlendState.RenderTarget)
+        {
+            rt.SrcBlend = D3D12_BLEND_ONE;
+            rt.DestBlend = D3D12_BLEND_ZERO;
+            rt.BlendOp = D3D12_BLEND_OP_ADD;
+            rt.SrcBlendAlpha = D3D12_BLEND_ONE;
+            rt.DestBlendAlpha = D3D12_BLEND_ZERO;
+            rt.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+            rt.LogicOp = D3D12_LOGIC_OP_NOOP;
+            rt.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+        }
+        desc.SampleMask = UINT_MAX;
+        desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+        desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+        desc.RasterizerState.DepthClipEnable = TRUE;
+        desc.DepthStencilState.DepthEnable = TRUE;
+        desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+        desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+        desc.InputLayout = { kInputElements, (UINT)(sizeof(kInputElements) / sizeof(kInputElements[0])) };
+        desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+        desc.NumRenderTargets = 1;
+        desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+        desc.SampleDesc.Count = 1;
+        return desc;
+    }
+}
+
+BENCHMARK(PipelineStateHash_Graphics)
+{
+    // The key is computed on every cache lookup, the shader bytecode dominates
+    for (size_t size : { 4096u, 16384u, 65536u })
+    {
+        std::vector<uint8_t> vs = makeBytecode(size, 1);
+        std::vector<uint8_t> ps = makeBytecode(size, 2);
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = makeGraphicsDesc(vs, ps);
+
+        auto start = Benchmark::Clock::now();
+        for (uint32_t i = 0; i < kHashCount; i++) Benchmark::keep(hashPipelineStateDesc(desc, i));
+        double seconds = Benchmark::getSeconds(start);
+        bench_.report("VS + PS, " + std::to_string(size >> 10) + "KB each", kHashCount, seconds);
+    }
+}
+
+BENCHMARK(PipelineStateHash_Compute)
+{
+    for (size_t size : { 4096u, 16384u, 65536u })
+    {
+        std::vector<uint8_t> cs = makeBytecode(size, 3);
+        D3D12_COMPUTE_PIPELINE_STATE_DESC desc = {};
+        desc.CS = { cs.data(), cs.size() };
+
+        auto start = Benchmark::Clock::now();
+        for (uint32_t i = 0; i < kHashCount; i++) Benchmark::keep(hashPipelineStateDesc(desc, i));
+        double seconds = Benchmark::getSeconds(start);
+        bench_.report("CS, " + std::to_string(size >> 10) + "KB", kHashCount, seconds);
+    }
+}
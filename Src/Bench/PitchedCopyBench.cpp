@@ -0,0 +1,93 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "../PitchedCopy.h"
+#include "../WorkerPool.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const size_t kRowPitchAlignment = 256;     // D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+    const uint32_t kRepeatCount = 8;
+
+    struct Format
+    {
+        const char* name;
+        uint32_t bytesPerPixel;
+    };
+
+    const Format kFormats[] = { { "R8", 1 }, { "RGBA8", 4 }, { "RGBA16F", 8 }, { "RGBA32F", 16 } };
+
+    /** Upload a width x width texture from a packed CPU copy to a footprint with aligned rows, the way the upload paths fill a buffer
+    */
+    PitchedCopyDesc makeUploadDesc(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst, uint32_t width, uint32_t bytesPerPixel)
+    {
+        PitchedCopyDesc desc;
+        desc.pSrc = src.data();
+        desc.pDst = dst.data();
+        desc.rowSize = (size_t)width * bytesPerPixel;
+        desc.rowCount = width;
+        desc.srcRowPitch = desc.rowSize;
+        desc.dstRowPitch = (desc.rowSize + kRowPitchAlignment - 1) & ~(kRowPitchAlignment - 1);
+        desc.srcSlicePitch = desc.srcRowPitch * width;
+        desc.dstSlicePitch = desc.dstRowPitch * width;
+        return desc;
+    }
+
+    template<typename CopyFunc>
+    void runFormats(Benchmark& bench, const std::string& label, CopyFunc copy)
+    {
+        for (const Format& format : kFormats)
+        {
+            for (uint32_t width : { 256u, 1024u, 2048u })
+            {
+                std::vector<uint8_t> src((size_t)width * width * format.bytesPerPixel, 1);
+                std::vector<uint8_t> dst(((size_t)width * format.bytesPerPixel + kRowPitchAlignment) * width);
+                PitchedCopyDesc desc = makeUploadDesc(src, dst, width, format.bytesPerPixel);
+                copy(desc);
+
+                auto start = Benchmark::Clock::now();
+                for (uint32_t i = 0; i < kRepeatCount; i++) copy(desc);
+                double seconds = Benchmark::getSeconds(start);
+                Benchmark::keep(dst[dst.size() / 2]);
+
+                // One op is one row, the report shows the time per row
+                bench.report(label + ", " + format.name + " " + std::to_string(width) + "x" + std::to_string(width) + " (" + std::to_string(src.size() >> 10) + "KB)", (uint64_t)width * kRepeatCount, seconds);
+            }
+        }
+    }
+}
+
+BENCHMARK(PitchedCopy_NaiveRows)
+{
+    runFormats(bench_, "memcpy", [](const PitchedCopyDesc& desc)
+    {
+        for (uint32_t y = 0; y < desc.rowCount; y++)
+        {
+            memcpy((uint8_t*)desc.pDst + y * desc.dstRowPitch, (const uint8_t*)desc.pSrc + y * desc.srcRowPitch, desc.rowSize);
+        }
+    });
+}
+
+BENCHMARK(PitchedCopy_Serial)
+{
+    runFormats(bench_, "serial", [](const PitchedCopyDesc& desc) { copyPitched(desc); });
+}
+
+BENCHMARK(PitchedCopy_Streaming)
+{
+    runFormats(bench_, "streaming", [](const PitchedCopyDesc& desc)
+    {
+        PitchedCopyDesc streamed = desc;
+        streamed.writeCombinedDst = true;
+        copyPitched(streamed);
+    });
+}
+
+BENCHMARK(PitchedCopy_Parallel)
+{
+    WorkerPool::SharedPtr pPool = WorkerPool::create();
+    runFormats(bench_, std::to_string(pPool->getThreadCount()) + " threads", [&](const PitchedCopyDesc& desc) { copyPitched(desc, pPool.get()); });
+}
@@ -0,0 +1,137 @@
+#include <memory>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "Benchmark.h"
+#include "../RingAllocator.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint64_t kFramesInFlight = 3;
+    const uint32_t kFrameCount = 16;
+
+    // Constant-buffer sized uploads with the D3D12 constant-buffer alignment
+    std::vector<uint64_t> makeSizes(uint32_t count)
+    {
+        std::mt19937 rng(42);
+        std::vector<uint64_t> sizes(count);
+        for (auto& size : sizes) size = 16 + rng() % 496;
+        return sizes;
+    }
+
+    /** The bookkeeping of GpuMemoryHeap's Paged mode, with the same containers: pages with a live-allocation count, a map of the used pages and a priority queue of deferred releases ordered by fence value
+    */
+    class PageBookkeeping
+    {
+    public:
+        PageBookkeeping(uint64_t pageSize) : mPageSize(pageSize) { newPage(); }
+
+        void allocate(uint64_t size, uint64_t alignment, uint64_t fenceValue)
+        {
+            uint64_t offset = ((mpActive->offset + alignment - 1) / alignment) * alignment;
+            if (offset + size > mPageSize)
+            {
+                newPage();
+                offset = 0;
+            }
+            mpActive->offset = offset + size;
+            mpActive->allocationCount++;
+            mReleases.push({ mActiveId, fenceValue });
+        }
+
+        void retire(uint64_t completedValue)
+        {
+            while (mReleases.size() && mReleases.top().fenceValue <= completedValue)
+            {
+                uint64_t pageId = mReleases.top().pageId;
+                mReleases.pop();
+                if (pageId == mActiveId)
+                {
+                    if (--mpActive->allocationCount == 0) mpActive->offset = 0;
+                    continue;
+                }
+                auto& pPage = mUsedPages[pageId];
+                if (--pPage->allocationCount == 0)
+                {
+                    mAvailablePages.push(std::move(pPage));
+                    mUsedPages.erase(pageId);
+                }
+            }
+        }
+
+    private:
+        struct Page
+        {
+            uint64_t offset = 0;
+            uint32_t allocationCount = 0;
+        };
+
+        struct Release
+        {
+            uint64_t pageId;
+            uint64_t fenceValue;
+            bool operator<(const Release& other) const { return fenceValue > other.fenceValue; }
+        };
+
+        void newPage()
+        {
+            if (mpActive) mUsedPages[mActiveId] = std::move(mpActive);
+            if (mAvailablePages.size())
+            {
+                mpActive = std::move(mAvailablePages.front());
+                mAvailablePages.pop();
+                mpActive->offset = 0;
+            }
+            else mpActive = std::make_unique<Page>();
+            mActiveId++;
+        }
+
+        uint64_t mPageSize;
+        uint64_t mActiveId = 0;
+        std::unique_ptr<Page> mpActive;
+        std::unordered_map<uint64_t, std::unique_ptr<Page>> mUsedPages;
+        std::queue<std::unique_ptr<Page>> mAvailablePages;
+        std::priority_queue<Release> mReleases;
+    };
+}
+
+BENCHMARK(RingAllocator_FrameAllocations)
+{
+    // Each frame allocates, then retires the frame the GPU finished kFramesInFlight frames ago
+    for (uint32_t perFrame : { 10000u, 100000u, 1000000u })
+    {
+        std::vector<uint64_t> sizes = makeSizes(perFrame);
+        RingAllocator::SharedPtr pRing = RingAllocator::create((kFramesInFlight + 1) * (uint64_t)perFrame * 512);
+
+        auto start = Benchmark::Clock::now();
+        for (uint64_t frame = 1; frame <= kFrameCount; frame++)
+        {
+            if (frame > kFramesInFlight) pRing->retire(frame - kFramesInFlight);
+            for (uint32_t i = 0; i < perFrame; i++) Benchmark::keep(pRing->allocate(sizes[i], 256, frame));
+        }
+        double seconds = Benchmark::getSeconds(start);
+        bench_.report("ring, " + std::to_string(perFrame) + " allocations per frame", (uint64_t)perFrame * kFrameCount, seconds);
+    }
+}
+
+BENCHMARK(RingAllocator_PagedComparison)
+{
+    // The same frames through the per-allocation bookkeeping of the paged heap, with 2MB pages
+    for (uint32_t perFrame : { 10000u, 100000u, 1000000u })
+    {
+        std::vector<uint64_t> sizes = makeSizes(perFrame);
+        PageBookkeeping pages(2 * 1024 * 1024);
+
+        auto start = Benchmark::Clock::now();
+        for (uint64_t frame = 1; frame <= kFrameCount; frame++)
+        {
+            if (frame > kFramesInFlight) pages.retire(frame - kFramesInFlight);
+            for (uint32_t i = 0; i < perFrame; i++) pages.allocate(sizes[i], 256, frame);
+        }
+        double seconds = Benchmark::getSeconds(start);
+        bench_.report("paged, " + std::to_string(perFrame) + " allocations per frame", (uint64_t)perFrame * kFrameCount, seconds);
+    }
+}
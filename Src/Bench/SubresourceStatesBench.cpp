@@ -0,0 +1,59 @@
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "../SubresourceStates.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint32_t kResourceCount = 4096;
+    const uint32_t kStateCount = 8;
+
+    struct Shape
+    {
+        uint32_t mipCount;
+        uint32_t arraySize;
+    };
+}
+
+BENCHMARK(SubresourceStates_RecordAndResolve)
+{
+    // A command list touching every resource several times, whole resources and single mips, then the fix-up pass at submission
+    for (Shape shape : { Shape{ 1, 1 }, Shape{ 12, 1 }, Shape{ 12, 6 }, Shape{ 1, 64 } })
+    {
+        uint32_t subresourceCount = shape.mipCount * shape.arraySize;
+        std::mt19937 rng(42);
+        std::vector<uint32_t> globalStates(subresourceCount);
+        for (auto& state : globalStates) state = 1 + rng() % kStateCount;
+
+        std::vector<SubresourceStates> resources(kResourceCount, SubresourceStates(shape.mipCount, shape.arraySize));
+        std::vector<SubresourceStates::Transition> transitions;
+        std::vector<SubresourceStates::Transition> fixups;
+        uint64_t transitionCount = 0;
+
+        auto start = Benchmark::Clock::now();
+        for (uint32_t pass = 0; pass < 4; pass++)
+        {
+            for (auto& states : resources)
+            {
+                uint32_t mip = rng() % shape.mipCount;
+                SubresourceStates::Range range = { mip, 1, 0, shape.arraySize };
+                states.transition(1 + rng() % kStateCount, (pass & 1) ? &range : nullptr, transitions);
+                transitionCount += transitions.size();
+                transitions.clear();
+            }
+        }
+        for (const auto& states : resources)
+        {
+            states.getFixups(globalStates.data(), fixups);
+            transitionCount += fixups.size();
+            fixups.clear();
+            Benchmark::keep(states.isFinalStateUniform());
+        }
+        double seconds = Benchmark::getSeconds(start);
+        Benchmark::keep(transitionCount);
+        bench_.report(std::to_string(shape.mipCount) + " mips x " + std::to_string(shape.arraySize) + " slices, per resource", kResourceCount * 5ull, seconds);
+    }
+}
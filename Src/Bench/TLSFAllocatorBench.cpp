@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <random>
+#include "Benchmark.h"
+#include "../TLSFAllocator.h"
+
+using namespace WIP3D;
+
+BENCHMARK(TLSFAllocator_AllocateRelease)
+{
+    // Steady state: a fixed number of live allocations, each iteration releases a random one and allocates a new one
+    const uint32_t kIterations = 2000000;
+    for (uint32_t liveCount : { 1024u, 16u * 1024, 64u * 1024 })
+    {
+        TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(1ull << 34, liveCount * 2);
+        std::mt19937 rng(42);
+        std::vector<uint64_t> sizes(4096);
+        for (auto& size : sizes) size = 256 + (rng() % (256 * 1024));
+
+        std::vector<TLSFAllocator::Allocation> live(liveCount);
+        for (uint32_t i = 0; i < liveCount; i++) live[i] = pAllocator->allocate(sizes[i % sizes.size()], 256);
+
+        std::vector<uint32_t> victims(kIterations);
+        for (auto& v : victims) v = rng() % liveCount;
+
+        auto start = Benchmark::Clock::now();
+        for (uint32_t i = 0; i < kIterations; i++)
+        {
+            TLSFAllocator::Allocation& a = live[victims[i]];
+            pAllocator->release(a);
+            a = pAllocator->allocate(sizes[i % sizes.size()], 256);
+        }
+        double seconds = Benchmark::getSeconds(start);
+        bench_.report(std::to_string(liveCount) + " live, 256B-256KB, release + allocate", kIterations, seconds);
+
+        TLSFAllocator::Stats stats = pAllocator->getStats();
+        printf("        fragmentation %.3f, free blocks %u\n", stats.getFragmentation(), stats.freeBlockCount);
+    }
+}
@@ -0,0 +1,197 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Benchmark.h"
+#include "../LockFreeStack.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint64_t kPageSize = 2 * 1024 * 1024;
+    const uint32_t kFrameCount = 8;
+    const uint32_t kAllocationsPerFrame = 400000;   // Split between the threads
+
+    struct Page
+    {
+        uint64_t offset = 0;
+        Page* pNext = nullptr;
+    };
+
+    /** The page hand-off of GpuMemoryHeap::ThreadAllocator: pages are leased from a lock-free free stack, filled by one thread and retired to a lock-free stack.
+        Between frames, recycle() moves the retired pages back to the free stack, like executeDeferredReleases() does once the GPU is done with them.
+    */
+    class PagePool
+    {
+    public:
+        Page* lease()
+        {
+            Page* pPage = mFree.pop();
+            if (pPage == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(mStorageMutex);
+                mStorage.push_back(std::make_unique<Page>());
+                pPage = mStorage.back().get();
+            }
+            pPage->offset = 0;
+            return pPage;
+        }
+
+        void retire(Page* pPage) { mRetired.push(pPage); }
+
+        void recycle()
+        {
+            Page* pPage = mRetired.takeAll();
+            while (pPage)
+            {
+                Page* pNext = pPage->pNext;
+                mFree.push(pPage);
+                pPage = pNext;
+            }
+        }
+
+    private:
+        LockFreeStack<Page> mFree;
+        LockFreeStack<Page> mRetired;
+        std::mutex mStorageMutex;
+        std::vector<std::unique_ptr<Page>> mStorage;
+    };
+
+    class ThreadAllocator
+    {
+    public:
+        ThreadAllocator(PagePool& pool) : mPool(pool) {}
+
+        uint64_t allocate(uint64_t size, uint64_t alignment)
+        {
+            uint64_t offset = mpPage ? ((mpPage->offset + alignment - 1) / alignment) * alignment : 0;
+            if (mpPage == nullptr || offset + size > kPageSize)
+            {
+                flush();
+                mpPage = mPool.lease();
+                offset = 0;
+            }
+            mpPage->offset = offset + size;
+            return offset;
+        }
+
+        void flush()
+        {
+            if (mpPage) mPool.retire(mpPage);
+            mpPage = nullptr;
+        }
+
+    private:
+        PagePool& mPool;
+        Page* mpPage = nullptr;
+    };
+
+    // All threads wait until every thread arrived. The last one runs onLast() before releasing the others
+    class Barrier
+    {
+    public:
+        Barrier(uint32_t count) : mCount(count) {}
+
+        template<typename Func>
+        void arrive(Func onLast)
+        {
+            uint32_t generation = mGeneration.load();
+            if (mArrived.fetch_add(1) + 1 == mCount)
+            {
+                onLast();
+                mArrived = 0;
+                mGeneration++;
+                return;
+            }
+            while (mGeneration.load() == generation) std::this_thread::yield();
+        }
+
+    private:
+        uint32_t mCount;
+        std::atomic<uint32_t> mArrived { 0 };
+        std::atomic<uint32_t> mGeneration { 0 };
+    };
+
+    std::vector<uint64_t> makeSizes()
+    {
+        std::mt19937 rng(42);
+        std::vector<uint64_t> sizes(4096);
+        for (auto& size : sizes) size = 16 + rng() % 496;
+        return sizes;
+    }
+}
+
+BENCHMARK(ThreadAllocator_Scaling)
+{
+    // The same per-frame allocation count split across 1 to 8 threads, each with its own ThreadAllocator
+    std::vector<uint64_t> sizes = makeSizes();
+    for (uint32_t threadCount : { 1u, 2u, 4u, 8u })
+    {
+        PagePool pool;
+        Barrier barrier(threadCount);
+        uint32_t perThread = kAllocationsPerFrame / threadCount;
+        std::vector<uint64_t> offsetSums(threadCount);  // Benchmark::keep() isn't thread-safe
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            ThreadAllocator allocator(pool);
+            uint64_t offsetSum = 0;
+            for (uint32_t frame = 0; frame < kFrameCount; frame++)
+            {
+                for (uint32_t i = 0; i < perThread; i++) offsetSum += allocator.allocate(sizes[(i + threadIndex) % sizes.size()], 256);
+                allocator.flush();
+                barrier.arrive([&]() { pool.recycle(); });
+            }
+            offsetSums[threadIndex] = offsetSum;
+        };
+
+        auto start = Benchmark::Clock::now();
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++) threads.emplace_back(worker, t);
+        for (auto& thread : threads) thread.join();
+        double seconds = Benchmark::getSeconds(start);
+        for (uint64_t offsetSum : offsetSums) Benchmark::keep(offsetSum);
+        bench_.report(std::to_string(threadCount) + " threads, thread allocators", (uint64_t)perThread * threadCount * kFrameCount, seconds);
+    }
+}
+
+BENCHMARK(ThreadAllocator_LockedComparison)
+{
+    // The same frames through a single page behind a lock, which is what sharing one heap between threads would take
+    std::vector<uint64_t> sizes = makeSizes();
+    for (uint32_t threadCount : { 1u, 2u, 4u, 8u })
+    {
+        PagePool pool;
+        ThreadAllocator shared(pool);
+        std::mutex mutex;
+        Barrier barrier(threadCount);
+        uint32_t perThread = kAllocationsPerFrame / threadCount;
+        std::vector<uint64_t> offsetSums(threadCount);
+
+        auto worker = [&](uint32_t threadIndex)
+        {
+            uint64_t offsetSum = 0;
+            for (uint32_t frame = 0; frame < kFrameCount; frame++)
+            {
+                for (uint32_t i = 0; i < perThread; i++)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    offsetSum += shared.allocate(sizes[(i + threadIndex) % sizes.size()], 256);
+                }
+                barrier.arrive([&]() { shared.flush(); pool.recycle(); });
+            }
+            offsetSums[threadIndex] = offsetSum;
+        };
+
+        auto start = Benchmark::Clock::now();
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++) threads.emplace_back(worker, t);
+        for (auto& thread : threads) thread.join();
+        double seconds = Benchmark::getSeconds(start);
+        for (uint64_t offsetSum : offsetSums) Benchmark::keep(offsetSum);
+        bench_.report(std::to_string(threadCount) + " threads, one locked allocator", (uint64_t)perThread * threadCount * kFrameCount, seconds);
+    }
+}
@@ -0,0 +1,200 @@
+#include <fstream>
+#include <sstream>
+#include "Common.h"
+#include "Common/Logger.h"
+#include "CommandCapture.h"
+
+namespace WIP3D
+{
+    CommandCapture::SharedPtr CommandCapture::spActive;
+    thread_local uint32_t CommandCapture::Scope::sDepth = 0;
+
+    namespace
+    {
+        const char* kOpNames[] =
+        {
+            "Flush",
+            "ResourceBarrier",
+            "UavBarrier",
+            "CopyResource",
+            "CopySubresource",
+            "CopyBufferRegion",
+            "CopySubresourceRegion",
+            "UpdateTexture",
+            "UpdateBuffer",
+            "Dispatch",
+            "DispatchIndirect",
+            "ClearUavFloat",
+            "ClearUavUint",
+            "ClearRtv",
+            "ClearDsv",
+            "DrawInstanced",
+            "DrawIndexedInstanced",
+            "DrawIndirect",
+            "DrawIndexedIndirect",
+            "Raytrace",
+            "SetDescriptor",
+            "BindDescriptorSet",
+            "HeapAllocate",
+            "HeapRelease",
+        };
+        static_assert(sizeof(kOpNames) / sizeof(kOpNames[0]) == (size_t)CommandCapture::Op::Count, "kOpNames doesn't match the Op enum");
+
+        bool readVarint(const uint8_t*& pData, const uint8_t* pEnd, uint64_t& value)
+        {
+            value = 0;
+            for (uint32_t shift = 0; shift < 64; shift += 7)
+            {
+                if (pData == pEnd) return false;
+                uint8_t byte = *pData++;
+                value |= (uint64_t)(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) return true;
+            }
+            return false;
+        }
+
+        uint32_t readU32(const uint8_t* pData)
+        {
+            uint32_t value;
+            memcpy(&value, pData, sizeof(value));
+            return value;
+        }
+    }
+
+    CommandCapture::SharedPtr CommandCapture::create()
+    {
+        return SharedPtr(new CommandCapture());
+    }
+
+    CommandCapture::CommandCapture()
+    {
+        clear();
+    }
+
+    void CommandCapture::setActive(const SharedPtr& pCapture)
+    {
+        spActive = pCapture;
+    }
+
+    void CommandCapture::clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mData.clear();
+        mObjectIDs.clear();
+        mCommandCount = 0;
+
+        const uint32_t header[] = { kMagic, kVersion };
+        mData.insert(mData.end(), (const uint8_t*)header, (const uint8_t*)header + sizeof(header));
+    }
+
+    uint64_t CommandCapture::getObjectID(uint64_t pointer)
+    {
+        if (pointer == 0) return 0;
+        auto it = mObjectIDs.find(pointer);
+        if (it != mObjectIDs.end()) return it->second;
+        uint32_t id = (uint32_t)mObjectIDs.size() + 1;
+        mObjectIDs[pointer] = id;
+        return id;
+    }
+
+    void CommandCapture::writeVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            mData.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        mData.push_back((uint8_t)value);
+    }
+
+    void CommandCapture::record(Op op, std::initializer_list<Arg> args)
+    {
+        assert(op < Op::Count && args.size() <= kMaxArgCount);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mData.push_back((uint8_t)op);
+        mData.push_back((uint8_t)args.size());
+        for (const Arg& arg : args)
+        {
+            writeVarint(arg.isObject ? getObjectID(arg.value) : arg.value);
+        }
+        mCommandCount++;
+    }
+
+    bool CommandCapture::saveToFile(const std::string& filename) const
+    {
+        std::ofstream fout(filename, std::ios::binary);
+        if (fout.is_open() == false)
+        {
+            LOG_WARN(("CommandCapture::saveToFile() - can't open " + filename).c_str());
+            return false;
+        }
+        fout.write((const char*)mData.data(), mData.size());
+        return true;
+    }
+
+    bool CommandCapture::loadFromFile(const std::string& filename, std::vector<uint8_t>& data)
+    {
+        std::ifstream fin(filename, std::ios::binary);
+        if (fin.is_open() == false)
+        {
+            LOG_WARN(("CommandCapture::loadFromFile() - can't open " + filename).c_str());
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        if (data.size() < 8 || readU32(data.data()) != kMagic || readU32(data.data() + 4) != kVersion)
+        {
+            LOG_WARN(("CommandCapture::loadFromFile() - " + filename + " is not a command log, or was recorded with a different version").c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool CommandCapture::replay(const std::vector<uint8_t>& data, const ReplayFunc& func)
+    {
+        if (data.size() < 8 || readU32(data.data()) != kMagic || readU32(data.data() + 4) != kVersion) return false;
+
+        const uint8_t* pData = data.data() + 8;
+        const uint8_t* pEnd = data.data() + data.size();
+        Command command;
+        while (pData < pEnd)
+        {
+            if (pEnd - pData < 2) return false;
+            command.op = (Op)pData[0];
+            command.argCount = pData[1];
+            pData += 2;
+            if (command.op >= Op::Count || command.argCount > kMaxArgCount) return false;
+            for (uint32_t i = 0; i < command.argCount; i++)
+            {
+                if (readVarint(pData, pEnd, command.args[i]) == false) return false;
+            }
+            func(command);
+        }
+        return true;
+    }
+
+    bool CommandCapture::replayNull(const std::vector<uint8_t>& data, ReplayStats& stats)
+    {
+        stats = ReplayStats();
+        return replay(data, [&stats](const Command& command)
+        {
+            stats.commandCounts[(uint32_t)command.op]++;
+            stats.commandCount++;
+        });
+    }
+
+    const char* CommandCapture::getOpName(Op op)
+    {
+        return (op < Op::Count) ? kOpNames[(uint32_t)op] : "Unknown";
+    }
+
+    std::string CommandCapture::ReplayStats::toString() const
+    {
+        std::stringstream ss;
+        ss << commandCount << " commands\n";
+        for (uint32_t i = 0; i < (uint32_t)Op::Count; i++)
+        {
+            if (commandCounts[i]) ss << "  " << getOpName((Op)i) << ": " << commandCounts[i] << "\n";
+        }
+        return ss.str();
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace WIP3D
+{
+    /** Records the calls made into the contexts, descriptor sets and GPU memory heaps into a compact binary log, and decodes logs for replay.
+        Only the calls made by the application are recorded, calls made by the engine while executing a recorded call are not. Objects are recorded as IDs assigned in order of first use, 0 is nullptr.
+        The log has no graphics API dependencies, so it can be decoded and replayed on machines without a GPU.
+        Recording is enabled by making a capture active. Calls can be recorded from multiple threads.
+    */
+    class CommandCapture
+    {
+    public:
+        using SharedPtr = std::shared_ptr<CommandCapture>;
+        using SharedConstPtr = std::shared_ptr<const CommandCapture>;
+
+        static const uint32_t kMagic = 0x43504957;  // 'WIPC'
+        static const uint32_t kVersion = 1;
+        static const uint32_t kMaxArgCount = 16;
+
+        enum class Op : uint8_t
+        {
+            Flush,                  ///< context, wait
+            ResourceBarrier,        ///< context, resource, newState
+            UavBarrier,             ///< context, resource
+            CopyResource,           ///< context, dst, src
+            CopySubresource,        ///< context, dst, dstSubresource, src, srcSubresource
+            CopyBufferRegion,       ///< context, dst, dstOffset, src, srcOffset, numBytes
+            CopySubresourceRegion,  ///< context, dst, dstSubresource, src, srcSubresource, dstOffset.xyz, srcOffset.xyz, size.xyz
+            UpdateTexture,          ///< context, texture, firstSubresource, subresourceCount, offset.xyz, size.xyz
+            UpdateBuffer,           ///< context, buffer, offset, numBytes
+            Dispatch,               ///< context, state, vars, x, y, z
+            DispatchIndirect,       ///< context, state, vars, argBuffer, argBufferOffset
+            ClearUavFloat,          ///< context, uav, value.xyzw (floats)
+            ClearUavUint,           ///< context, uav, value.xyzw
+            ClearRtv,               ///< context, rtv, color.rgba (floats)
+            ClearDsv,               ///< context, dsv, depth (float), stencil, clearDepth, clearStencil
+            DrawInstanced,          ///< context, state, vars, vertexCount, instanceCount, startVertex, startInstance
+            DrawIndexedInstanced,   ///< context, state, vars, indexCount, instanceCount, startIndex, baseVertex (signed), startInstance
+            DrawIndirect,           ///< context, state, vars, maxCommandCount, argBuffer, argBufferOffset, countBuffer, countBufferOffset
+            DrawIndexedIndirect,    ///< Same as DrawIndirect
+            Raytrace,               ///< context, program, vars, width, height, depth
+            SetDescriptor,          ///< set, type (0 SRV, 1 UAV, 2 sampler, 3 CBV), rangeIndex, descIndex, view
+            BindDescriptorSet,      ///< context, set, rootSignature, rootIndex, compute
+            HeapAllocate,           ///< heap, size, alignment
+            HeapRelease,            ///< heap, size
+
+            Count
+        };
+
+        /** A recorded argument. Integers are stored as varints, signed integers are zigzag-encoded, floats are stored as their bit pattern and pointers are mapped to object IDs
+        */
+        struct Arg
+        {
+            template<typename T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int>::type = 0>
+            Arg(T v) : value(encode(v, std::is_signed<T>())) {}
+            Arg(const void* pObject) : value((uint64_t)(uintptr_t)pObject), isObject(true) {}
+            Arg(float f) { uint32_t bits; memcpy(&bits, &f, sizeof(bits)); value = bits; }
+
+            uint64_t value = 0;
+            bool isObject = false;
+
+        private:
+            template<typename T> static uint64_t encode(T v, std::true_type) { int64_t s = (int64_t)v; return ((uint64_t)s << 1) ^ (uint64_t)(s >> 63); }
+            template<typename T> static uint64_t encode(T v, std::false_type) { return (uint64_t)v; }
+        };
+
+        /** A decoded command
+        */
+        struct Command
+        {
+            Op op;
+            uint32_t argCount;
+            uint64_t args[kMaxArgCount];
+
+            uint64_t getUint(uint32_t i) const { return args[i]; }
+            int64_t getInt(uint32_t i) const { return (int64_t)(args[i] >> 1) ^ -(int64_t)(args[i] & 1); }
+            float getFloat(uint32_t i) const { uint32_t bits = (uint32_t)args[i]; float f; memcpy(&f, &bits, sizeof(f)); return f; }
+            uint32_t getObject(uint32_t i) const { return (uint32_t)args[i]; }
+        };
+
+        /** Per-op command counts of a log
+        */
+        struct ReplayStats
+        {
+            uint64_t commandCounts[(uint32_t)Op::Count] = {};
+            uint64_t commandCount = 0;
+
+            std::string toString() const;
+        };
+
+        using ReplayFunc = std::function<void(const Command& command)>;
+
+        /** Create a new capture
+        */
+        static SharedPtr create();
+
+        /** Set the capture recording the calls. Pass nullptr to stop recording.
+            Only change it between frames, while no thread is recording.
+        */
+        static void setActive(const SharedPtr& pCapture);
+        static CommandCapture* getActive() { return spActive.get(); }
+
+        /** Record a call
+        */
+        void record(Op op, std::initializer_list<Arg> args);
+
+        /** Drop the recorded calls and the object IDs
+        */
+        void clear();
+
+        const std::vector<uint8_t>& getData() const { return mData; }
+        uint64_t getCommandCount() const { return mCommandCount; }
+
+        /** Write the log to a file.
+            \return true on success, false if the file couldn't be opened.
+        */
+        bool saveToFile(const std::string& filename) const;
+
+        /** Read a log from a file.
+            \return true on success, false if the file couldn't be read or isn't a log.
+        */
+        static bool loadFromFile(const std::string& filename, std::vector<uint8_t>& data);
+
+        /** Decode a log and call func for every command, in recording order.
+            \return false if the log is malformed. The commands before the error were replayed.
+        */
+        static bool replay(const std::vector<uint8_t>& data, const ReplayFunc& func);
+
+        /** Replay a log against a backend that does nothing but count the commands. Used to measure the decoding overhead and to validate logs.
+        */
+        static bool replayNull(const std::vector<uint8_t>& data, ReplayStats& stats);
+
+        static const char* getOpName(Op op);
+
+        /** Records the call it was created for, unless it was created while another call is being recorded on the same thread
+        */
+        class Scope
+        {
+        public:
+            Scope(Op op, std::initializer_list<Arg> args)
+            {
+                if (sDepth++ == 0)
+                {
+                    CommandCapture* pCapture = getActive();
+                    if (pCapture) pCapture->record(op, args);
+                }
+            }
+            ~Scope() { sDepth--; }
+        private:
+            static thread_local uint32_t sDepth;
+        };
+
+    private:
+        CommandCapture();
+        uint64_t getObjectID(uint64_t pointer);
+        void writeVarint(uint64_t value);
+
+        static SharedPtr spActive;
+
+        std::mutex mMutex;
+        std::vector<uint8_t> mData;
+        std::unordered_map<uint64_t, uint32_t> mObjectIDs;
+        uint64_t mCommandCount = 0;
+    };
+}
+
+/** Record the current call into the active capture
+*/
+#define CAPTURE_COMMAND(op_, ...) WIP3D::CommandCapture::Scope captureScope_(WIP3D::CommandCapture::Op::op_, { __VA_ARGS__ })
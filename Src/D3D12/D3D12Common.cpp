@@ -1,8 +1,10 @@
+#include <algorithm>
 #include "WIPD3D12.h"
 #include "../Common/Logger.h"
 #include "../GraphicsCommon.h"
 #include "../Device.h"
 #include "../GPUMemory.h"
+#include "../StableHash.h"
 #include "../Util.h"
 
 
@@ -53,7 +55,7 @@ namespace WIP3D
 		//If the device has been removed, the return value will be UINT64_MAX.
 		return mApiHandle->GetCompletedValue();
 	}
-	void GpuFence::syncGpu(CommandQueueHandle pQueue)
+	void GpuFence::syncGpu(CommandQueueHandle pQueue, uint64_t val)
 	{
 		// Queues a GPU-side wait, and returns immediately. A GPU-side wait is where the GPU waits 
 		// until the specified fence reaches or exceeds the specified value.
@@ -62,7 +64,9 @@ namespace WIP3D
 		// to reach or exceed. 
 		// So when ID3D12Fence::GetCompletedValue is greater than or equal to Value, \
 		// the wait is terminated.
-		d3d_call(pQueue->Wait(mApiHandle, mCpuValue - 1));
+		uint64_t syncVal = val ? val : mCpuValue - 1;
+		assert(syncVal <= mCpuValue - 1);
+		d3d_call(pQueue->Wait(mApiHandle, syncVal));
 	}
 	void GpuFence::syncCpu(uint64_t val)
 	{
@@ -86,6 +90,29 @@ namespace WIP3D
 		return mCpuValue - 1;
 	}
 
+	QueryHeap::QueryHeap(Type type, uint32_t count)
+		: mCount(count)
+		, mType(type)
+	{
+		D3D12_QUERY_HEAP_DESC desc = {};
+		desc.Count = count;
+		switch (type)
+		{
+		case Type::Timestamp:
+			desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+			break;
+		case Type::Occlusion:
+			desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+			break;
+		case Type::PipelineStats:
+			desc.Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS;
+			break;
+		default:
+			should_not_get_here();
+		}
+		d3d_call(gpDevice->getApiHandle()->CreateQueryHeap(&desc, IID_PPV_ARGS(&mApiHandle)));
+	}
+
 
 	D3D12_DESCRIPTOR_HEAP_TYPE falcorToDxDescType(DescriptorPool::Type t)
 	{
@@ -141,4 +168,319 @@ namespace WIP3D
 		assert(heapIndex < ARRAY_COUNT(mpApiData->pHeaps));
 		return mpApiData->pHeaps[heapIndex]->getApiHandle();
 	}
+
+	DescriptorPool::Stats DescriptorPool::getStats() const
+	{
+		Stats stats;
+		stats.totalDescCount = mDesc.mTotalDescCount;
+		stats.deferredReleaseCount = (uint32_t)mpDeferredReleases.size();
+		for (const auto& pHeap : mpApiData->pHeaps)
+		{
+			if (pHeap) stats.usedDescCount += pHeap->getUsedDescCount();
+		}
+		return stats;
+	}
+
+	TransientDescriptorRing::SharedPtr TransientDescriptorRing::create(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence)
+	{
+		assert(pHeap && pFence);
+		return SharedPtr(new TransientDescriptorRing(pHeap, descCount, pFence));
+	}
+
+	TransientDescriptorRing::TransientDescriptorRing(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence)
+		: mpHeap(pHeap)
+		, mpFence(pFence)
+	{
+		mAllocation = mpHeap->allocateDescriptors(descCount);
+		if (mAllocation == D3D12DescriptorHeap::kInvalidAllocation) throw std::exception("TransientDescriptorRing::create() - can't reserve the ring from the descriptor heap");
+		mDescCount = descCount;
+	}
+
+	TransientDescriptorRing::~TransientDescriptorRing()
+	{
+		mpHeap->releaseDescriptors(mAllocation);
+	}
+
+	TransientDescriptorRing::Table TransientDescriptorRing::allocateTable(uint32_t descCount)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return allocate(descCount);
+	}
+
+	TransientDescriptorRing::Table TransientDescriptorRing::allocate(uint32_t descCount)
+	{
+		assert(descCount > 0);
+		if (descCount > mDescCount) throw std::exception("TransientDescriptorRing::allocateTable() - table is larger than the ring");
+
+		// Tables must be contiguous, so a table that doesn't fit at the end of the ring wastes the tail and starts over at the beginning
+		auto getWaste = [this, descCount]() { return (mHead + descCount > mDescCount) ? mDescCount - mHead : 0; };
+		if (mUsed + getWaste() + descCount > mDescCount)
+		{
+			retireFrames(mpFence->getGpuValue());
+			if (mUsed + getWaste() + descCount > mDescCount) throw std::exception("TransientDescriptorRing::allocateTable() - the ring is full. Increase its size");
+		}
+
+		uint32_t waste = getWaste();
+		uint32_t offset = waste ? 0 : mHead;
+		mHead = offset + descCount;
+		mUsed += waste + descCount;
+
+		uint64_t fenceValue = mpFence->getCpuValue();
+		if (mFrames.empty() || mFrames.back().fenceValue != fenceValue) mFrames.push_back({ fenceValue, 0 });
+		mFrames.back().descCount += waste + descCount;
+
+		Table table;
+		table.cpuHandle = mpHeap->getCpuHandle(mAllocation, offset);
+		table.gpuHandle = mpHeap->getGpuHandle(mAllocation, offset);
+		table.descCount = descCount;
+		return table;
+	}
+
+	TransientDescriptorRing::GpuHandle TransientDescriptorRing::copyTable(CpuHandle srcStart, uint32_t descCount)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Table table = allocate(descCount);
+		gpDevice->getApiHandle()->CopyDescriptorsSimple(descCount, table.cpuHandle, srcStart, getType());
+		return table.gpuHandle;
+	}
+
+	TransientDescriptorRing::GpuHandle TransientDescriptorRing::copyTable(const CpuHandle* pSrcHandles, uint32_t descCount)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Table table = allocate(descCount);
+		if (mSrcRangeSizes.size() < descCount) mSrcRangeSizes.resize(descCount, 1);
+		gpDevice->getApiHandle()->CopyDescriptors(1, &table.cpuHandle, &descCount, descCount, pSrcHandles, mSrcRangeSizes.data(), getType());
+		return table.gpuHandle;
+	}
+
+	void TransientDescriptorRing::executeDeferredReleases()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		retireFrames(mpFence->getGpuValue());
+	}
+
+	uint32_t TransientDescriptorRing::getUsedDescCount() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mUsed;
+	}
+
+	void TransientDescriptorRing::retireFrames(uint64_t gpuVal)
+	{
+		while (mFrames.size() && mFrames.front().fenceValue <= gpuVal)
+		{
+			mUsed -= mFrames.front().descCount;
+			mFrames.pop_front();
+		}
+
+		// Nothing in flight, start over to avoid wasting the tail
+		if (mUsed == 0) mHead = 0;
+	}
+
+	DescriptorTableCache::SharedPtr DescriptorTableCache::create(const D3D12DescriptorHeap::SharedPtr& pHeap, const std::shared_ptr<GpuFence>& pFence, uint32_t maxAge)
+	{
+		assert(pHeap && pFence);
+		return SharedPtr(new DescriptorTableCache(pHeap, pFence, maxAge));
+	}
+
+	DescriptorTableCache::DescriptorTableCache(const D3D12DescriptorHeap::SharedPtr& pHeap, const std::shared_ptr<GpuFence>& pFence, uint32_t maxAge)
+		: mpHeap(pHeap)
+		, mpFence(pFence)
+		, mMaxAge(maxAge)
+	{
+	}
+
+	DescriptorTableCache::~DescriptorTableCache()
+	{
+		for (auto& e : mEntries) mpHeap->releaseDescriptors(e.second.allocation);
+	}
+
+	uint64_t DescriptorTableCache::hashContent(uint64_t layoutHash, const std::shared_ptr<DescriptorSet>* pSrcSets, uint32_t descCount)
+	{
+		// The cache only lives in memory, so the set addresses are a valid part of the key
+		StableHash hash;
+		hash.add(layoutHash);
+		for (uint32_t i = 0; i < descCount; i++) hash.add((uint64_t)(uintptr_t)pSrcSets[i].get());
+		return hash.get();
+	}
+
+	DescriptorTableCache::GpuHandle DescriptorTableCache::findOrCreate(uint64_t layoutHash, uint64_t contentHash, const std::shared_ptr<DescriptorSet>* pSrcSets, uint32_t descCount)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		uint64_t fenceValue = mpFence->getCpuValue();
+		auto range = mEntries.equal_range(contentHash);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			Entry& e = it->second;
+			if (e.layoutHash != layoutHash || e.pSrcSets.size() != descCount) continue;
+			if (std::equal(e.pSrcSets.begin(), e.pSrcSets.end(), pSrcSets) == false) continue;
+
+			e.lastUsedFenceValue = fenceValue;
+			mHitCount++;
+			return mpHeap->getGpuHandle(e.allocation, 0);
+		}
+
+		mMissCount++;
+		D3D12DescriptorHeap::Allocation allocation = mpHeap->allocateDescriptors(descCount);
+		if (allocation == D3D12DescriptorHeap::kInvalidAllocation)
+		{
+			// Drop everything the GPU is done with and try again
+			evict(mpFence->getGpuValue());
+			allocation = mpHeap->allocateDescriptors(descCount);
+			if (allocation == D3D12DescriptorHeap::kInvalidAllocation) return {};
+		}
+
+		mSrcHandles.resize(descCount);
+		for (uint32_t i = 0; i < descCount; i++) mSrcHandles[i] = pSrcSets[i]->getCpuHandle(0);
+		if (mSrcRangeSizes.size() < descCount) mSrcRangeSizes.resize(descCount, 1);
+
+		D3D12DescriptorHeap::CpuHandle dstHandle = mpHeap->getCpuHandle(allocation, 0);
+		gpDevice->getApiHandle()->CopyDescriptors(1, &dstHandle, &descCount, descCount, mSrcHandles.data(), mSrcRangeSizes.data(), mpHeap->getType());
+
+		Entry e;
+		e.layoutHash = layoutHash;
+		e.pSrcSets.assign(pSrcSets, pSrcSets + descCount);
+		e.allocation = allocation;
+		e.lastUsedFenceValue = fenceValue;
+		mEntries.emplace(contentHash, std::move(e));
+		mCachedDescCount += descCount;
+		return mpHeap->getGpuHandle(allocation, 0);
+	}
+
+	void DescriptorTableCache::evict(uint64_t maxFenceValue)
+	{
+		for (auto it = mEntries.begin(); it != mEntries.end();)
+		{
+			if (it->second.lastUsedFenceValue <= maxFenceValue)
+			{
+				mCachedDescCount -= (uint32_t)it->second.pSrcSets.size();
+				mpHeap->releaseDescriptors(it->second.allocation);
+				it = mEntries.erase(it);
+				mEvictionCount++;
+			}
+			else it++;
+		}
+	}
+
+	void DescriptorTableCache::executeDeferredReleases()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		uint64_t cpuVal = mpFence->getCpuValue();
+		if (cpuVal <= mMaxAge) return;
+		evict(std::min(cpuVal - mMaxAge, mpFence->getGpuValue()));
+	}
+
+	void DescriptorTableCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		evict(mpFence->getGpuValue());
+	}
+
+	DescriptorTableCache::Stats DescriptorTableCache::getStats() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Stats stats;
+		stats.entryCount = (uint32_t)mEntries.size();
+		stats.cachedDescCount = mCachedDescCount;
+		stats.hitCount = mHitCount;
+		stats.missCount = mMissCount;
+		stats.evictionCount = mEvictionCount;
+		return stats;
+	}
+
+	BindlessDescriptorTable::SharedPtr BindlessDescriptorTable::create(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence)
+	{
+		assert(pHeap && pFence);
+		if (pHeap->getType() != D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) throw std::exception("BindlessDescriptorTable::create() - the heap must be a CBV/SRV/UAV heap");
+		return SharedPtr(new BindlessDescriptorTable(pHeap, descCount, pFence));
+	}
+
+	BindlessDescriptorTable::BindlessDescriptorTable(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence)
+		: mpHeap(pHeap)
+		, mpFence(pFence)
+	{
+		mAllocation = mpHeap->allocateDescriptors(descCount);
+		if (mAllocation == D3D12DescriptorHeap::kInvalidAllocation) throw std::exception("BindlessDescriptorTable::create() - can't reserve the table from the descriptor heap");
+		mDescCount = descCount;
+	}
+
+	BindlessDescriptorTable::~BindlessDescriptorTable()
+	{
+		mpHeap->releaseDescriptors(mAllocation);
+	}
+
+	uint32_t BindlessDescriptorTable::allocate(CpuHandle srcHandle)
+	{
+		uint32_t index = kInvalidIndex;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFreeIndices.size())
+			{
+				index = mFreeIndices.back();
+				mFreeIndices.pop_back();
+			}
+			else if (mBumpIndex < mDescCount)
+			{
+				index = mBumpIndex++;
+			}
+		}
+
+		if (index == kInvalidIndex)
+		{
+			LOG_WARN("BindlessDescriptorTable::allocate() - the table is full");
+			return kInvalidIndex;
+		}
+
+		gpDevice->getApiHandle()->CopyDescriptorsSimple(1, mpHeap->getCpuHandle(mAllocation, index), srcHandle, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		return index;
+	}
+
+	void BindlessDescriptorTable::release(uint32_t index)
+	{
+		assert(index < mDescCount);
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDeferredReleases.push_back({ index, mpFence->getCpuValue() });
+	}
+
+	void BindlessDescriptorTable::executeDeferredReleases()
+	{
+		uint64_t gpuVal = mpFence->getGpuValue();
+		std::lock_guard<std::mutex> lock(mMutex);
+		while (mDeferredReleases.size() && mDeferredReleases.front().fenceValue <= gpuVal)
+		{
+			mFreeIndices.push_back(mDeferredReleases.front().index);
+			mDeferredReleases.pop_front();
+		}
+	}
+
+	uint32_t BindlessDescriptorTable::getUsedDescCount() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mBumpIndex - (uint32_t)mFreeIndices.size();
+	}
+
+	void BindlessDescriptorTable::getDescriptorRanges(D3D12_DESCRIPTOR_RANGE1 ranges[2])
+	{
+		// The ranges alias each other, so the descriptors are volatile. Offsets must be explicit since the ranges are unbounded
+		ranges[0] = {};
+		ranges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+		ranges[0].NumDescriptors = UINT_MAX;
+		ranges[0].RegisterSpace = kSrvSpace;
+		ranges[0].Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+		ranges[0].OffsetInDescriptorsFromTableStart = 0;
+
+		ranges[1] = ranges[0];
+		ranges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+		ranges[1].RegisterSpace = kUavSpace;
+	}
+
+	void BindlessDescriptorTable::bindForGraphics(CopyContext* pCtx, uint32_t rootIndex) const
+	{
+		pCtx->getLowLevelData()->getCommandList()->SetGraphicsRootDescriptorTable(rootIndex, getGpuHandle());
+	}
+
+	void BindlessDescriptorTable::bindForCompute(CopyContext* pCtx, uint32_t rootIndex) const
+	{
+		pCtx->getLowLevelData()->getCommandList()->SetComputeRootDescriptorTable(rootIndex, getGpuHandle());
+	}
 }
\ No newline at end of file
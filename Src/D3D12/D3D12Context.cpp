@@ -1,5 +1,9 @@
+#include <cstring>
+#include "../CommandCapture.h"
 #include "../Device.h"
 #include "../GraphicsContext.h"
+#include "../PipeplineStateObject.h"
+#include "../PitchedCopy.h"
 #include "../Util.h"
 
 namespace WIP3D
@@ -7,7 +11,12 @@ namespace WIP3D
     struct LowLevelContextApiData
     {
         FencedPool<CommandAllocatorHandle>::SharedPtr pAllocatorPool;
+        D3D12_COMMAND_LIST_TYPE cmdListType;
+        CommandListHandle pFixupList;   // Records the state fix-ups of command lists recorded with a local state tracker
     };
+
+    // Once a context has this many allocators in flight, flush() waits for the GPU instead of creating more
+    static const uint32_t kMaxCommandAllocatorCount = 32;
     template<D3D12_COMMAND_LIST_TYPE type>
     static ID3D12CommandAllocatorPtr newCommandAllocator(void* pUserData)
     {
@@ -28,31 +37,32 @@ namespace WIP3D
         return (FAILED(hr)) ? nullptr : pList;
     }
 
-    LowLevelContextData::SharedPtr LowLevelContextData::create(CommandQueueType type, CommandQueueHandle queue)
+    LowLevelContextData::SharedPtr LowLevelContextData::create(CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence)
     {
-        return SharedPtr(new LowLevelContextData(type, queue));
+        return SharedPtr(new LowLevelContextData(type, queue, pFence));
     }
 
-    LowLevelContextData::LowLevelContextData(CommandQueueType type, CommandQueueHandle queue)
+    LowLevelContextData::LowLevelContextData(CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence)
         : mType(type)
         , mpQueue(queue)
     {
-        mpFence = GpuFence::create();
+        mpFence = pFence ? pFence : GpuFence::create();
         mpApiData = new LowLevelContextApiData;
         assert(mpFence && mpApiData);
 
         // Create a command allocator
         D3D12_COMMAND_LIST_TYPE cmdListType = gpDevice->getApiCommandQueueType(type);
+        mpApiData->cmdListType = cmdListType;
         switch (cmdListType)
         {
         case D3D12_COMMAND_LIST_TYPE_DIRECT:
-            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_DIRECT>);
+            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_DIRECT>, nullptr, kMaxCommandAllocatorCount);
             break;
         case D3D12_COMMAND_LIST_TYPE_COMPUTE:
-            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_COMPUTE>);
+            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_COMPUTE>, nullptr, kMaxCommandAllocatorCount);
             break;
         case D3D12_COMMAND_LIST_TYPE_COPY:
-            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_COPY>);
+            mpApiData->pAllocatorPool = FencedPool<CommandAllocatorHandle>::create(mpFence, newCommandAllocator<D3D12_COMMAND_LIST_TYPE_COPY>, nullptr, kMaxCommandAllocatorCount);
             break;
         default:
             should_not_get_here();
@@ -69,22 +79,70 @@ namespace WIP3D
         safe_delete(mpApiData);
     }
 
-    void LowLevelContextData::flush()
+    void LowLevelContextData::flush(const D3D12_RESOURCE_BARRIER* pFixups, uint32_t fixupCount)
     {
         // رlist record commandsУеrecordsзֵ
         // https://docs.microsoft.com/zh-cn/windows/win32/api/d3d12/nf-d3d12-id3d12graphicscommandlist-close
         d3d_call(mpList->Close());
-        ID3D12CommandList* pList = mpList.GetInterfacePtr();
+        ID3D12CommandList* pLists[2];
+        uint32_t listCount = 0;
         assert(mpQueue);
+
+        // The fix-up barriers go into their own command list, submitted right before the main one
+        CommandAllocatorHandle pFixupAllocator;
+        if (fixupCount)
+        {
+            pFixupAllocator = mpApiData->pAllocatorPool->acquire();
+            d3d_call(pFixupAllocator->Reset());
+            if (mpApiData->pFixupList)
+            {
+                d3d_call(mpApiData->pFixupList->Reset(pFixupAllocator, nullptr));
+            }
+            else
+            {
+                d3d_call(gpDevice->getApiHandle()->CreateCommandList(0, mpApiData->cmdListType, pFixupAllocator, nullptr, IID_PPV_ARGS(&mpApiData->pFixupList)));
+            }
+            mpApiData->pFixupList->ResourceBarrier(fixupCount, pFixups);
+            d3d_call(mpApiData->pFixupList->Close());
+            pLists[listCount++] = mpApiData->pFixupList.GetInterfacePtr();
+        }
+        pLists[listCount++] = mpList.GetInterfacePtr();
         // https://docs.microsoft.com/en-us/windows/win32/api/d3d12/nf-d3d12-id3d12commandqueue-executecommandlists
         // commandlistֱһδ˺֤򣬵ͬʱȥͲһͬʱִеģҲܵڶִ
         // ŻĽʹһExecuteCommandListsύеcommand lists
-        mpQueue->ExecuteCommandLists(1, &pList);
+        mpQueue->ExecuteCommandLists(listCount, pLists);
         // ָͬǲȴ
-        mpFence->gpuSignal(mpQueue);
+        uint64_t fenceValue = mpFence->gpuSignal(mpQueue);
+        if (pFixupAllocator) mpApiData->pAllocatorPool->retire(pFixupAllocator, mpFence, fenceValue);
+        resetCommandList(fenceValue);
+    }
+
+    void LowLevelContextData::flushWithSecondaries(LowLevelContextData* const* ppSecondaries, uint32_t secondaryCount)
+    {
+        assert(mpQueue);
+        std::vector<ID3D12CommandList*> pLists(secondaryCount + 1);
+        d3d_call(mpList->Close());
+        pLists[0] = mpList.GetInterfacePtr();
+        for (uint32_t i = 0; i < secondaryCount; i++)
+        {
+            assert(ppSecondaries[i]->mpFence == mpFence);
+            d3d_call(ppSecondaries[i]->mpList->Close());
+            pLists[i + 1] = ppSecondaries[i]->mpList.GetInterfacePtr();
+        }
+
+        // A single submission, executed in order
+        mpQueue->ExecuteCommandLists((UINT)pLists.size(), pLists.data());
+        uint64_t fenceValue = mpFence->gpuSignal(mpQueue);
+
+        resetCommandList(fenceValue);
+        for (uint32_t i = 0; i < secondaryCount; i++) ppSecondaries[i]->resetCommandList(fenceValue);
+    }
+
+    void LowLevelContextData::resetCommandList(uint64_t fenceValue)
+    {
         // һµķ
         // ˴Ķ󲢲һcacheģΪǰһָһѾִ
-        mpAllocator = mpApiData->pAllocatorPool->newObject();
+        mpAllocator = mpApiData->pAllocatorPool->newObject(mpFence, fenceValue);
         // ˷cacheģ½ģresetԱ
         // https://docs.microsoft.com/en-us/windows/win32/api/d3d12/nf-d3d12-id3d12commandallocator-reset
         d3d_call(mpAllocator->Reset());
@@ -95,6 +153,9 @@ namespace WIP3D
 
     void CopyContext::bindDescriptorHeaps()
     {
+        // Copy command lists can't set descriptor heaps
+        if (mpLowLevelData->getType() == LowLevelContextData::CommandQueueType::Copy) return;
+
         const DescriptorPool* pGpuPool = gpDevice->getGpuDescriptorPool().get();
         const DescriptorPool::ApiData* pData = pGpuPool->getApiData();
         ID3D12DescriptorHeap* pHeaps[ARRAY_COUNT(pData->pHeaps)];
@@ -110,31 +171,28 @@ namespace WIP3D
         mpLowLevelData->getCommandList()->SetDescriptorHeaps(heapCount, pHeaps);
     }
 
-    //
+    // The destination is in the upload ring, which is write-combined memory
     void copySubresourceData(const D3D12_SUBRESOURCE_DATA& srcData, 
         const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& dstFootprint, uint8_t* pDstStart, 
-        uint64_t rowSize, uint64_t rowsToCopy)
+        uint64_t rowSize, uint64_t rowsToCopy, WorkerPool* pPool)
     {
-        const uint8_t* pSrc = (uint8_t*)srcData.pData;
-        uint8_t* pDst = pDstStart + dstFootprint.Offset;
-        const D3D12_SUBRESOURCE_FOOTPRINT& dstData = dstFootprint.Footprint;
-
-        for (uint32_t z = 0; z < dstData.Depth; z++)
-        {
-            uint8_t* pDstSlice = pDst + rowsToCopy * dstData.RowPitch * z;
-            const uint8_t* pSrcSlice = pSrc + srcData.SlicePitch * z;
-
-            for (uint32_t y = 0; y < rowsToCopy; y++)
-            {
-                const uint8_t* pSrcRow = pSrcSlice + srcData.RowPitch * y;
-                uint8_t* pDstRow = pDstSlice + dstData.RowPitch * y;
-                memcpy(pDstRow, pSrcRow, rowSize);
-            }
-        }
+        PitchedCopyDesc desc;
+        desc.pSrc = srcData.pData;
+        desc.pDst = pDstStart + dstFootprint.Offset;
+        desc.rowSize = (size_t)rowSize;
+        desc.rowCount = (uint32_t)rowsToCopy;
+        desc.sliceCount = dstFootprint.Footprint.Depth;
+        desc.srcRowPitch = (size_t)srcData.RowPitch;
+        desc.srcSlicePitch = (size_t)srcData.SlicePitch;
+        desc.dstRowPitch = dstFootprint.Footprint.RowPitch;
+        desc.dstSlicePitch = (size_t)rowsToCopy * dstFootprint.Footprint.RowPitch;
+        desc.writeCombinedDst = true;
+        copyPitched(desc, pPool);
     }
 
     void CopyContext::updateTextureSubresources(const Texture* pTexture, uint32_t firstSubresource, uint32_t subresourceCount, const void* pData, const uint3& offset, const uint3& size)
     {
+        CAPTURE_COMMAND(UpdateTexture, this, pTexture, firstSubresource, subresourceCount, offset.x, offset.y, offset.z, size.x, size.y, size.z);
         bool copyRegion = (offset != uint3(0)) || (size != uint3(-1));
         assert(subresourceCount == 1 || (copyRegion == false));
 
@@ -169,15 +227,13 @@ namespace WIP3D
             pDevice->GetCopyableFootprints(&texDesc, firstSubresource, subresourceCount, 0, footprint.data(), rowCount.data(), rowSize.data(), &bufferSize);
         }
 
-        // Allocate a buffer on the upload heap
-        Buffer::SharedPtr pBuffer = Buffer::create(bufferSize, Buffer::BindFlags::None, Buffer::CpuAccess::Write, nullptr);
-        // Map the buffer
-        uint8_t* pDst = (uint8_t*)pBuffer->map(Buffer::MapType::WriteDiscard);
-        ID3D12ResourcePtr pResource = pBuffer->getApiHandle();
+        // Stage the data in the upload ring. The copies are recorded with the other pending uploads
+        GpuMemoryHeap::Allocation staging = allocateStagingMemory((size_t)bufferSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+        uint8_t* pDst = staging.pData;
 
-        // Get the offset from the beginning of the resource
-        uint64_t vaOffset = pBuffer->getGpuAddressOffset();
+        mStagingUpload = true;
         resourceBarrier(pTexture, Resource::State::CopyDest);
+        mStagingUpload = false;
 
         const uint8_t* pSrc = (uint8_t*)pData;
         for (uint32_t s = 0; s < subresourceCount; s++)
@@ -189,83 +245,158 @@ namespace WIP3D
             src.pData = pSrc;
             src.RowPitch = physicalWidth * getFormatBytesPerBlock(pTexture->getFormat());
             src.SlicePitch = src.RowPitch * physicalHeight;
-            copySubresourceData(src, footprint[s], pDst, rowSize[s], rowCount[s]);
+            copySubresourceData(src, footprint[s], pDst, rowSize[s], rowCount[s], mpWorkerPool);
             pSrc = (uint8_t*)pSrc + footprint[s].Footprint.Depth * src.SlicePitch;
 
-            // Dispatch a command
-            footprint[s].Offset += vaOffset;
-            uint32_t subresource = s + firstSubresource;
-            D3D12_TEXTURE_COPY_LOCATION dstLoc = { pTexture->getApiHandle(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, subresource };
-            D3D12_TEXTURE_COPY_LOCATION srcLoc = { pResource, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, footprint[s] };
+            PendingUpload upload;
+            upload.pDst = pTexture->getApiHandle();
+            upload.pSrc = staging.pResourceHandle;
+            upload.dstSubresource = s + firstSubresource;
+            upload.dstOrigin = offset;
+            upload.srcFootprint = footprint[s];
+            upload.srcFootprint.Offset += staging.offset;
+            mPendingUploads.push_back(upload);
+        }
+    }
 
-            mpLowLevelData->getCommandList()->CopyTextureRegion(&dstLoc, offset.x, offset.y, offset.z, &srcLoc, nullptr);
+    GpuMemoryHeap::Allocation CopyContext::allocateStagingMemory(size_t size, size_t alignment)
+    {
+        if (mpStagingHeap == nullptr)
+        {
+            mpStagingHeap = GpuMemoryHeap::create(GpuMemoryHeap::Type::Upload, kStagingRingSize, mpLowLevelData->getFence(), GpuMemoryHeap::Mode::Ring);
         }
+        return mpStagingHeap->allocate(size, alignment);
+    }
 
-        pBuffer->unmap();
+    void CopyContext::uploadBufferData(const Buffer* pBuffer, const void* pData, size_t offset, size_t numBytes)
+    {
+        GpuMemoryHeap::Allocation staging = allocateStagingMemory(numBytes, 16);
+        PitchedCopyDesc desc;
+        desc.pSrc = pData;
+        desc.pDst = staging.pData;
+        desc.rowSize = numBytes;
+        desc.writeCombinedDst = true;
+        copyPitched(desc, mpWorkerPool);
+
+        mStagingUpload = true;
+        resourceBarrier(pBuffer, Resource::State::CopyDest);
+        mStagingUpload = false;
+
+        PendingUpload upload;
+        upload.pDst = pBuffer->getApiHandle();
+        upload.pSrc = staging.pResourceHandle;
+        upload.size = numBytes;
+        upload.dstOffset = offset;
+        upload.srcOffset = staging.offset;
+        mPendingUploads.push_back(upload);
     }
 
     CopyContext::ReadTextureTask::SharedPtr CopyContext::ReadTextureTask::create(CopyContext* pCtx, const Texture* pTexture, uint32_t subresourceIndex)
     {
         SharedPtr pThis = SharedPtr(new ReadTextureTask);
-        pThis->mpContext = pCtx;
         //Get footprint
         D3D12_RESOURCE_DESC texDesc = pTexture->getApiHandle()->GetDesc();
-        D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = pThis->mFootprint;
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+        uint32_t rowCount;
         uint64_t rowSize;
         uint64_t size;
         ID3D12Device* pDevice = gpDevice->getApiHandle();
-        pDevice->GetCopyableFootprints(&texDesc, subresourceIndex, 1, 0, &footprint, &pThis->mRowCount, &rowSize, &size);
+        pDevice->GetCopyableFootprints(&texDesc, subresourceIndex, 1, 0, &footprint, &rowCount, &rowSize, &size);
 
-        //Create buffer
-        pThis->mpBuffer = Buffer::create(size, Buffer::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+        // Get memory from the readback pool
+        if (pCtx->mpReadbackHeap == nullptr)
+        {
+            pCtx->mpReadbackHeap = GpuMemoryHeap::create(GpuMemoryHeap::Type::Readback, kReadbackPageSize, pCtx->mpLowLevelData->getFence());
+        }
+        pThis->mpHeap = pCtx->mpReadbackHeap;
+        pThis->mAllocation = pThis->mpHeap->allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+        footprint.Offset = pThis->mAllocation.offset;
 
         //Copy from texture to buffer
         D3D12_TEXTURE_COPY_LOCATION srcLoc = { pTexture->getApiHandle(), D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, subresourceIndex };
-        D3D12_TEXTURE_COPY_LOCATION dstLoc = { pThis->mpBuffer->getApiHandle(), D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, footprint };
+        D3D12_TEXTURE_COPY_LOCATION dstLoc = { pThis->mAllocation.pResourceHandle, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, footprint };
         pCtx->resourceBarrier(pTexture, Resource::State::CopySource);
+        pCtx->flushBarriers();
         pCtx->getLowLevelData()->getCommandList()->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
         pCtx->setPendingCommands(true);
 
-        // Create a fence and signal
-        pThis->mpFence = GpuFence::create();
-        pCtx->flush(false);
-        pThis->mpFence->gpuSignal(pCtx->getLowLevelData()->getCommandQueue());
-        pThis->mTextureFormat = pTexture->getFormat();
+        // The copy is done once the context's fence reaches the value signaled by the flush. A secondary context shares the fence of its primary, which signals it in joinSecondaryContexts()
+        pThis->mpFence = pCtx->getLowLevelData()->getFence();
+        pThis->mFenceValue = pThis->mpFence->getCpuValue();
+        if (!pCtx->isSecondary()) pCtx->flush(false);
+
+        // Calculate row size. GPU pitch can be different because it is aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+        ResourceFormat format = pTexture->getFormat();
+        assert(footprint.Footprint.Width % getFormatWidthCompressionRatio(format) == 0); // Should divide evenly
+        MappedData& mapped = pThis->mMappedData;
+        mapped.pData = pThis->mAllocation.pData;
+        mapped.rowSize = (footprint.Footprint.Width / getFormatWidthCompressionRatio(format)) * getFormatBytesPerBlock(format);
+        mapped.rowPitch = footprint.Footprint.RowPitch;
+        mapped.rowCount = rowCount;
+        mapped.depthPitch = footprint.Footprint.RowPitch * rowCount;
+        mapped.depth = footprint.Footprint.Depth;
 
         return pThis;
     }
 
+    CopyContext::ReadTextureTask::~ReadTextureTask()
+    {
+        // The fence value of the allocation is the one of the copy, so the memory is recycled by the next executeDeferredReleases() after the copy
+        if (mpHeap) mpHeap->release(mAllocation);
+    }
+
+    void CopyContext::ReadTextureTask::copyData(void* pDst, size_t size) const
+    {
+        assert(size >= getDataSize());
+        const MappedData& mapped = mMappedData;
+        PitchedCopyDesc desc;
+        desc.pSrc = mapped.pData;
+        desc.pDst = pDst;
+        desc.rowSize = mapped.rowSize;
+        desc.rowCount = mapped.rowCount;
+        desc.sliceCount = mapped.depth;
+        desc.srcRowPitch = mapped.rowPitch;
+        desc.srcSlicePitch = mapped.depthPitch;
+        desc.dstRowPitch = mapped.rowSize;
+        desc.dstSlicePitch = (size_t)mapped.rowSize * mapped.rowCount;
+        copyPitched(desc);
+    }
+
     std::vector<uint8_t> CopyContext::ReadTextureTask::getData()
     {
-        mpFence->syncCpu();
-        D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = mFootprint;
+        std::vector<uint8_t> result(getDataSize());
+        getData(result.data(), result.size());
+        return result;
+    }
 
-        // Calculate row size. GPU pitch can be different because it is aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
-        assert(footprint.Footprint.Width % getFormatWidthCompressionRatio(mTextureFormat) == 0); // Should divide evenly
-        uint32_t actualRowSize = (footprint.Footprint.Width / getFormatWidthCompressionRatio(mTextureFormat)) * getFormatBytesPerBlock(mTextureFormat);
+    void CopyContext::ReadTextureTask::getData(void* pDst, size_t size)
+    {
+        mpFence->syncCpu(mFenceValue);
+        copyData(pDst, size);
+    }
 
-        // Get buffer data
-        std::vector<uint8_t> result;
-        result.resize(mRowCount * actualRowSize * footprint.Footprint.Depth);
-        uint8_t* pData = reinterpret_cast<uint8_t*>(mpBuffer->map(Buffer::MapType::Read));
+    bool CopyContext::ReadTextureTask::tryGetData(std::vector<uint8_t>& data)
+    {
+        if (isReady() == false) return false;
+        data.resize(getDataSize());
+        copyData(data.data(), data.size());
+        return true;
+    }
 
-        for (uint32_t z = 0; z < footprint.Footprint.Depth; z++)
-        {
-            const uint8_t* pSrcZ = pData + z * footprint.Footprint.RowPitch * mRowCount;
-            uint8_t* pDstZ = result.data() + z * actualRowSize * mRowCount;
-            for (uint32_t y = 0; y < mRowCount; y++)
-            {
-                const uint8_t* pSrc = pSrcZ + y * footprint.Footprint.RowPitch;
-                uint8_t* pDst = pDstZ + y * actualRowSize;
-                memcpy(pDst, pSrc, actualRowSize);
-            }
-        }
+    bool CopyContext::ReadTextureTask::tryGetData(void* pDst, size_t size)
+    {
+        if (isReady() == false) return false;
+        copyData(pDst, size);
+        return true;
+    }
 
-        mpBuffer->unmap();
-        return result;
+    const CopyContext::ReadTextureTask::MappedData& CopyContext::ReadTextureTask::getMappedData()
+    {
+        mpFence->syncCpu(mFenceValue);
+        return mMappedData;
     }
 
-    static void d3d12ResourceBarrier(const Resource* pResource, Resource::State newState, Resource::State oldState, uint32_t subresourceIndex, ID3D12GraphicsCommandList* pCmdList)
+    static D3D12_RESOURCE_BARRIER createTransitionBarrier(const Resource* pResource, Resource::State newState, Resource::State oldState, uint32_t subresourceIndex)
     {
         D3D12_RESOURCE_BARRIER barrier;
         barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -292,44 +423,179 @@ namespace WIP3D
             assert(is_set(pResource->getBindFlags(), Resource::BindFlags::UnorderedAccess));
         }
 
-        pCmdList->ResourceBarrier(1, &barrier);
+        return barrier;
+    }
+
+    static D3D12_RESOURCE_BARRIER createTransitionBarrier(const ResourceStateTracker::Transition& t)
+    {
+        uint32_t subresourceIndex = (t.subresource == ResourceStateTracker::kAllSubresources) ? D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES : t.subresource;
+        return createTransitionBarrier(t.pResource, t.after, t.before, subresourceIndex);
+    }
+
+    static ID3D12Resource* getBarrierResource(const D3D12_RESOURCE_BARRIER& barrier)
+    {
+        return (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) ? barrier.UAV.pResource : barrier.Transition.pResource;
     }
 
-    static bool d3d12GlobalResourceBarrier(const Resource* pResource, Resource::State newState, ID3D12GraphicsCommandList* pCmdList)
+    void CopyContext::addPendingBarrier(const D3D12_RESOURCE_BARRIER& barrier)
     {
-        if (pResource->getGlobalState() != newState)
+        // A barrier for anything other than an upload must not be merged with, or recorded before, the transitions the pending uploads depend on
+        if (mPendingUploads.size() && mStagingUpload == false) flushBarriers();
+
+        // Find the last pending barrier on the same resource. Nothing was recorded since it, so the two can be combined
+        ID3D12Resource* pResource = getBarrierResource(barrier);
+        for (size_t i = mPendingBarriers.size(); i-- > 0;)
         {
-            d3d12ResourceBarrier(pResource, newState, pResource->getGlobalState(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, pCmdList);
-            return true;
+            D3D12_RESOURCE_BARRIER& prev = mPendingBarriers[i];
+            if (prev.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING || getBarrierResource(prev) != pResource) continue;
+
+            // Back-to-back UAV barriers
+            if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV && prev.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) return;
+
+            // A->B followed by B->C becomes A->C, and A->B followed by B->A is dropped.
+            // A UnorderedAccess round trip still orders the UAV accesses on both sides, so it becomes a UAV barrier instead
+            bool mergeable = barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && prev.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            mergeable = mergeable && barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE && prev.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            mergeable = mergeable && barrier.Transition.Subresource == prev.Transition.Subresource && barrier.Transition.StateBefore == prev.Transition.StateAfter;
+            if (mergeable)
+            {
+                if (prev.Transition.StateBefore != barrier.Transition.StateAfter) prev.Transition.StateAfter = barrier.Transition.StateAfter;
+                else if (prev.Transition.StateBefore == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+                {
+                    prev.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+                    prev.UAV.pResource = pResource;
+                }
+                else mPendingBarriers.erase(mPendingBarriers.begin() + i);
+                return;
+            }
+            break;
+        }
+        mPendingBarriers.push_back(barrier);
+    }
+
+    void CopyContext::flushBarriers()
+    {
+        ID3D12GraphicsCommandList* pList = mpLowLevelData->getCommandList();
+        if (mPendingBarriers.size())
+        {
+            pList->ResourceBarrier((UINT)mPendingBarriers.size(), mPendingBarriers.data());
+            mPendingBarriers.clear();
+            mCommandsPending = true;
+        }
+
+        for (const auto& upload : mPendingUploads)
+        {
+            if (upload.size)
+            {
+                pList->CopyBufferRegion(upload.pDst, upload.dstOffset, upload.pSrc, upload.srcOffset, upload.size);
+            }
+            else
+            {
+                D3D12_TEXTURE_COPY_LOCATION dstLoc = { upload.pDst, D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, upload.dstSubresource };
+                D3D12_TEXTURE_COPY_LOCATION srcLoc = { upload.pSrc, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT, upload.srcFootprint };
+                pList->CopyTextureRegion(&dstLoc, upload.dstOrigin.x, upload.dstOrigin.y, upload.dstOrigin.z, &srcLoc, nullptr);
+            }
+            mCommandsPending = true;
+        }
+        mPendingUploads.clear();
+    }
+
+    bool CopyContext::beginTransition(const Resource* pResource, Resource::State newState)
+    {
+        endTransition(pResource);
+        if (mpStateTracker)
+        {
+            resourceBarrier(pResource, newState);
+            return false;
+        }
+        if (pResource->isStateGlobal() == false || pResource->getGlobalState() == newState) return false;
+        const Buffer* pBuffer = dynamic_cast<const Buffer*>(pResource);
+        if (pBuffer && pBuffer->getCpuAccess() != Buffer::CpuAccess::None) return false;
+
+        Resource::State oldState = pResource->getGlobalState();
+        D3D12_RESOURCE_BARRIER barrier = createTransitionBarrier(pResource, newState, oldState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+        addPendingBarrier(barrier);
+        mSplitTransitions.push_back({ pResource, oldState, newState });
+        pResource->setGlobalState(newState);
+        return true;
+    }
+
+    void CopyContext::endTransition(const Resource* pResource)
+    {
+        for (size_t i = 0; i < mSplitTransitions.size(); i++)
+        {
+            const SplitTransition& t = mSplitTransitions[i];
+            if (t.pResource != pResource) continue;
+
+            D3D12_RESOURCE_BARRIER barrier = createTransitionBarrier(pResource, t.newState, t.oldState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+            barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+            addPendingBarrier(barrier);
+            mSplitTransitions.erase(mSplitTransitions.begin() + i);
+            return;
         }
-        return false;
     }
 
     bool CopyContext::textureBarrier(const Texture* pTexture, Resource::State newState)
     {
-        bool recorded = d3d12GlobalResourceBarrier(pTexture, newState, mpLowLevelData->getCommandList());
+        bool recorded = pTexture->getGlobalState() != newState;
+        if (recorded) addPendingBarrier(createTransitionBarrier(pTexture, newState, pTexture->getGlobalState(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES));
         pTexture->setGlobalState(newState);
-        mCommandsPending = mCommandsPending || recorded;
         return recorded;
     }
 
     bool CopyContext::bufferBarrier(const Buffer* pBuffer, Resource::State newState)
     {
         if (pBuffer && pBuffer->getCpuAccess() != Buffer::CpuAccess::None) return false;
-        bool recorded = d3d12GlobalResourceBarrier(pBuffer, newState, mpLowLevelData->getCommandList());
+        bool recorded = pBuffer->getGlobalState() != newState;
+        if (recorded) addPendingBarrier(createTransitionBarrier(pBuffer, newState, pBuffer->getGlobalState(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES));
         pBuffer->setGlobalState(newState);
-        mCommandsPending = mCommandsPending || recorded;
         return recorded;
     }
 
+    void CopyContext::setStateTracker(const ResourceStateTracker::SharedPtr& pTracker)
+    {
+        assert(mPendingBarriers.empty() && mSplitTransitions.empty());
+        if (mpStateTracker && mpStateTracker != pTracker && mpStateTracker->isEmpty() == false)
+        {
+            LOG_WARN("CopyContext::setStateTracker() - the previous tracker has unresolved states. Call flush() before changing the tracker");
+        }
+        mpStateTracker = pTracker;
+    }
+
+    bool CopyContext::trackedResourceBarrier(const Resource* pResource, Resource::State newState, const ResourceViewInfo* pViewInfo)
+    {
+        const Buffer* pBuffer = dynamic_cast<const Buffer*>(pResource);
+        if (pBuffer && pBuffer->getCpuAccess() != Buffer::CpuAccess::None) return false;
+
+        mTrackedTransitions.clear();
+        mpStateTracker->transition(pResource, newState, pViewInfo, mTrackedTransitions);
+        for (const auto& t : mTrackedTransitions)
+        {
+            addPendingBarrier(createTransitionBarrier(t));
+        }
+        return mTrackedTransitions.size() > 0;
+    }
+
+    void CopyContext::resolveTrackedStates()
+    {
+        mTrackedTransitions.clear();
+        mpStateTracker->resolve(mTrackedTransitions);
+        for (const auto& t : mTrackedTransitions)
+        {
+            mFixupBarriers.push_back(createTransitionBarrier(t));
+        }
+    }
+
     void CopyContext::apiSubresourceBarrier(const Texture* pTexture, Resource::State newState, Resource::State oldState, uint32_t arraySlice, uint32_t mipLevel)
     {
         uint32_t subresourceIndex = pTexture->getSubresourceIndex(arraySlice, mipLevel);
-        d3d12ResourceBarrier(pTexture, newState, oldState, subresourceIndex, mpLowLevelData->getCommandList());
+        addPendingBarrier(createTransitionBarrier(pTexture, newState, oldState, subresourceIndex));
     }
 
     void CopyContext::uavBarrier(const Resource* pResource)
     {
+        CAPTURE_COMMAND(UavBarrier, this, pResource);
         D3D12_RESOURCE_BARRIER barrier;
         barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
         barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
@@ -338,22 +604,25 @@ namespace WIP3D
         // Check that resource has required bind flags for UAV barrier to be supported
         static const Resource::BindFlags reqFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::AccelerationStructure;
         assert(is_set(pResource->getBindFlags(), reqFlags));
-        mpLowLevelData->getCommandList()->ResourceBarrier(1, &barrier);
-        mCommandsPending = true;
+        addPendingBarrier(barrier);
     }
 
     void CopyContext::copyResource(const Resource* pDst, const Resource* pSrc)
     {
+        CAPTURE_COMMAND(CopyResource, this, pDst, pSrc);
         resourceBarrier(pDst, Resource::State::CopyDest);
         resourceBarrier(pSrc, Resource::State::CopySource);
+        flushBarriers();
         mpLowLevelData->getCommandList()->CopyResource(pDst->getApiHandle(), pSrc->getApiHandle());
         mCommandsPending = true;
     }
 
     void CopyContext::copySubresource(const Texture* pDst, uint32_t dstSubresourceIdx, const Texture* pSrc, uint32_t srcSubresourceIdx)
     {
+        CAPTURE_COMMAND(CopySubresource, this, pDst, dstSubresourceIdx, pSrc, srcSubresourceIdx);
         resourceBarrier(pDst, Resource::State::CopyDest);
         resourceBarrier(pSrc, Resource::State::CopySource);
+        flushBarriers();
 
         D3D12_TEXTURE_COPY_LOCATION pSrcCopyLoc;
         D3D12_TEXTURE_COPY_LOCATION pDstCopyLoc;
@@ -372,16 +641,20 @@ namespace WIP3D
 
     void CopyContext::copyBufferRegion(const Buffer* pDst, uint64_t dstOffset, const Buffer* pSrc, uint64_t srcOffset, uint64_t numBytes)
     {
+        CAPTURE_COMMAND(CopyBufferRegion, this, pDst, dstOffset, pSrc, srcOffset, numBytes);
         resourceBarrier(pDst, Resource::State::CopyDest);
         resourceBarrier(pSrc, Resource::State::CopySource);
+        flushBarriers();
         mpLowLevelData->getCommandList()->CopyBufferRegion(pDst->getApiHandle(), dstOffset, pSrc->getApiHandle(), pSrc->getGpuAddressOffset() + srcOffset, numBytes);
         mCommandsPending = true;
     }
 
     void CopyContext::copySubresourceRegion(const Texture* pDst, uint32_t dstSubresource, const Texture* pSrc, uint32_t srcSubresource, const uint3& dstOffset, const uint3& srcOffset, const uint3& size)
     {
+        CAPTURE_COMMAND(CopySubresourceRegion, this, pDst, dstSubresource, pSrc, srcSubresource, dstOffset.x, dstOffset.y, dstOffset.z, srcOffset.x, srcOffset.y, srcOffset.z, size.x, size.y, size.z);
         resourceBarrier(pDst, Resource::State::CopyDest);
         resourceBarrier(pSrc, Resource::State::CopySource);
+        flushBarriers();
 
         D3D12_TEXTURE_COPY_LOCATION dstLoc = {};
         dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
@@ -442,8 +715,8 @@ namespace WIP3D
         }
     }
 
-    ComputeContext::ComputeContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue)
-        : CopyContext(type, queue)
+    ComputeContext::ComputeContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence)
+        : CopyContext(type, queue, pFence)
     {
         assert(queue);
         ComputeContextApiData::init();
@@ -463,18 +736,25 @@ namespace WIP3D
         // Apply the vars. Must be first because applyComputeVars() might cause a flush
         if (pVars)
         {
-            if (applyComputeVars(pVars, pCSO->getDesc().getProgramKernels()->getRootSignature().get()) == false) return false;
+            RootSignature* pRootSig = pCSO->getDesc().getProgramKernels()->getRootSignature().get();
+            if (applyComputeVars(pVars, pRootSig) == false) return false;
         }
         else mpLowLevelData->getCommandList()->SetComputeRootSignature(RootSignature::getEmpty()->getApiHandle());
 
         mpLastBoundComputeVars = pVars;
-        mpLowLevelData->getCommandList()->SetPipelineState(pCSO->getApiHandle());
+        flushBarriers();
+        if (mpBoundPipelineState != pCSO->getApiHandle().GetInterfacePtr())
+        {
+            mpBoundPipelineState = pCSO->getApiHandle().GetInterfacePtr();
+            mpLowLevelData->getCommandList()->SetPipelineState(mpBoundPipelineState);
+        }
         mCommandsPending = true;
         return true;
     }
 
     void ComputeContext::dispatch(ComputeState* pState, ComputeVars* pVars, const uint3& dispatchSize)
     {
+        CAPTURE_COMMAND(Dispatch, this, pState, pVars, dispatchSize.x, dispatchSize.y, dispatchSize.z);
         // Check dispatch dimensions. TODO: Should be moved into Falcor.
         if (dispatchSize.x > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION ||
             dispatchSize.y > D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION ||
@@ -493,6 +773,7 @@ namespace WIP3D
     void clearUavCommon(ComputeContext* pContext, const UnorderedAccessView* pUav, const ClearType& clear, ID3D12GraphicsCommandList* pList)
     {
         pContext->resourceBarrier(pUav->getResource(), Resource::State::UnorderedAccess);
+        pContext->flushBarriers();
         UavHandle uav = pUav->getApiHandle();
         if (typeid(ClearType) == typeid(float4))
         {
@@ -510,12 +791,14 @@ namespace WIP3D
 
     void ComputeContext::clearUAV(const UnorderedAccessView* pUav, const float4& value)
     {
+        CAPTURE_COMMAND(ClearUavFloat, this, pUav, value.x, value.y, value.z, value.w);
         clearUavCommon(this, pUav, value, mpLowLevelData->getCommandList().GetInterfacePtr());
         mCommandsPending = true;
     }
 
     void ComputeContext::clearUAV(const UnorderedAccessView* pUav, const uint4& value)
     {
+        CAPTURE_COMMAND(ClearUavUint, this, pUav, value.x, value.y, value.z, value.w);
         clearUavCommon(this, pUav, value, mpLowLevelData->getCommandList().GetInterfacePtr());
         mCommandsPending = true;
     }
@@ -530,8 +813,10 @@ namespace WIP3D
 
     void ComputeContext::dispatchIndirect(ComputeState* pState, ComputeVars* pVars, const Buffer* pArgBuffer, uint64_t argBufferOffset)
     {
+        CAPTURE_COMMAND(DispatchIndirect, this, pState, pVars, pArgBuffer, argBufferOffset);
         if (prepareForDispatch(pState, pVars) == false) return;
         resourceBarrier(pArgBuffer, Resource::State::IndirectArg);
+        flushBarriers();
         mpLowLevelData->getCommandList()->ExecuteIndirect(sApiData.pDispatchCommandSig, 1, pArgBuffer->getApiHandle(), argBufferOffset, nullptr, 0);
     }
 
@@ -660,8 +945,8 @@ namespace WIP3D
         }
     }
 
-    RenderContext::RenderContext(CommandQueueHandle queue)
-        : ComputeContext(LowLevelContextData::CommandQueueType::Direct, queue)
+    RenderContext::RenderContext(CommandQueueHandle queue, const GpuFence::SharedPtr& pFence)
+        : ComputeContext(LowLevelContextData::CommandQueueType::Direct, queue, pFence)
     {
         RenderContextApiData::init();
     }
@@ -673,26 +958,28 @@ namespace WIP3D
 
     void RenderContext::clearRtv(const RenderTargetView* pRtv, const float4& color)
     {
+        CAPTURE_COMMAND(ClearRtv, this, pRtv, color.x, color.y, color.z, color.w);
         resourceBarrier(pRtv->getResource(), Resource::State::RenderTarget);
+        flushBarriers();
         mpLowLevelData->getCommandList()->ClearRenderTargetView(pRtv->getApiHandle()->getCpuHandle(0), glm::value_ptr(color), 0, nullptr);
         mCommandsPending = true;
     }
 
     void RenderContext::clearDsv(const DepthStencilView* pDsv, float depth, uint8_t stencil, bool clearDepth, bool clearStencil)
     {
+        CAPTURE_COMMAND(ClearDsv, this, pDsv, depth, stencil, clearDepth, clearStencil);
         uint32_t flags = clearDepth ? D3D12_CLEAR_FLAG_DEPTH : 0;
         flags |= clearStencil ? D3D12_CLEAR_FLAG_STENCIL : 0;
 
         resourceBarrier(pDsv->getResource(), Resource::State::DepthStencil);
+        flushBarriers();
         mpLowLevelData->getCommandList()->ClearDepthStencilView(pDsv->getApiHandle()->getCpuHandle(0), D3D12_CLEAR_FLAGS(flags), depth, stencil, 0, nullptr);
         mCommandsPending = true;
     }
 
-    static void D3D12SetVao(RenderContext* pCtx, ID3D12GraphicsCommandList* pList, const Vao* pVao)
+    // Get the buffer views of a VAO and transition the buffers. pVB must have D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT zeroed entries, and ib must be zeroed
+    static void D3D12GetVaoViews(RenderContext* pCtx, const Vao* pVao, D3D12_VERTEX_BUFFER_VIEW* vb, D3D12_INDEX_BUFFER_VIEW& ib)
     {
-        D3D12_VERTEX_BUFFER_VIEW vb[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {};
-        D3D12_INDEX_BUFFER_VIEW ib = {};
-
         if (pVao)
         {
             // Get the vertex buffers
@@ -717,19 +1004,18 @@ namespace WIP3D
                 pCtx->resourceBarrier(pIB, Resource::State::IndexBuffer);
             }
         }
-
-        pList->IASetVertexBuffers(0, ARRAYSIZE(vb), vb);
-        pList->IASetIndexBuffer(&ib);
     }
 
-    static void D3D12SetFbo(RenderContext* pCtx, const Fbo* pFbo)
+    // Get the RTV handles of an FBO, followed by its DSV handle, and transition the attachments. pRTV must have Fbo::getMaxColorTargetCount() + 1 entries
+    static void D3D12GetFboViews(RenderContext* pCtx, const Fbo* pFbo, HeapCpuHandle* pRTV)
     {
         // We are setting the entire RTV array to make sure everything that was previously bound is detached.
         // We're using 2D null views for any unused slots.
         uint32_t colorTargets = Fbo::getMaxColorTargetCount();
         auto pNullRtv = RenderTargetView::getNullView(RenderTargetView::Dimension::Texture2D);
-        std::vector<HeapCpuHandle> pRTV(colorTargets, pNullRtv->getApiHandle()->getCpuHandle(0));
-        HeapCpuHandle pDSV = DepthStencilView::getNullView(DepthStencilView::Dimension::Texture2D)->getApiHandle()->getCpuHandle(0);
+        for (uint32_t i = 0; i < colorTargets; i++) pRTV[i] = pNullRtv->getApiHandle()->getCpuHandle(0);
+        HeapCpuHandle& pDSV = pRTV[colorTargets];
+        pDSV = DepthStencilView::getNullView(DepthStencilView::Dimension::Texture2D)->getApiHandle()->getCpuHandle(0);
 
         if (pFbo)
         {
@@ -753,8 +1039,6 @@ namespace WIP3D
                 }
             }
         }
-        ID3D12GraphicsCommandList* pCmdList = pCtx->getLowLevelData()->getCommandList().GetInterfacePtr();
-        pCmdList->OMSetRenderTargets(colorTargets, pRTV.data(), FALSE, &pDSV);
     }
 
     static void D3D12SetSamplePositions(ID3D12GraphicsCommandList* pList, const Fbo* pFbo)
@@ -816,6 +1100,20 @@ namespace WIP3D
         pList->RSSetScissorRects(D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE, (D3D12_RECT*)sc);
     }
 
+    template<typename T>
+    bool RenderContext::updateBoundValue(BoundValue<T>& bound, const T& value, StateFilterStats::Counter& counter)
+    {
+        if (bound.valid && std::memcmp(&bound.value, &value, sizeof(T)) == 0)
+        {
+            counter.avoided++;
+            return false;
+        }
+        bound.value = value;
+        bound.valid = true;
+        counter.issued++;
+        return true;
+    }
+
     bool RenderContext::prepareForDraw(GraphicsState* pState, GraphicsVars* pVars)
     {
         assert(pState);
@@ -824,6 +1122,30 @@ namespace WIP3D
 
         auto pGSO = pState->getGSO(pVars);
 
+        // The PSO is still compiling on the PipelineStateCache threads
+        if (pGSO->isReady() == false)
+        {
+            switch (mPendingPipelinePolicy)
+            {
+            case PendingPipelinePolicy::Skip:
+                mStateFilterStats.pendingPipelineSkips++;
+                return false;
+            case PendingPipelinePolicy::Fallback:
+                if (mpFallbackGraphicsState == nullptr)
+                {
+                    mStateFilterStats.pendingPipelineSkips++;
+                    return false;
+                }
+                mStateFilterStats.pendingPipelineFallbacks++;
+                pGSO = mpFallbackGraphicsState;
+                break;
+            default:
+                // getApiHandle() below waits
+                mStateFilterStats.pendingPipelineWaits++;
+                break;
+            }
+        }
+
         if (is_set(StateBindFlags::Vars, mBindFlags))
         {
             // Apply the vars. Must be first because applyGraphicsVars() might cause a flush
@@ -833,28 +1155,105 @@ namespace WIP3D
                 // from computing the GSO down into `applyGraphicsVars` so that parameters
                 // can be bound using an appropriate layout.
                 //
-                if (applyGraphicsVars(pVars, pGSO->getDesc().getRootSignature().get()) == false) return false;
+                RootSignature* pRootSig = pGSO->getDesc().getRootSignature().get();
+                ID3D12RootSignature* pApiRootSig = pRootSig->getApiHandle().GetInterfacePtr();
+
+                // The vars bind the root signature when they change. Force it if something else was bound in between
+                if (mBoundState.rootSignature.valid == false || mBoundState.rootSignature.value != pApiRootSig) mpLastBoundGraphicsVars = nullptr;
+                if (pVars == mpLastBoundGraphicsVars) mStateFilterStats.rootSignature.avoided++;
+                else mStateFilterStats.rootSignature.issued++;
+                if (applyGraphicsVars(pVars, pRootSig) == false) return false;
+                mBoundState.rootSignature = { pApiRootSig, true };
+            }
+            else
+            {
+                ID3D12RootSignature* pEmptyRootSig = RootSignature::getEmpty()->getApiHandle().GetInterfacePtr();
+                if (updateBoundValue(mBoundState.rootSignature, pEmptyRootSig, mStateFilterStats.rootSignature)) mpLowLevelData->getCommandList()->SetGraphicsRootSignature(pEmptyRootSig);
             }
-            else mpLowLevelData->getCommandList()->SetGraphicsRootSignature(RootSignature::getEmpty()->getApiHandle());
             mpLastBoundGraphicsVars = pVars;
         }
+        else mBoundState.rootSignature.valid = false;   // The user might bind it with a raw API call
 
         ID3D12GraphicsCommandList* pList = mpLowLevelData->getCommandList();
+        mStateFilterStats.drawCount++;
 
+        // Only the state that differs from what the command list has bound is set. State the bind flags exclude is forgotten, since the user might set it with raw API calls
+        if (is_set(StateBindFlags::Topology, mBindFlags))
+        {
+            D3D12_PRIMITIVE_TOPOLOGY topology = getD3DPrimitiveTopology(pState->getVao()->getPrimitiveTopology());
+            if (updateBoundValue(mBoundState.primitiveTopology, topology, mStateFilterStats.primitiveTopology)) pList->IASetPrimitiveTopology(topology);
+        }
+        else mBoundState.primitiveTopology.valid = false;
+
+        if (is_set(StateBindFlags::Vao, mBindFlags))
+        {
+            std::array<D3D12_VERTEX_BUFFER_VIEW, D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT> vb = {};
+            D3D12_INDEX_BUFFER_VIEW ib = {};
+            D3D12GetVaoViews(this, pState->getVao().get(), vb.data(), ib);
+            if (updateBoundValue(mBoundState.vertexBuffers, vb, mStateFilterStats.vertexBuffers)) pList->IASetVertexBuffers(0, (UINT)vb.size(), vb.data());
+            if (updateBoundValue(mBoundState.indexBuffer, ib, mStateFilterStats.indexBuffer)) pList->IASetIndexBuffer(&ib);
+        }
+        else
+        {
+            mBoundState.vertexBuffers.valid = false;
+            mBoundState.indexBuffer.valid = false;
+        }
+
+        if (is_set(StateBindFlags::Fbo, mBindFlags))
+        {
+            assert(Fbo::getMaxColorTargetCount() + 1 == mBoundState.renderTargets.value.size());
+            std::array<HeapCpuHandle, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1> rtv;
+            D3D12GetFboViews(this, pState->getFbo().get(), rtv.data());
+            if (updateBoundValue(mBoundState.renderTargets, rtv, mStateFilterStats.renderTargets)) pList->OMSetRenderTargets((UINT)rtv.size() - 1, rtv.data(), FALSE, &rtv.back());
+        }
+        else mBoundState.renderTargets.valid = false;
 
-        if (is_set(StateBindFlags::Topology, mBindFlags))           pList->IASetPrimitiveTopology(getD3DPrimitiveTopology(pState->getVao()->getPrimitiveTopology()));
-        if (is_set(StateBindFlags::Vao, mBindFlags))                D3D12SetVao(this, pList, pState->getVao().get());
-        if (is_set(StateBindFlags::Fbo, mBindFlags))                D3D12SetFbo(this, pState->getFbo().get());
         if (is_set(StateBindFlags::SamplePositions, mBindFlags))    D3D12SetSamplePositions(pList, pState->getFbo().get());
-        if (is_set(StateBindFlags::Viewports, mBindFlags))          D3D12SetViewports(pList, &pState->getViewport(0));
-        if (is_set(StateBindFlags::Scissors, mBindFlags))           D3D12SetScissors(pList, &pState->getScissors(0));
-        if (is_set(StateBindFlags::PipelineState, mBindFlags))      pList->SetPipelineState(pGSO->getApiHandle());
+
+        if (is_set(StateBindFlags::Viewports, mBindFlags))
+        {
+            std::array<D3D12_VIEWPORT, D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE> viewports;
+            std::memcpy(viewports.data(), &pState->getViewport(0), sizeof(viewports));
+            if (updateBoundValue(mBoundState.viewports, viewports, mStateFilterStats.viewports)) D3D12SetViewports(pList, &pState->getViewport(0));
+        }
+        else mBoundState.viewports.valid = false;
+
+        if (is_set(StateBindFlags::Scissors, mBindFlags))
+        {
+            std::array<D3D12_RECT, D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE> scissors;
+            std::memcpy(scissors.data(), &pState->getScissors(0), sizeof(scissors));
+            if (updateBoundValue(mBoundState.scissors, scissors, mStateFilterStats.scissors)) D3D12SetScissors(pList, &pState->getScissors(0));
+        }
+        else mBoundState.scissors.valid = false;
+
+        if (is_set(StateBindFlags::PipelineState, mBindFlags))
+        {
+            ID3D12PipelineState* pApiGSO = pGSO->getApiHandle().GetInterfacePtr();
+            if (pApiGSO == nullptr) return false;   // Creation failed, the PipelineStateCache logged the error
+            if (mpBoundPipelineState == pApiGSO) mStateFilterStats.pipelineState.avoided++;
+            else
+            {
+                mStateFilterStats.pipelineState.issued++;
+                mpBoundPipelineState = pApiGSO;
+                pList->SetPipelineState(pApiGSO);
+            }
+        }
+        else mpBoundPipelineState = nullptr;
 
         BlendState::SharedPtr blendState = pState->getBlendState();
-        if (blendState != nullptr)  pList->OMSetBlendFactor(glm::value_ptr(blendState->getBlendFactor()));
+        if (blendState != nullptr)
+        {
+            std::array<float, 4> blendFactor;
+            std::memcpy(blendFactor.data(), glm::value_ptr(blendState->getBlendFactor()), sizeof(blendFactor));
+            if (updateBoundValue(mBoundState.blendFactor, blendFactor, mStateFilterStats.blendFactor)) pList->OMSetBlendFactor(blendFactor.data());
+        }
 
         const auto pDsState = pState->getDepthStencilState();
-        pList->OMSetStencilRef(pDsState == nullptr ? 0 : pDsState->getStencilRef());
+        UINT stencilRef = pDsState == nullptr ? 0 : pDsState->getStencilRef();
+        if (updateBoundValue(mBoundState.stencilRef, stencilRef, mStateFilterStats.stencilRef)) pList->OMSetStencilRef(stencilRef);
+
+        // Every barrier the draw depends on was recorded above, batch them into a single call
+        flushBarriers();
 
         mCommandsPending = true;
         return true;
@@ -862,6 +1261,7 @@ namespace WIP3D
 
     void RenderContext::drawInstanced(GraphicsState* pState, GraphicsVars* pVars, uint32_t vertexCount, uint32_t instanceCount, uint32_t startVertexLocation, uint32_t startInstanceLocation)
     {
+        CAPTURE_COMMAND(DrawInstanced, this, pState, pVars, vertexCount, instanceCount, startVertexLocation, startInstanceLocation);
         if (prepareForDraw(pState, pVars) == false) return;
         mpLowLevelData->getCommandList()->DrawInstanced(vertexCount, instanceCount, startVertexLocation, startInstanceLocation);
     }
@@ -873,6 +1273,7 @@ namespace WIP3D
 
     void RenderContext::drawIndexedInstanced(GraphicsState* pState, GraphicsVars* pVars, uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation, int32_t baseVertexLocation, uint32_t startInstanceLocation)
     {
+        CAPTURE_COMMAND(DrawIndexedInstanced, this, pState, pVars, indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
         if (prepareForDraw(pState, pVars) == false) return;
         mpLowLevelData->getCommandList()->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
     }
@@ -886,29 +1287,34 @@ namespace WIP3D
     {
         pContext->resourceBarrier(pArgBuffer, Resource::State::IndirectArg);
         if (pCountBuffer != nullptr && pCountBuffer != pArgBuffer) pContext->resourceBarrier(pCountBuffer, Resource::State::IndirectArg);
+        pContext->flushBarriers();
         pCommandList->ExecuteIndirect(pCommandSig, maxCommandCount, pArgBuffer->getApiHandle(), argBufferOffset, (pCountBuffer != nullptr ? pCountBuffer->getApiHandle() : nullptr), countBufferOffset);
     }
 
     void RenderContext::drawIndirect(GraphicsState* pState, GraphicsVars* pVars, uint32_t maxCommandCount, const Buffer* pArgBuffer, uint64_t argBufferOffset, const Buffer* pCountBuffer, uint64_t countBufferOffset)
     {
+        CAPTURE_COMMAND(DrawIndirect, this, pState, pVars, maxCommandCount, pArgBuffer, argBufferOffset, pCountBuffer, countBufferOffset);
         if (prepareForDraw(pState, pVars) == false) return;
         drawIndirectCommon(this, mpLowLevelData->getCommandList(), sApiData.pDrawCommandSig, maxCommandCount, pArgBuffer, argBufferOffset, pCountBuffer, countBufferOffset);
     }
 
     void RenderContext::drawIndexedIndirect(GraphicsState* pState, GraphicsVars* pVars, uint32_t maxCommandCount, const Buffer* pArgBuffer, uint64_t argBufferOffset, const Buffer* pCountBuffer, uint64_t countBufferOffset)
     {
+        CAPTURE_COMMAND(DrawIndexedIndirect, this, pState, pVars, maxCommandCount, pArgBuffer, argBufferOffset, pCountBuffer, countBufferOffset);
         if (prepareForDraw(pState, pVars) == false) return;
         drawIndirectCommon(this, mpLowLevelData->getCommandList(), sApiData.pDrawIndexCommandSig, maxCommandCount, pArgBuffer, argBufferOffset, pCountBuffer, countBufferOffset);
     }
 
     void RenderContext::raytrace(RtProgram* pProgram, RtProgramVars* pVars, uint32_t width, uint32_t height, uint32_t depth)
     {
+        CAPTURE_COMMAND(Raytrace, this, pProgram, pVars, width, height, depth);
         auto pRtso = pProgram->getRtso(pVars);
 
         pVars->apply(this, pRtso.get());
 
         const auto& pShaderTable = pVars->getShaderTable();
         resourceBarrier(pShaderTable->getBuffer().get(), Resource::State::NonPixelShader);
+        flushBarriers();
 
         D3D12_GPU_VIRTUAL_ADDRESS startAddress = pShaderTable->getBuffer()->getGpuAddress();
 
@@ -947,6 +1353,7 @@ namespace WIP3D
         // Dispatch
         GET_COM_INTERFACE(pCmdList, ID3D12GraphicsCommandList4, pList4);
         pList4->SetPipelineState1(pRtso->getApiHandle().GetInterfacePtr());
+        mpBoundPipelineState = nullptr; // SetPipelineState1() replaces the bound PSO
         pList4->DispatchRays(&raytraceDesc);
     }
 
@@ -1066,6 +1473,7 @@ namespace WIP3D
     void RenderContext::resolveSubresource(const Texture::SharedPtr& pSrc, uint32_t srcSubresource, const Texture::SharedPtr& pDst, uint32_t dstSubresource)
     {
         DXGI_FORMAT format = getDxgiFormat(pDst->getFormat());
+        flushBarriers();
         mpLowLevelData->getCommandList()->ResolveSubresource(pDst->getApiHandle(), dstSubresource, pSrc->getApiHandle(), srcSubresource, format);
         mCommandsPending = true;
     }
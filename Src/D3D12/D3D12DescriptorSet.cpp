@@ -1,12 +1,26 @@
+#include <algorithm>
+#include "../CommandCapture.h"
 #include "../DescriptorSet.h"
 #include "../Device.h"
 #include "../GraphicsContext.h"
+#include "../StableHash.h"
 #include "WIPD3D12.h"
 
 namespace WIP3D
 {
     D3D12_DESCRIPTOR_HEAP_TYPE falcorToDxDescType(DescriptorPool::Type t);
 
+    static uint64_t hashLayout(const DescriptorSet::Layout& layout)
+    {
+        StableHash hash;
+        for (size_t i = 0; i < layout.getRangeCount(); i++)
+        {
+            const auto& range = layout.getRange(i);
+            hash.add(range.type).add(range.descCount);
+        }
+        return hash.get();
+    }
+
     static D3D12DescriptorHeap* getHeap(const DescriptorPool* pPool, DescriptorSet::Type type)
     {
         auto dxType = falcorToDxDescType(type);
@@ -34,64 +48,106 @@ namespace WIP3D
             count += range.descCount;
         }
 
+        mpApiData->descCount = count;
+        mpApiData->layoutHash = hashLayout(mLayout);
         D3D12DescriptorHeap* pHeap = getHeap(mpPool.get(), falcorType);
-        mpApiData->pAllocation = pHeap->allocateDescriptors(count);
-        if (mpApiData->pAllocation == nullptr)
+        mpApiData->pHeap = pHeap;
+        mpApiData->allocation = pHeap->allocateDescriptors(count);
+        if (mpApiData->allocation == D3D12DescriptorHeap::kInvalidAllocation)
         {
             // Execute deferred releases and try again
             mpPool->executeDeferredReleases();
-            mpApiData->pAllocation = pHeap->allocateDescriptors(count);
+            mpApiData->allocation = pHeap->allocateDescriptors(count);
         }
 
         // Allocation failed again, there is nothing else we can do.
-        if (mpApiData->pAllocation == nullptr) throw std::exception("Failed to create descriptor set");
+        if (mpApiData->allocation == D3D12DescriptorHeap::kInvalidAllocation) throw std::exception("Failed to create descriptor set");
     }
 
     DescriptorSet::CpuHandle DescriptorSet::getCpuHandle(uint32_t rangeIndex, uint32_t descInRange) const
     {
         uint32_t index = mpApiData->rangeBaseOffset[rangeIndex] + descInRange;
-        return mpApiData->pAllocation->getCpuHandle(index);
+        return mpApiData->pHeap->getCpuHandle(mpApiData->allocation, index);
     }
 
     DescriptorSet::GpuHandle DescriptorSet::getGpuHandle(uint32_t rangeIndex, uint32_t descInRange) const
     {
         uint32_t index = mpApiData->rangeBaseOffset[rangeIndex] + descInRange;
-        return mpApiData->pAllocation->getGpuHandle(index);
+        return mpApiData->pHeap->getGpuHandle(mpApiData->allocation, index);
     }
 
-    void setCpuHandle(DescriptorSet* pSet, uint32_t rangeIndex, uint32_t descIndex, const DescriptorSet::CpuHandle& handle)
+    static void setCpuHandle(DescriptorSet* pSet, DescriptorSetApiData* pData, bool trackSource, uint32_t rangeIndex, uint32_t descIndex, const std::shared_ptr<DescriptorSet>& pSrc)
     {
         auto dstHandle = pSet->getCpuHandle(rangeIndex, descIndex);
-        gpDevice->getApiHandle()->CopyDescriptorsSimple(1, dstHandle, handle, falcorToDxDescType(pSet->getRange(rangeIndex).type));
+        gpDevice->getApiHandle()->CopyDescriptorsSimple(1, dstHandle, pSrc->getCpuHandle(0), falcorToDxDescType(pSet->getRange(rangeIndex).type));
+
+        // Staging sets remember the views, they are the key into the table cache
+        if (trackSource)
+        {
+            if (pData->pSrcSets.empty()) pData->pSrcSets.resize(pData->descCount);
+            pData->pSrcSets[pData->rangeBaseOffset[rangeIndex] + descIndex] = pSrc;
+            pData->contentDirty = true;
+        }
     }
 
     void DescriptorSet::setSrv(uint32_t rangeIndex, uint32_t descIndex, const ShaderResourceView* pSrv)
     {
-        setCpuHandle(this, rangeIndex, descIndex, pSrv->getApiHandle()->getCpuHandle(0));
+        CAPTURE_COMMAND(SetDescriptor, this, 0, rangeIndex, descIndex, pSrv);
+        setCpuHandle(this, mpApiData.get(), !mpPool->isShaderVisible(), rangeIndex, descIndex, pSrv->getApiHandle());
     }
 
     void DescriptorSet::setUav(uint32_t rangeIndex, uint32_t descIndex, const UnorderedAccessView* pUav)
     {
-        setCpuHandle(this, rangeIndex, descIndex, pUav->getApiHandle()->getCpuHandle(0));
+        CAPTURE_COMMAND(SetDescriptor, this, 1, rangeIndex, descIndex, pUav);
+        setCpuHandle(this, mpApiData.get(), !mpPool->isShaderVisible(), rangeIndex, descIndex, pUav->getApiHandle());
     }
 
     void DescriptorSet::setSampler(uint32_t rangeIndex, uint32_t descIndex, const Sampler* pSampler)
     {
-        setCpuHandle(this, rangeIndex, descIndex, pSampler->getApiHandle()->getCpuHandle(0));
+        CAPTURE_COMMAND(SetDescriptor, this, 2, rangeIndex, descIndex, pSampler);
+        setCpuHandle(this, mpApiData.get(), !mpPool->isShaderVisible(), rangeIndex, descIndex, pSampler->getApiHandle());
+    }
+
+    /** Get the GPU handle to bind for a set. Sets allocated from a CPU-only pool are staging sets.
+        A staging set whose slots were all set from views shares a table with every other set with the same content, through the table cache. Otherwise its descriptors are copied into this frame's transient ring.
+    */
+    static DescriptorSet::GpuHandle getBindHandle(const DescriptorSet* pSet, const DescriptorPool* pPool, DescriptorSetApiData* pData)
+    {
+        if (pPool->isShaderVisible()) return pSet->getGpuHandle(0);
+
+        const auto& pCache = gpDevice->getDescriptorTableCache(pData->pHeap->getType());
+        bool cacheable = pCache && pData->pSrcSets.size() && std::find(pData->pSrcSets.begin(), pData->pSrcSets.end(), nullptr) == pData->pSrcSets.end();
+        if (cacheable)
+        {
+            if (pData->contentDirty)
+            {
+                pData->contentHash = DescriptorTableCache::hashContent(pData->layoutHash, pData->pSrcSets.data(), pData->descCount);
+                pData->contentDirty = false;
+            }
+            DescriptorSet::GpuHandle handle = pCache->findOrCreate(pData->layoutHash, pData->contentHash, pData->pSrcSets.data(), pData->descCount);
+            if (handle.ptr) return handle;
+        }
+
+        const auto& pRing = gpDevice->getTransientDescriptorRing(pData->pHeap->getType());
+        assert(pRing);
+        return pRing->copyTable(pSet->getCpuHandle(0), pData->descCount);
     }
 
     void DescriptorSet::bindForGraphics(CopyContext* pCtx, const RootSignature* pRootSig, uint32_t rootIndex)
     {
-        pCtx->getLowLevelData()->getCommandList()->SetGraphicsRootDescriptorTable(rootIndex, getGpuHandle(0));
+        CAPTURE_COMMAND(BindDescriptorSet, pCtx, this, pRootSig, rootIndex, false);
+        pCtx->getLowLevelData()->getCommandList()->SetGraphicsRootDescriptorTable(rootIndex, getBindHandle(this, mpPool.get(), mpApiData.get()));
     }
 
     void DescriptorSet::bindForCompute(CopyContext* pCtx, const RootSignature* pRootSig, uint32_t rootIndex)
     {
-        pCtx->getLowLevelData()->getCommandList()->SetComputeRootDescriptorTable(rootIndex, getGpuHandle(0));
+        CAPTURE_COMMAND(BindDescriptorSet, pCtx, this, pRootSig, rootIndex, true);
+        pCtx->getLowLevelData()->getCommandList()->SetComputeRootDescriptorTable(rootIndex, getBindHandle(this, mpPool.get(), mpApiData.get()));
     }
 
     void DescriptorSet::setCbv(uint32_t rangeIndex, uint32_t descIndex, ConstantBufferView* pView)
     {
-        setCpuHandle(this, rangeIndex, descIndex, pView->getApiHandle()->getCpuHandle(0));
+        CAPTURE_COMMAND(SetDescriptor, this, 3, rangeIndex, descIndex, pView);
+        setCpuHandle(this, mpApiData.get(), !mpPool->isShaderVisible(), rangeIndex, descIndex, pView->getApiHandle());
     }
 }
@@ -0,0 +1,248 @@
+#include <vector>
+#include "../Device.h"
+#include "../PipeplineStateObject.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        D3D12_BLEND_OP getD3D12BlendOp(BlendState::BlendOp op)
+        {
+            switch (op)
+            {
+            case BlendState::BlendOp::Add: return D3D12_BLEND_OP_ADD;
+            case BlendState::BlendOp::Subtract: return D3D12_BLEND_OP_SUBTRACT;
+            case BlendState::BlendOp::ReverseSubtract: return D3D12_BLEND_OP_REV_SUBTRACT;
+            case BlendState::BlendOp::Min: return D3D12_BLEND_OP_MIN;
+            case BlendState::BlendOp::Max: return D3D12_BLEND_OP_MAX;
+            default: assert(false); return D3D12_BLEND_OP_ADD;
+            }
+        }
+
+        D3D12_BLEND getD3D12BlendFunc(BlendState::BlendFunc func)
+        {
+            switch (func)
+            {
+            case BlendState::BlendFunc::Zero: return D3D12_BLEND_ZERO;
+            case BlendState::BlendFunc::One: return D3D12_BLEND_ONE;
+            case BlendState::BlendFunc::SrcColor: return D3D12_BLEND_SRC_COLOR;
+            case BlendState::BlendFunc::OneMinusSrcColor: return D3D12_BLEND_INV_SRC_COLOR;
+            case BlendState::BlendFunc::DstColor: return D3D12_BLEND_DEST_COLOR;
+            case BlendState::BlendFunc::OneMinusDstColor: return D3D12_BLEND_INV_DEST_COLOR;
+            case BlendState::BlendFunc::SrcAlpha: return D3D12_BLEND_SRC_ALPHA;
+            case BlendState::BlendFunc::OneMinusSrcAlpha: return D3D12_BLEND_INV_SRC_ALPHA;
+            case BlendState::BlendFunc::DstAlpha: return D3D12_BLEND_DEST_ALPHA;
+            case BlendState::BlendFunc::OneMinusDstAlpha: return D3D12_BLEND_INV_DEST_ALPHA;
+            case BlendState::BlendFunc::BlendFactor: return D3D12_BLEND_BLEND_FACTOR;
+            case BlendState::BlendFunc::OneMinusBlendFactor: return D3D12_BLEND_INV_BLEND_FACTOR;
+            case BlendState::BlendFunc::SrcAlphaSaturate: return D3D12_BLEND_SRC_ALPHA_SAT;
+            case BlendState::BlendFunc::Src1Color: return D3D12_BLEND_SRC1_COLOR;
+            case BlendState::BlendFunc::OneMinusSrc1Color: return D3D12_BLEND_INV_SRC1_COLOR;
+            case BlendState::BlendFunc::Src1Alpha: return D3D12_BLEND_SRC1_ALPHA;
+            case BlendState::BlendFunc::OneMinusSrc1Alpha: return D3D12_BLEND_INV_SRC1_ALPHA;
+            default: assert(false); return D3D12_BLEND_ZERO;
+            }
+        }
+
+        D3D12_COMPARISON_FUNC getD3D12ComparisonFunc(ComparisonFunc func)
+        {
+            switch (func)
+            {
+            case ComparisonFunc::Disabled: return D3D12_COMPARISON_FUNC_ALWAYS;    // D3D12 has no disabled function, the test is turned off by the enable flag
+            case ComparisonFunc::Never: return D3D12_COMPARISON_FUNC_NEVER;
+            case ComparisonFunc::Always: return D3D12_COMPARISON_FUNC_ALWAYS;
+            case ComparisonFunc::Less: return D3D12_COMPARISON_FUNC_LESS;
+            case ComparisonFunc::Equal: return D3D12_COMPARISON_FUNC_EQUAL;
+            case ComparisonFunc::NotEqual: return D3D12_COMPARISON_FUNC_NOT_EQUAL;
+            case ComparisonFunc::LessEqual: return D3D12_COMPARISON_FUNC_LESS_EQUAL;
+            case ComparisonFunc::Greater: return D3D12_COMPARISON_FUNC_GREATER;
+            case ComparisonFunc::GreaterEqual: return D3D12_COMPARISON_FUNC_GREATER_EQUAL;
+            default: assert(false); return D3D12_COMPARISON_FUNC_ALWAYS;
+            }
+        }
+
+        D3D12_STENCIL_OP getD3D12StencilOp(DepthStencilState::StencilOp op)
+        {
+            switch (op)
+            {
+            case DepthStencilState::StencilOp::Keep: return D3D12_STENCIL_OP_KEEP;
+            case DepthStencilState::StencilOp::Zero: return D3D12_STENCIL_OP_ZERO;
+            case DepthStencilState::StencilOp::Replace: return D3D12_STENCIL_OP_REPLACE;
+            case DepthStencilState::StencilOp::Increase: return D3D12_STENCIL_OP_INCR;
+            case DepthStencilState::StencilOp::IncreaseSaturate: return D3D12_STENCIL_OP_INCR_SAT;
+            case DepthStencilState::StencilOp::Decrease: return D3D12_STENCIL_OP_DECR;
+            case DepthStencilState::StencilOp::DecreaseSaturate: return D3D12_STENCIL_OP_DECR_SAT;
+            case DepthStencilState::StencilOp::Invert: return D3D12_STENCIL_OP_INVERT;
+            default: assert(false); return D3D12_STENCIL_OP_KEEP;
+            }
+        }
+
+        D3D12_PRIMITIVE_TOPOLOGY_TYPE getD3D12PrimitiveType(GraphicsStateObject::PrimitiveType type)
+        {
+            switch (type)
+            {
+            case GraphicsStateObject::PrimitiveType::Point: return D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+            case GraphicsStateObject::PrimitiveType::Line: return D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+            case GraphicsStateObject::PrimitiveType::Triangle: return D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+            case GraphicsStateObject::PrimitiveType::Patch: return D3D12_PRIMITIVE_TOPOLOGY_TYPE_PATCH;
+            default: return D3D12_PRIMITIVE_TOPOLOGY_TYPE_UNDEFINED;
+            }
+        }
+
+        void initD3D12BlendDesc(const BlendState* pState, D3D12_BLEND_DESC& desc)
+        {
+            desc.AlphaToCoverageEnable = pState->isAlphaToCoverageEnabled();
+            desc.IndependentBlendEnable = pState->isIndependentBlendEnabled();
+            assert(pState->getRtCount() <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+            for (uint32_t rt = 0; rt < pState->getRtCount(); rt++)
+            {
+                const BlendState::Desc::RenderTargetDesc& rtDesc = pState->getRtDesc(rt);
+                D3D12_RENDER_TARGET_BLEND_DESC& d3dRtDesc = desc.RenderTarget[rt];
+                d3dRtDesc.BlendEnable = rtDesc.blendEnabled;
+                d3dRtDesc.SrcBlend = getD3D12BlendFunc(rtDesc.srcRgbFunc);
+                d3dRtDesc.DestBlend = getD3D12BlendFunc(rtDesc.dstRgbFunc);
+                d3dRtDesc.BlendOp = getD3D12BlendOp(rtDesc.rgbBlendOp);
+                d3dRtDesc.SrcBlendAlpha = getD3D12BlendFunc(rtDesc.srcAlphaFunc);
+                d3dRtDesc.DestBlendAlpha = getD3D12BlendFunc(rtDesc.dstAlphaFunc);
+                d3dRtDesc.BlendOpAlpha = getD3D12BlendOp(rtDesc.alphaBlendOp);
+                d3dRtDesc.LogicOpEnable = FALSE;
+                d3dRtDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
+
+                d3dRtDesc.RenderTargetWriteMask = 0;
+                if (rtDesc.writeMask.writeRed) d3dRtDesc.RenderTargetWriteMask |= D3D12_COLOR_WRITE_ENABLE_RED;
+                if (rtDesc.writeMask.writeGreen) d3dRtDesc.RenderTargetWriteMask |= D3D12_COLOR_WRITE_ENABLE_GREEN;
+                if (rtDesc.writeMask.writeBlue) d3dRtDesc.RenderTargetWriteMask |= D3D12_COLOR_WRITE_ENABLE_BLUE;
+                if (rtDesc.writeMask.writeAlpha) d3dRtDesc.RenderTargetWriteMask |= D3D12_COLOR_WRITE_ENABLE_ALPHA;
+            }
+        }
+
+        void initD3D12RasterizerDesc(const RasterizerState* pState, D3D12_RASTERIZER_DESC& desc)
+        {
+            desc.FillMode = (pState->getFillMode() == RasterizerState::FillMode::Wireframe) ? D3D12_FILL_MODE_WIREFRAME : D3D12_FILL_MODE_SOLID;
+            switch (pState->getCullMode())
+            {
+            case RasterizerState::CullMode::None: desc.CullMode = D3D12_CULL_MODE_NONE; break;
+            case RasterizerState::CullMode::Front: desc.CullMode = D3D12_CULL_MODE_FRONT; break;
+            default: desc.CullMode = D3D12_CULL_MODE_BACK; break;
+            }
+            desc.FrontCounterClockwise = pState->isFrontCounterCW();
+            desc.DepthBias = pState->getDepthBias();
+            desc.DepthBiasClamp = 0;
+            desc.SlopeScaledDepthBias = pState->getSlopeScaledDepthBias();
+            desc.DepthClipEnable = !pState->isDepthClampEnabled();
+            desc.MultisampleEnable = FALSE;
+            desc.AntialiasedLineEnable = pState->isLineAntiAliasingEnabled();
+            desc.ForcedSampleCount = pState->getForcedSampleCount();
+            desc.ConservativeRaster = pState->isConservativeRasterizationEnabled() ? D3D12_CONSERVATIVE_RASTERIZATION_MODE_ON : D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
+        }
+
+        void initD3D12StencilOpDesc(const DepthStencilState::StencilDesc& stencil, D3D12_DEPTH_STENCILOP_DESC& desc)
+        {
+            desc.StencilFunc = getD3D12ComparisonFunc(stencil.func);
+            desc.StencilFailOp = getD3D12StencilOp(stencil.stencilFailOp);
+            desc.StencilDepthFailOp = getD3D12StencilOp(stencil.depthFailOp);
+            desc.StencilPassOp = getD3D12StencilOp(stencil.depthStencilPassOp);
+        }
+
+        void initD3D12DepthStencilDesc(const DepthStencilState* pState, D3D12_DEPTH_STENCIL_DESC& desc)
+        {
+            desc.DepthEnable = pState->isDepthTestEnabled();
+            desc.DepthFunc = getD3D12ComparisonFunc(pState->getDepthFunc());
+            desc.DepthWriteMask = pState->isDepthWriteEnabled() ? D3D12_DEPTH_WRITE_MASK_ALL : D3D12_DEPTH_WRITE_MASK_ZERO;
+            desc.StencilEnable = pState->isStencilTestEnabled();
+            desc.StencilReadMask = pState->getStencilReadMask();
+            desc.StencilWriteMask = pState->getStencilWriteMask();
+            initD3D12StencilOpDesc(pState->getStencilDesc(DepthStencilState::Face::Front), desc.FrontFace);
+            initD3D12StencilOpDesc(pState->getStencilDesc(DepthStencilState::Face::Back), desc.BackFace);
+        }
+
+        // The semantic names point into the layout, which must outlive the elements
+        void initD3D12InputLayout(const VertexLayout* pLayout, std::vector<D3D12_INPUT_ELEMENT_DESC>& elements)
+        {
+            for (size_t vb = 0; vb < pLayout->getBufferCount(); vb++)
+            {
+                const VertexBufferLayout::SharedConstPtr& pVB = pLayout->getBufferLayout(vb);
+                if (pVB == nullptr) continue;
+
+                for (uint32_t elemIndex = 0; elemIndex < pVB->getElementCount(); elemIndex++)
+                {
+                    D3D12_INPUT_ELEMENT_DESC element = {};
+                    element.SemanticName = pVB->getElementName(elemIndex).c_str();
+                    element.Format = getDxgiFormat(pVB->getElementFormat(elemIndex));
+                    element.InputSlot = (UINT)vb;
+                    element.AlignedByteOffset = pVB->getElementOffset(elemIndex);
+                    element.InputSlotClass = (pVB->getInputClass() == VertexBufferLayout::InputClass::PerInstanceData) ? D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA : D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
+                    element.InstanceDataStepRate = pVB->getInstanceStepRate();
+
+                    // Arrays take one element per entry, with increasing semantic indices
+                    for (uint32_t arrayIndex = 0; arrayIndex < pVB->getElementArraySize(elemIndex); arrayIndex++)
+                    {
+                        element.SemanticIndex = arrayIndex;
+                        elements.push_back(element);
+                        element.AlignedByteOffset += getFormatBytesPerBlock(pVB->getElementFormat(elemIndex));
+                    }
+                }
+            }
+        }
+
+        D3D12_SHADER_BYTECODE getShaderByteCode(const ProgramKernels* pProgram, ShaderType type)
+        {
+            const auto pShader = pProgram->getShader(type);
+            return pShader ? pShader->getApiHandle() : D3D12_SHADER_BYTECODE{};
+        }
+    }
+
+    GraphicsStateObject::~GraphicsStateObject()
+    {
+        // A PSO from the PipelineStateCache is also owned by the cache
+        if (mApiHandle) gpDevice->releaseResource(mApiHandle);
+    }
+
+    void GraphicsStateObject::apiInit()
+    {
+        assert(mDesc.mpProgram);
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+        desc.VS = getShaderByteCode(mDesc.mpProgram.get(), ShaderType::Vertex);
+        desc.PS = getShaderByteCode(mDesc.mpProgram.get(), ShaderType::Pixel);
+        desc.GS = getShaderByteCode(mDesc.mpProgram.get(), ShaderType::Geometry);
+        desc.HS = getShaderByteCode(mDesc.mpProgram.get(), ShaderType::Hull);
+        desc.DS = getShaderByteCode(mDesc.mpProgram.get(), ShaderType::Domain);
+
+        initD3D12BlendDesc(mDesc.mpBlendState.get(), desc.BlendState);
+        initD3D12RasterizerDesc(mDesc.mpRasterizerState.get(), desc.RasterizerState);
+        initD3D12DepthStencilDesc(mDesc.mpDepthStencilState.get(), desc.DepthStencilState);
+
+        std::vector<D3D12_INPUT_ELEMENT_DESC> inputElements;
+        if (mDesc.mpLayout) initD3D12InputLayout(mDesc.mpLayout.get(), inputElements);
+        desc.InputLayout.NumElements = (UINT)inputElements.size();
+        desc.InputLayout.pInputElementDescs = inputElements.data();
+
+        desc.SampleMask = mDesc.mSampleMask;
+        desc.pRootSignature = mDesc.mpRootSignature ? mDesc.mpRootSignature->getApiHandle().GetInterfacePtr() : nullptr;
+
+        uint32_t rtCount = 0;
+        for (uint32_t rt = 0; rt < Fbo::getMaxColorTargetCount(); rt++)
+        {
+            desc.RTVFormats[rt] = getDxgiFormat(mDesc.mFboDesc.getColorTargetFormat(rt));
+            if (desc.RTVFormats[rt] != DXGI_FORMAT_UNKNOWN) rtCount = rt + 1;
+        }
+        desc.NumRenderTargets = rtCount;
+        desc.DSVFormat = getDxgiFormat(mDesc.mFboDesc.getDepthStencilFormat());
+        desc.SampleDesc.Count = mDesc.mFboDesc.getSampleCount();
+        desc.PrimitiveTopologyType = getD3D12PrimitiveType(mDesc.mPrimType);
+
+        // Request the PSO without waiting, draws decide what to do until it's ready, see RenderContext::PendingPipelinePolicy
+        const PipelineStateCache::SharedPtr& pCache = gpDevice->getPipelineStateCache();
+        if (pCache)
+        {
+            uint64_t rootSignatureHash = mDesc.mpRootSignature ? mDesc.mpRootSignature->getDesc().getHash() : 0;
+            mPendingHandle = pCache->requestGraphicsState(desc, rootSignatureHash);
+            return;
+        }
+
+        if (FAILED(gpDevice->getApiHandle()->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&mApiHandle))))
+        {
+            throw std::exception("Failed to create graphics PSO");
+        }
+    }
+}
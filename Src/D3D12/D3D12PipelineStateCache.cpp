@@ -0,0 +1,413 @@
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include "../Common/Logger.h"
+#include "../Device.h"
+#include "../PipelineStateCache.h"
+#include "D3D12PipelineStateHash.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        using Clock = std::chrono::high_resolution_clock;
+
+        double getElapsedMs(Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        std::wstring getLibraryName(uint64_t hash)
+        {
+            wchar_t name[17];
+            swprintf_s(name, L"%016llx", (unsigned long long)hash);
+            return name;
+        }
+
+        ID3D12PipelineStatePtr createGraphicsState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+        {
+            ID3D12PipelineStatePtr pState;
+            d3d_call(gpDevice->getApiHandle()->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pState)));
+            return pState;
+        }
+
+        ID3D12PipelineStatePtr createComputeState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+        {
+            ID3D12PipelineStatePtr pState;
+            d3d_call(gpDevice->getApiHandle()->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pState)));
+            return pState;
+        }
+
+        void copyShader(D3D12_SHADER_BYTECODE& shader, std::vector<uint8_t>& storage)
+        {
+            const uint8_t* pBytes = (const uint8_t*)shader.pShaderBytecode;
+            storage.assign(pBytes, pBytes + shader.BytecodeLength);
+            shader.pShaderBytecode = storage.data();
+        }
+
+        /** Owns everything a graphics desc points to, so the PSO can be compiled after the caller's desc is gone
+        */
+        struct GraphicsDescCopy
+        {
+            D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+            ID3D12RootSignaturePtr pRootSignature;
+            std::vector<uint8_t> shaders[5];
+            std::vector<D3D12_INPUT_ELEMENT_DESC> inputElements;
+            std::vector<D3D12_SO_DECLARATION_ENTRY> soEntries;
+            std::vector<UINT> soStrides;
+            std::deque<std::string> semanticNames;  // A deque never moves its elements, so the c_str() pointers stay valid
+
+            GraphicsDescCopy(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& src)
+                : desc(src)
+                , pRootSignature(src.pRootSignature)
+            {
+                copyShader(desc.VS, shaders[0]);
+                copyShader(desc.PS, shaders[1]);
+                copyShader(desc.DS, shaders[2]);
+                copyShader(desc.HS, shaders[3]);
+                copyShader(desc.GS, shaders[4]);
+
+                const D3D12_INPUT_LAYOUT_DESC& layout = src.InputLayout;
+                inputElements.assign(layout.pInputElementDescs, layout.pInputElementDescs + layout.NumElements);
+                for (auto& element : inputElements) element.SemanticName = copyName(element.SemanticName);
+                desc.InputLayout.pInputElementDescs = inputElements.data();
+
+                const D3D12_STREAM_OUTPUT_DESC& so = src.StreamOutput;
+                soEntries.assign(so.pSODeclaration, so.pSODeclaration + so.NumEntries);
+                for (auto& entry : soEntries) entry.SemanticName = copyName(entry.SemanticName);
+                soStrides.assign(so.pBufferStrides, so.pBufferStrides + so.NumStrides);
+                desc.StreamOutput.pSODeclaration = soEntries.data();
+                desc.StreamOutput.pBufferStrides = soStrides.data();
+
+                // Not owned, and the library supersedes it anyway
+                desc.CachedPSO = {};
+            }
+
+            GraphicsDescCopy(const GraphicsDescCopy&) = delete;
+            GraphicsDescCopy& operator=(const GraphicsDescCopy&) = delete;
+
+            const char* copyName(const char* name)
+            {
+                // Stream-output gaps have no semantic name
+                if (name == nullptr) return nullptr;
+                semanticNames.push_back(name);
+                return semanticNames.back().c_str();
+            }
+        };
+
+        struct ComputeDescCopy
+        {
+            D3D12_COMPUTE_PIPELINE_STATE_DESC desc;
+            ID3D12RootSignaturePtr pRootSignature;
+            std::vector<uint8_t> shader;
+
+            ComputeDescCopy(const D3D12_COMPUTE_PIPELINE_STATE_DESC& src)
+                : desc(src)
+                , pRootSignature(src.pRootSignature)
+            {
+                copyShader(desc.CS, shader);
+                desc.CachedPSO = {};
+            }
+
+            ComputeDescCopy(const ComputeDescCopy&) = delete;
+            ComputeDescCopy& operator=(const ComputeDescCopy&) = delete;
+        };
+    }
+
+    PipelineStateCache::SharedPtr PipelineStateCache::create(const std::string& filename, uint32_t compileThreadCount)
+    {
+        return SharedPtr(new PipelineStateCache(filename, compileThreadCount));
+    }
+
+    PipelineStateCache::PipelineStateCache(const std::string& filename, uint32_t compileThreadCount)
+        : mFilename(filename)
+    {
+        for (uint32_t i = 0; i < compileThreadCount; i++) mCompileThreads.emplace_back(&PipelineStateCache::compileLoop, this);
+
+        ID3D12Device1Ptr pDevice1;
+        if (FAILED(gpDevice->getApiHandle()->QueryInterface(IID_PPV_ARGS(&pDevice1))))
+        {
+            LOG_WARN("PipelineStateCache - pipeline libraries are not supported, PSOs will only be cached in memory");
+            return;
+        }
+
+        if (mFilename.size())
+        {
+            std::ifstream fin(mFilename, std::ios::binary);
+            if (fin.is_open()) mLibraryBlob.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        }
+
+        HRESULT hr = E_FAIL;
+        if (mLibraryBlob.size())
+        {
+            // Fails with D3D12_ERROR_DRIVER_VERSION_MISMATCH or D3D12_ERROR_ADAPTER_NOT_FOUND after a driver or GPU change, and with E_INVALIDARG if the file is corrupted
+            hr = pDevice1->CreatePipelineLibrary(mLibraryBlob.data(), mLibraryBlob.size(), IID_PPV_ARGS(&mpLibrary));
+            if (FAILED(hr))
+            {
+                LOG_WARN(("PipelineStateCache - discarding " + mFilename + ", it was written by a different driver or adapter, or is corrupted").c_str());
+                mLibraryBlob.clear();
+            }
+        }
+
+        if (FAILED(hr))
+        {
+            hr = pDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mpLibrary));
+            if (FAILED(hr))
+            {
+                LOG_WARN("PipelineStateCache - can't create a pipeline library, PSOs will only be cached in memory");
+                mpLibrary = nullptr;
+            }
+        }
+    }
+
+    PipelineStateCache::~PipelineStateCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTerminate = true;
+        }
+        mJobQueued.notify_all();
+        for (auto& thread : mCompileThreads) thread.join();
+        save();
+    }
+
+    uint64_t PipelineStateCache::hashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        return hashPipelineStateDesc(desc, rootSignatureHash);
+    }
+
+    uint64_t PipelineStateCache::hashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        return hashPipelineStateDesc(desc, rootSignatureHash);
+    }
+
+    ID3D12PipelineStatePtr PipelineStateCache::getGraphicsState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        auto load = [&](const wchar_t* name, ID3D12PipelineStatePtr& pState)
+        {
+            return mpLibrary->LoadGraphicsPipeline(name, &desc, IID_PPV_ARGS(&pState));
+        };
+
+        uint64_t hash = hashDesc(desc, rootSignatureHash);
+        std::shared_ptr<Promise> pPromise;
+        StateFuture future = find(hash, load, pPromise);
+        if (pPromise) compile(hash, [&]() { return createGraphicsState(desc); }, *pPromise);
+        return future.get();
+    }
+
+    ID3D12PipelineStatePtr PipelineStateCache::getComputeState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        auto load = [&](const wchar_t* name, ID3D12PipelineStatePtr& pState)
+        {
+            return mpLibrary->LoadComputePipeline(name, &desc, IID_PPV_ARGS(&pState));
+        };
+
+        uint64_t hash = hashDesc(desc, rootSignatureHash);
+        std::shared_ptr<Promise> pPromise;
+        StateFuture future = find(hash, load, pPromise);
+        if (pPromise) compile(hash, [&]() { return createComputeState(desc); }, *pPromise);
+        return future.get();
+    }
+
+    PipelineStateCache::StateFuture PipelineStateCache::requestGraphicsState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        auto load = [&](const wchar_t* name, ID3D12PipelineStatePtr& pState)
+        {
+            return mpLibrary->LoadGraphicsPipeline(name, &desc, IID_PPV_ARGS(&pState));
+        };
+
+        uint64_t hash = hashDesc(desc, rootSignatureHash);
+        std::shared_ptr<Promise> pPromise;
+        StateFuture future = find(hash, load, pPromise);
+        if (pPromise)
+        {
+            auto pCopy = std::make_shared<GraphicsDescCopy>(desc);
+            enqueue(hash, [pCopy]() { return createGraphicsState(pCopy->desc); }, pPromise);
+        }
+        return future;
+    }
+
+    PipelineStateCache::StateFuture PipelineStateCache::requestComputeState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        auto load = [&](const wchar_t* name, ID3D12PipelineStatePtr& pState)
+        {
+            return mpLibrary->LoadComputePipeline(name, &desc, IID_PPV_ARGS(&pState));
+        };
+
+        uint64_t hash = hashDesc(desc, rootSignatureHash);
+        std::shared_ptr<Promise> pPromise;
+        StateFuture future = find(hash, load, pPromise);
+        if (pPromise)
+        {
+            auto pCopy = std::make_shared<ComputeDescCopy>(desc);
+            enqueue(hash, [pCopy]() { return createComputeState(pCopy->desc); }, pPromise);
+        }
+        return future;
+    }
+
+    PipelineStateCache::StateFuture PipelineStateCache::find(uint64_t hash, const LoadFunc& load, std::shared_ptr<Promise>& pPromise)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // Pending entries are returned too, so a PSO is never compiled twice
+        auto it = mStates.find(hash);
+        if (it != mStates.end())
+        {
+            mStats.memoryHits++;
+            return it->second;
+        }
+
+        pPromise = std::make_shared<Promise>();
+        StateFuture future = pPromise->get_future().share();
+        mStates[hash] = future;
+
+        // Loads are cheap compared to compilation, and the library requires loads of the same PSO to be synchronized, so they happen under the lock.
+        // A load fails if the name isn't in the library, or if the stored PSO doesn't match the desc
+        if (mpLibrary)
+        {
+            auto start = Clock::now();
+            ID3D12PipelineStatePtr pState;
+            HRESULT hr = load(getLibraryName(hash).c_str(), pState);
+            mStats.libraryLoadTime += getElapsedMs(start);
+            if (SUCCEEDED(hr))
+            {
+                mStats.libraryHits++;
+                pPromise->set_value(pState);
+                pPromise = nullptr;
+                return future;
+            }
+        }
+
+        mStats.pendingCount++;
+        return future;
+    }
+
+    void PipelineStateCache::compile(uint64_t hash, const CreateFunc& create, Promise& promise)
+    {
+        auto start = Clock::now();
+        ID3D12PipelineStatePtr pState;
+        try
+        {
+            pState = create();
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR((std::string("PipelineStateCache - PSO creation failed: ") + e.what()).c_str());
+            pState = nullptr;
+        }
+        catch (...)
+        {
+            LOG_ERROR("PipelineStateCache - PSO creation failed");
+            pState = nullptr;
+        }
+        double compileTime = getElapsedMs(start);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.misses++;
+            mStats.pendingCount--;
+            mStats.compileTime += compileTime;
+
+            // Names can't be replaced, so this fails if the library holds a mismatching PSO under the same name. The PSO is then only cached in memory
+            if (pState && mpLibrary && SUCCEEDED(mpLibrary->StorePipeline(getLibraryName(hash).c_str(), pState))) mDirty = true;
+        }
+
+        // Failures stay in the cache as nullptr, so a broken PSO isn't recompiled on every request
+        promise.set_value(pState);
+    }
+
+    void PipelineStateCache::enqueue(uint64_t hash, const CreateFunc& create, const std::shared_ptr<Promise>& pPromise)
+    {
+        if (mCompileThreads.empty())
+        {
+            compile(hash, create, *pPromise);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJobs.push_back({ hash, create, pPromise });
+        }
+        mJobQueued.notify_one();
+    }
+
+    void PipelineStateCache::compileLoop()
+    {
+        while (true)
+        {
+            CompileJob job;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mJobQueued.wait(lock, [this]() { return mTerminate || mJobs.size(); });
+
+                // The queue is drained before terminating, so every future completes
+                if (mJobs.empty()) return;
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+            if (job.pPromise) compile(job.hash, job.create, *job.pPromise);
+            else save();
+        }
+    }
+
+    bool PipelineStateCache::save()
+    {
+        // Taken first, so a newer serialization can't be overwritten by an older one
+        std::lock_guard<std::mutex> fileLock(mFileMutex);
+        std::vector<uint8_t> blob;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mSaveQueued = false;
+            if (mDirty == false || mFilename.empty()) return true;
+
+            blob.resize(mpLibrary->GetSerializedSize());
+            if (FAILED(mpLibrary->Serialize(blob.data(), blob.size())))
+            {
+                LOG_WARN("PipelineStateCache::save() - can't serialize the pipeline library");
+                return false;
+            }
+            mDirty = false;
+        }
+
+        std::ofstream fout(mFilename, std::ios::binary);
+        if (fout.is_open() == false || fout.write((const char*)blob.data(), blob.size()).fail())
+        {
+            LOG_WARN(("PipelineStateCache::save() - can't write " + mFilename).c_str());
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDirty = true;
+            return false;
+        }
+        return true;
+    }
+
+    void PipelineStateCache::saveAsync()
+    {
+        if (mCompileThreads.empty())
+        {
+            save();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mDirty == false || mSaveQueued) return;
+            mSaveQueued = true;
+            mJobs.push_back({ 0, nullptr, nullptr });
+        }
+        mJobQueued.notify_one();
+    }
+
+    bool PipelineStateCache::isDirty() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mDirty;
+    }
+
+    PipelineStateCache::Stats PipelineStateCache::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Stats stats = mStats;
+        stats.entryCount = (uint32_t)mStates.size();
+        return stats;
+    }
+}
@@ -0,0 +1,95 @@
+#include "D3D12PipelineStateHash.h"
+#include "../StableHash.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        // Keeps graphics and compute keys apart
+        enum class StateType : uint32_t
+        {
+            Graphics,
+            Compute,
+        };
+
+        void hashShader(StableHash& hash, const D3D12_SHADER_BYTECODE& shader)
+        {
+            hash.add((uint64_t)shader.BytecodeLength);
+            if (shader.BytecodeLength) hash.add(shader.pShaderBytecode, shader.BytecodeLength);
+        }
+
+        void hashStencilOp(StableHash& hash, const D3D12_DEPTH_STENCILOP_DESC& desc)
+        {
+            hash.add(desc.StencilFailOp).add(desc.StencilDepthFailOp).add(desc.StencilPassOp).add(desc.StencilFunc);
+        }
+    }
+
+    uint64_t hashPipelineStateDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        StableHash hash;
+        hash.add(StateType::Graphics).add(rootSignatureHash);
+
+        hashShader(hash, desc.VS);
+        hashShader(hash, desc.PS);
+        hashShader(hash, desc.DS);
+        hashShader(hash, desc.HS);
+        hashShader(hash, desc.GS);
+
+        const D3D12_STREAM_OUTPUT_DESC& so = desc.StreamOutput;
+        hash.add(so.NumEntries).add(so.NumStrides).add(so.RasterizedStream);
+        for (uint32_t i = 0; i < so.NumEntries; i++)
+        {
+            const D3D12_SO_DECLARATION_ENTRY& entry = so.pSODeclaration[i];
+            hash.add(entry.Stream).addString(entry.SemanticName).add(entry.SemanticIndex).add(entry.StartComponent).add(entry.ComponentCount).add(entry.OutputSlot);
+        }
+        for (uint32_t i = 0; i < so.NumStrides; i++) hash.add(so.pBufferStrides[i]);
+
+        // The blend descs end with a UINT8, so they can't be hashed as raw memory
+        const D3D12_BLEND_DESC& blend = desc.BlendState;
+        hash.add(blend.AlphaToCoverageEnable).add(blend.IndependentBlendEnable);
+        for (const D3D12_RENDER_TARGET_BLEND_DESC& rt : blend.RenderTarget)
+        {
+            hash.add(rt.BlendEnable).add(rt.LogicOpEnable);
+            hash.add(rt.SrcBlend).add(rt.DestBlend).add(rt.BlendOp);
+            hash.add(rt.SrcBlendAlpha).add(rt.DestBlendAlpha).add(rt.BlendOpAlpha);
+            hash.add(rt.LogicOp).add(rt.RenderTargetWriteMask);
+        }
+        hash.add(desc.SampleMask);
+
+        const D3D12_RASTERIZER_DESC& rs = desc.RasterizerState;
+        hash.add(rs.FillMode).add(rs.CullMode).add(rs.FrontCounterClockwise);
+        hash.add(rs.DepthBias).add(rs.DepthBiasClamp).add(rs.SlopeScaledDepthBias);
+        hash.add(rs.DepthClipEnable).add(rs.MultisampleEnable).add(rs.AntialiasedLineEnable);
+        hash.add(rs.ForcedSampleCount).add(rs.ConservativeRaster);
+
+        const D3D12_DEPTH_STENCIL_DESC& ds = desc.DepthStencilState;
+        hash.add(ds.DepthEnable).add(ds.DepthWriteMask).add(ds.DepthFunc);
+        hash.add(ds.StencilEnable).add(ds.StencilReadMask).add(ds.StencilWriteMask);
+        hashStencilOp(hash, ds.FrontFace);
+        hashStencilOp(hash, ds.BackFace);
+
+        hash.add(desc.InputLayout.NumElements);
+        for (uint32_t i = 0; i < desc.InputLayout.NumElements; i++)
+        {
+            const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+            hash.addString(element.SemanticName).add(element.SemanticIndex).add(element.Format).add(element.InputSlot);
+            hash.add(element.AlignedByteOffset).add(element.InputSlotClass).add(element.InstanceDataStepRate);
+        }
+
+        hash.add(desc.IBStripCutValue).add(desc.PrimitiveTopologyType);
+        hash.add(desc.NumRenderTargets);
+        for (uint32_t i = 0; i < desc.NumRenderTargets; i++) hash.add(desc.RTVFormats[i]);
+        hash.add(desc.DSVFormat).add(desc.SampleDesc.Count).add(desc.SampleDesc.Quality);
+        hash.add(desc.NodeMask).add(desc.Flags);
+        return hash.get();
+    }
+
+    uint64_t hashPipelineStateDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash)
+    {
+        StableHash hash;
+        hash.add(StateType::Compute).add(rootSignatureHash);
+        hashShader(hash, desc.CS);
+        hash.add(desc.NodeMask).add(desc.Flags);
+        return hash.get();
+    }
+}
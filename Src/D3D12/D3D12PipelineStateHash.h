@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+#include <d3d12.h>
+
+namespace WIP3D
+{
+    /** Get the stable hash of a PSO description, the key of the PipelineStateCache.
+        Every field that affects the compiled PSO is hashed, including the shader bytecode, but no pointers, so the key is the same on every run. Only depends on the D3D12 types, so it can be measured without a device.
+        \param[in] desc The description.
+        \param[in] rootSignatureHash Stable hash of the root signature layout, see RootSignature::Desc::getHash().
+    */
+    uint64_t hashPipelineStateDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+    uint64_t hashPipelineStateDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+}
@@ -0,0 +1,70 @@
+#include "../Device.h"
+#include "../GraphicsContext.h"
+#include "../Profiler.h"
+
+namespace WIP3D
+{
+    void Profiler::apiInit()
+    {
+        uint32_t queryCount = kFrameLatency * mMaxEventsPerFrame * 2;
+        mpQueryHeap = gpDevice->createQueryHeap(QueryHeap::Type::Timestamp, queryCount);
+        mpReadbackBuffer = Buffer::create(queryCount * sizeof(uint64_t), Resource::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+
+        // The buffer stays mapped, a frame's range is only read once the GPU is done with it
+        D3D12_RANGE readRange = { 0, queryCount * sizeof(uint64_t) };
+        d3d_call(mpReadbackBuffer->getApiHandle()->Map(0, &readRange, (void**)&mpTimestamps));
+    }
+
+    void Profiler::apiShutdown()
+    {
+        if (mpTimestamps == nullptr) return;
+        D3D12_RANGE writeRange = {};
+        mpReadbackBuffer->getApiHandle()->Unmap(0, &writeRange);
+        mpTimestamps = nullptr;
+    }
+
+    void Profiler::writeTimestamp(CopyContext* pContext, uint32_t queryIndex)
+    {
+        QueryHeap::SharedPtr pHeap = mpQueryHeap.lock();
+        if (pHeap == nullptr) return;
+
+        // Record the queued barriers first, so their cost is charged to the scope they were issued in
+        pContext->flushBarriers();
+        pContext->getLowLevelData()->getCommandList()->EndQuery(pHeap->getApiHandle(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+        pContext->setPendingCommands(true);
+    }
+
+    void Profiler::resolveTimestamps(CopyContext* pContext, uint32_t frameIndex, uint32_t eventCount)
+    {
+        QueryHeap::SharedPtr pHeap = mpQueryHeap.lock();
+        if (pHeap == nullptr) return;
+        uint32_t firstQuery = getQueryIndex(frameIndex, 0);
+        pContext->flushBarriers();
+        pContext->getLowLevelData()->getCommandList()->ResolveQueryData(pHeap->getApiHandle(), D3D12_QUERY_TYPE_TIMESTAMP, firstQuery, eventCount * 2, mpReadbackBuffer->getApiHandle(), firstQuery * sizeof(uint64_t));
+        pContext->setPendingCommands(true);
+    }
+
+    void Profiler::sampleClocks(CopyContext* pContext, uint64_t& gpuTimestamp, uint64_t& cpuTimestamp)
+    {
+        // The CPU timestamp is a QueryPerformanceCounter() value, which is why getCpuTicks() uses it
+        d3d_call(pContext->getLowLevelData()->getCommandQueue()->GetClockCalibration(&gpuTimestamp, &cpuTimestamp));
+    }
+
+    uint64_t Profiler::getCpuTicks()
+    {
+        LARGE_INTEGER ticks;
+        QueryPerformanceCounter(&ticks);
+        return (uint64_t)ticks.QuadPart;
+    }
+
+    double Profiler::getCpuTicksPerSecond()
+    {
+        static double sTicksPerSecond = []()
+        {
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            return (double)frequency.QuadPart;
+        }();
+        return sTicksPerSecond;
+    }
+}
@@ -124,7 +124,38 @@ namespace WIP3D
     }
 
     template<typename T>
-    ResourceView<T>::~ResourceView() = default;
+    ResourceView<T>::~ResourceView()
+    {
+        uint32_t index = mBindlessIndex.load();
+        if (index != BindlessDescriptorTable::kInvalidIndex && gpDevice && gpDevice->getBindlessTable())
+        {
+            gpDevice->getBindlessTable()->release(index);
+        }
+    }
+
+    template<typename T>
+    uint32_t ResourceView<T>::requestBindlessIndex()
+    {
+        uint32_t index = mBindlessIndex.load();
+        if (index != BindlessDescriptorTable::kInvalidIndex || mBindlessAllowed == false) return index;
+
+        const auto& pTable = gpDevice->getBindlessTable();
+        if (pTable == nullptr) return BindlessDescriptorTable::kInvalidIndex;
+        index = pTable->allocate(mApiHandle->getCpuHandle(0));
+        if (index == BindlessDescriptorTable::kInvalidIndex) return index;
+
+        // Another thread may have registered the view in the meantime, keep its slot
+        uint32_t expected = BindlessDescriptorTable::kInvalidIndex;
+        if (mBindlessIndex.compare_exchange_strong(expected, index) == false)
+        {
+            pTable->release(index);
+            return expected;
+        }
+        return index;
+    }
+
+    // All the view handles are descriptor sets, so this covers both the SRVs and the UAVs
+    template uint32_t ResourceView<SrvHandle>::requestBindlessIndex();
 
     D3D12_SHADER_RESOURCE_VIEW_DESC createBufferSrvDesc(const Buffer* pBuffer, uint32_t firstElement, uint32_t elementCount)
     {
@@ -407,7 +438,9 @@ namespace WIP3D
         D3D12_SHADER_RESOURCE_VIEW_DESC desc = createTextureSrvDesc(pTexture.get(), firstArraySlice, arraySize, mostDetailedMip, mipCount);
         Resource::ApiHandle resHandle = pTexture->getApiHandle();
 
-        return SharedPtr(new ShaderResourceView(pTexture, createSrvDescriptor(desc, resHandle), mostDetailedMip, mipCount, firstArraySlice, arraySize));
+        SharedPtr pView = SharedPtr(new ShaderResourceView(pTexture, createSrvDescriptor(desc, resHandle), mostDetailedMip, mipCount, firstArraySlice, arraySize));
+        pView->mBindlessAllowed = true;
+        return pView;
     }
 
     ShaderResourceView::SharedPtr ShaderResourceView::create(ConstBufferSharedPtrRef pBuffer, uint32_t firstElement, uint32_t elementCount)
@@ -416,7 +449,9 @@ namespace WIP3D
         D3D12_SHADER_RESOURCE_VIEW_DESC desc = createBufferSrvDesc(pBuffer.get(), firstElement, elementCount);
         Resource::ApiHandle resHandle = pBuffer->getApiHandle();
 
-        return SharedPtr(new ShaderResourceView(pBuffer, createSrvDescriptor(desc, resHandle), firstElement, elementCount));
+        SharedPtr pView = SharedPtr(new ShaderResourceView(pBuffer, createSrvDescriptor(desc, resHandle), firstElement, elementCount));
+        pView->mBindlessAllowed = true;
+        return pView;
     }
 
     ShaderResourceView::SharedPtr ShaderResourceView::create(Dimension dimension)
@@ -493,7 +528,9 @@ namespace WIP3D
         D3D12_UNORDERED_ACCESS_VIEW_DESC desc = createDsvRtvUavDescCommon<D3D12_UNORDERED_ACCESS_VIEW_DESC>(pTexture.get(), mipLevel, firstArraySlice, arraySize);
         Resource::ApiHandle resHandle = pTexture->getApiHandle();
 
-        return SharedPtr(new UnorderedAccessView(pTexture, createUavDescriptor(desc, resHandle, nullptr), mipLevel, firstArraySlice, arraySize));
+        SharedPtr pView = SharedPtr(new UnorderedAccessView(pTexture, createUavDescriptor(desc, resHandle, nullptr), mipLevel, firstArraySlice, arraySize));
+        pView->mBindlessAllowed = true;
+        return pView;
     }
 
     UnorderedAccessView::SharedPtr UnorderedAccessView::create(ConstBufferSharedPtrRef pBuffer, uint32_t firstElement, uint32_t elementCount)
@@ -507,7 +544,9 @@ namespace WIP3D
             counterHandle = pBuffer->getUAVCounter()->getApiHandle();
         }
 
-        return SharedPtr(new UnorderedAccessView(pBuffer, createUavDescriptor(desc, resHandle, counterHandle), firstElement, elementCount));
+        SharedPtr pView = SharedPtr(new UnorderedAccessView(pBuffer, createUavDescriptor(desc, resHandle, counterHandle), firstElement, elementCount));
+        pView->mBindlessAllowed = true;
+        return pView;
     }
 
     UnorderedAccessView::SharedPtr UnorderedAccessView::create(Dimension dimension)
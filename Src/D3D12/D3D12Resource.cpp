@@ -33,6 +33,9 @@ namespace WIP3D
         0
     };
 
+    // Buffers up to this size are placed in the device's PlacedResourceHeap, larger ones get a committed resource
+    static const size_t kMaxPlacedBufferSize = 4 * 1024 * 1024;
+
     D3D12_RESOURCE_FLAGS getD3D12ResourceFlags(Resource::BindFlags flags)
     {
         D3D12_RESOURCE_FLAGS d3d = D3D12_RESOURCE_FLAG_NONE;
@@ -127,12 +130,8 @@ namespace WIP3D
 
    // ID3D12ResourcePtr createBuffer(Buffer::State initState, size_t size, const D3D12_HEAP_PROPERTIES& heapProps, Buffer::BindFlags bindFlags);
 
-    ID3D12ResourcePtr createBuffer(Buffer::State initState, size_t size, const D3D12_HEAP_PROPERTIES& heapProps, Buffer::BindFlags bindFlags)
+    D3D12_RESOURCE_DESC getBufferDesc(size_t size, Buffer::BindFlags bindFlags)
     {
-        assert(gpDevice);
-        ID3D12Device* pDevice = gpDevice->getApiHandle();
-
-        // Create the buffer
         D3D12_RESOURCE_DESC bufDesc = {};
         bufDesc.Alignment = 0;
         bufDesc.DepthOrArraySize = 1;
@@ -146,7 +145,16 @@ namespace WIP3D
         bufDesc.SampleDesc.Quality = 0;
         bufDesc.Width = size;
         assert(bufDesc.Width > 0);
+        return bufDesc;
+    }
 
+    ID3D12ResourcePtr createBuffer(Buffer::State initState, size_t size, const D3D12_HEAP_PROPERTIES& heapProps, Buffer::BindFlags bindFlags)
+    {
+        assert(gpDevice);
+        ID3D12Device* pDevice = gpDevice->getApiHandle();
+
+        // Create the buffer
+        D3D12_RESOURCE_DESC bufDesc = getBufferDesc(size, bindFlags);
         D3D12_RESOURCE_STATES d3dState = getD3D12ResourceState(initState);
         ID3D12ResourcePtr pApiHandle;
         D3D12_HEAP_FLAGS heapFlags = is_set(bindFlags, ResourceBindFlags::Shared) ? D3D12_HEAP_FLAG_SHARED : D3D12_HEAP_FLAG_NONE;
@@ -156,6 +164,25 @@ namespace WIP3D
         return pApiHandle;
     }
 
+    /** Create a buffer in the device's placed resource heap.
+        \return The buffer, or nullptr if the heap can't hold it. data is set to the heap allocation on success.
+    */
+    ID3D12ResourcePtr createPlacedBuffer(Buffer::State initState, size_t size, Buffer::BindFlags bindFlags, PlacedResourceHeap::Allocation& data)
+    {
+        assert(gpDevice);
+        ID3D12Device* pDevice = gpDevice->getApiHandle();
+
+        D3D12_RESOURCE_DESC bufDesc = getBufferDesc(size, bindFlags);
+        D3D12_RESOURCE_ALLOCATION_INFO allocInfo = pDevice->GetResourceAllocationInfo(0, 1, &bufDesc);
+        data = gpDevice->getPlacedResourceHeap()->allocate(allocInfo.SizeInBytes, allocInfo.Alignment);
+        if (data.isValid() == false) return nullptr;
+
+        ID3D12ResourcePtr pApiHandle;
+        d3d_call(pDevice->CreatePlacedResource(data.pHeap, data.offset, &bufDesc, getD3D12ResourceState(initState), nullptr, IID_PPV_ARGS(&pApiHandle)));
+        assert(pApiHandle);
+        return pApiHandle;
+    }
+
     size_t getBufferDataAlignment(const Buffer* pBuffer)
     {
         // This in order of the alignment size
@@ -206,7 +233,13 @@ namespace WIP3D
         {
             mState.global = Resource::State::Common;
             if (is_set(mBindFlags, BindFlags::AccelerationStructure)) mState.global = Resource::State::AccelerationStructure;
-            mApiHandle = createBuffer(mState.global, mSize, kDefaultHeapProps, mBindFlags);
+
+            // Small buffers are sub-allocated from the placed resource heap. Shared resources need their own heap
+            if (mSize <= kMaxPlacedBufferSize && is_set(mBindFlags, BindFlags::Shared) == false)
+            {
+                mApiHandle = createPlacedBuffer(mState.global, mSize, mBindFlags, mPlacedData);
+            }
+            if (!mApiHandle) mApiHandle = createBuffer(mState.global, mSize, kDefaultHeapProps, mBindFlags);
         }
     }
 
@@ -264,6 +297,20 @@ namespace WIP3D
         }
     }
 
+    HeapHandle PlacedResourceHeap::createApiHeap(uint64_t size)
+    {
+        assert(gpDevice);
+        D3D12_HEAP_DESC desc = {};
+        desc.SizeInBytes = size;
+        desc.Properties = kDefaultHeapProps;
+        desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+        HeapHandle pHeap;
+        d3d_call(gpDevice->getApiHandle()->CreateHeap(&desc, IID_PPV_ARGS(&pHeap)));
+        return pHeap;
+    }
+
     void GpuMemoryHeap::initBasePageData(BaseData& data, size_t size)
     {
         data.pResourceHandle = createBuffer(getInitState(mType), size, getHeapProps(mType), Buffer::BindFlags::None);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Formats.h"
+#include "../DescriptorAllocator.h"
 //#include "../GraphicsResource.h"
 #include <string>
 #include <d3d12.h>
@@ -9,6 +10,9 @@
 #include <dxgiformat.h>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <set>
 
 
@@ -67,14 +71,17 @@ namespace WIP3D
 
 	MAKE_SMART_COM_PTR(ID3D12StateObject);
 	MAKE_SMART_COM_PTR(ID3D12Device);
+	MAKE_SMART_COM_PTR(ID3D12Device1);
 	MAKE_SMART_COM_PTR(ID3D12GraphicsCommandList);
 	MAKE_SMART_COM_PTR(ID3D12Debug);
 	MAKE_SMART_COM_PTR(ID3D12CommandQueue);
 	MAKE_SMART_COM_PTR(ID3D12CommandAllocator);
 	MAKE_SMART_COM_PTR(ID3D12DescriptorHeap);
 	MAKE_SMART_COM_PTR(ID3D12Resource);
+	MAKE_SMART_COM_PTR(ID3D12Heap);
 	MAKE_SMART_COM_PTR(ID3D12Fence);
 	MAKE_SMART_COM_PTR(ID3D12PipelineState);
+	MAKE_SMART_COM_PTR(ID3D12PipelineLibrary);
 	MAKE_SMART_COM_PTR(ID3D12RootSignature);
 	MAKE_SMART_COM_PTR(ID3D12QueryHeap);
 	MAKE_SMART_COM_PTR(ID3D12CommandSignature);
@@ -96,6 +103,7 @@ namespace WIP3D
 	using CommandSignatureHandle = ID3D12CommandSignaturePtr;
 	using FenceHandle = ID3D12FencePtr;
 	using ResourceHandle = ID3D12ResourcePtr;
+	using HeapHandle = ID3D12HeapPtr;
 	using RtvHandle = std::shared_ptr<DescriptorSet>;
 	using DsvHandle = std::shared_ptr<DescriptorSet>;
 	using SrvHandle = std::shared_ptr<DescriptorSet>;
@@ -136,8 +144,12 @@ namespace WIP3D
 		using CpuHandle = HeapCpuHandle;
 		using GpuHandle = HeapGpuHandle;
 
+		/** A contiguous range of descriptors, identified by its base index. The heap doesn't track ownership.
+		*/
+		using Allocation = DescriptorAllocator::Handle;
+		static const Allocation kInvalidAllocation = DescriptorAllocator::kInvalidHandle;
+
 		~D3D12DescriptorHeap();
-		static const uint32_t kDescPerChunk = 64;
 
 		/** Create a new descriptor heap.
 			\param[in] type Descriptor heap type.
@@ -150,94 +162,272 @@ namespace WIP3D
 		GpuHandle getBaseGpuHandle() const { return mGpuHeapStart; }
 		CpuHandle getBaseCpuHandle() const { return mCpuHeapStart; }
 
-	private:
-		struct Chunk;
+		/** Allocate a contiguous range of descriptors. Thread-safe.
+			\return The allocation, or kInvalidAllocation if the heap is exhausted.
+		*/
+		Allocation allocateDescriptors(uint32_t count);
 
-	public:
-		class Allocation
-		{
-		public:
-			using SharedPtr = std::shared_ptr<Allocation>;
-			~Allocation();
-
-			uint32_t getHeapEntryIndex(uint32_t index) const 
-			{ assert(index < mDescCount); return index + mBaseIndex; }
-			// Index is relative to the allocation
-			CpuHandle getCpuHandle(uint32_t index) const 
-			{ return mpHeap->getCpuHandle(getHeapEntryIndex(index)); } 
-			// Index is relative to the allocation
-			GpuHandle getGpuHandle(uint32_t index) const 
-			{ return mpHeap->getGpuHandle(getHeapEntryIndex(index)); } 
-
-		private:
-			friend D3D12DescriptorHeap;
-			static SharedPtr create(D3D12DescriptorHeap::SharedPtr pHeap, uint32_t baseIndex, uint32_t descCount, std::shared_ptr<Chunk> pChunk);
-			Allocation(D3D12DescriptorHeap::SharedPtr pHeap, uint32_t baseIndex, uint32_t descCount, std::shared_ptr<Chunk> pChunk);
-			D3D12DescriptorHeap::SharedPtr mpHeap;
-			uint32_t mBaseIndex;
-			uint32_t mDescCount;
-			std::shared_ptr<Chunk> mpChunk;
-		};
+		/** Return a range to the heap. It is reused immediately, so the caller must make sure the GPU is done with it. Thread-safe.
+		*/
+		void releaseDescriptors(Allocation allocation);
+
+		// Index is relative to the allocation
+		CpuHandle getCpuHandle(Allocation allocation, uint32_t index) const { return getCpuHandle(getHeapEntryIndex(allocation, index)); }
+		// Index is relative to the allocation
+		GpuHandle getGpuHandle(Allocation allocation, uint32_t index) const { return getGpuHandle(getHeapEntryIndex(allocation, index)); }
 
-		Allocation::SharedPtr allocateDescriptors(uint32_t count);
 		const ApiHandle& getApiHandle() const { return mApiHandle; }
 		D3D12_DESCRIPTOR_HEAP_TYPE getType() const { return mType; }
 
-		uint32_t getReservedChunkCount() const { return mMaxChunkCount; }
+		uint32_t getDescCount() const { return mpAllocator->getDescCount(); }
+		uint32_t getUsedDescCount() const { return mpAllocator->getUsedDescCount(); }
 		uint32_t getDescriptorSize() const { return mDescriptorSize; }
 
 	private:
-		friend Allocation;
-		D3D12DescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t chunkCount);
-
+		D3D12DescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descCount);
 
+		uint32_t getHeapEntryIndex(Allocation allocation, uint32_t index) const
+		{
+			assert(allocation != kInvalidAllocation && index < mpAllocator->getRangeSize(allocation));
+			return DescriptorAllocator::getBaseIndex(allocation) + index;
+		}
 		CpuHandle getCpuHandle(uint32_t index) const;
 		GpuHandle getGpuHandle(uint32_t index) const;
 
 		CpuHandle mCpuHeapStart = {};
 		GpuHandle mGpuHeapStart = {};
 		uint32_t mDescriptorSize;
-		const uint32_t mMaxChunkCount = 0;
-		uint32_t mAllocatedChunks = 0;
 		ApiHandle mApiHandle;
 		D3D12_DESCRIPTOR_HEAP_TYPE mType;
+		DescriptorAllocator::SharedPtr mpAllocator;
+	};
+
+	class GpuFence;
+
+	/** Frame-scoped linear allocator for descriptor tables in a shader-visible heap.
+		Reserves a range of the heap and hands out tables from it as a ring. Tables don't need to be released, they are reclaimed in bulk once the GPU passes the fence value they were allocated with.
+		Thread-safe, so contexts recording on worker threads can share the ring.
+	*/
+	class TransientDescriptorRing
+	{
+	public:
+		using SharedPtr = std::shared_ptr<TransientDescriptorRing>;
+		using SharedConstPtr = std::shared_ptr<const TransientDescriptorRing>;
+		using CpuHandle = HeapCpuHandle;
+		using GpuHandle = HeapGpuHandle;
 
-		struct Chunk
+		struct Table
 		{
-		public:
-			using SharedPtr = std::shared_ptr<Chunk>;
-			Chunk(uint32_t index, uint32_t count) : chunkIndex(index), chunkCount(count) {}
-
-			void reset() { allocCount = 0; currentDesc = 0; }
-			uint32_t getCurrentAbsoluteIndex() const { return chunkIndex * kDescPerChunk + currentDesc; }
-			uint32_t getRemainingDescs() const { return chunkCount * kDescPerChunk - currentDesc; }
-
-			uint32_t chunkIndex = 0;
-			uint32_t chunkCount = 1; // For outstanding requests we can allocate more then a single chunk. This is the number of chunks we actually allocated
-			uint32_t allocCount = 0;
-			uint32_t currentDesc = 0;
+			CpuHandle cpuHandle = {};
+			GpuHandle gpuHandle = {};
+			uint32_t descCount = 0;
 		};
 
-		// Helper to compare Chunk::SharedPtr types
-		struct ChunkComparator
+		~TransientDescriptorRing();
+
+		/** Create a new ring.
+			\param[in] pHeap Shader-visible heap to reserve the ring from.
+			\param[in] descCount Number of descriptors in the ring.
+			\param[in] pFence Fence to use for synchronization.
+			\return A new object, or throws an exception if creation failed.
+		*/
+		static SharedPtr create(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence);
+
+		/** Allocate a table. Throws an exception if the ring is full even after retiring the completed frames.
+		*/
+		Table allocateTable(uint32_t descCount);
+
+		/** Allocate a table and fill it from a contiguous range of CPU descriptors with a single copy.
+			\return The GPU handle of the table.
+		*/
+		GpuHandle copyTable(CpuHandle srcStart, uint32_t descCount);
+
+		/** Allocate a table and fill it from scattered CPU descriptors with a single CopyDescriptors() call.
+			\return The GPU handle of the table.
+		*/
+		GpuHandle copyTable(const CpuHandle* pSrcHandles, uint32_t descCount);
+
+		/** Reclaim the tables of the frames the GPU finished
+		*/
+		void executeDeferredReleases();
+
+		D3D12_DESCRIPTOR_HEAP_TYPE getType() const { return mpHeap->getType(); }
+		uint32_t getDescCount() const { return mDescCount; }
+		uint32_t getUsedDescCount() const;
+
+	private:
+		TransientDescriptorRing(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence);
+
+		struct Frame
 		{
-			bool operator()(const Chunk::SharedPtr& lhs, const Chunk::SharedPtr& rhs) const
-			{
-				return lhs->chunkCount < rhs->chunkCount;
-			}
-
-			bool operator()(const Chunk::SharedPtr& lhs, uint32_t rhs) const
-			{
-				return lhs->chunkCount < rhs;
-			};
+			uint64_t fenceValue;
+			uint32_t descCount;
 		};
 
-		bool setupCurrentChunk(uint32_t descCount);
-		void releaseChunk(Chunk::SharedPtr pChunk);
+		Table allocate(uint32_t descCount);
+		void retireFrames(uint64_t gpuVal);
+
+		mutable std::mutex mMutex;
+		D3D12DescriptorHeap::SharedPtr mpHeap;
+		D3D12DescriptorHeap::Allocation mAllocation;
+		std::shared_ptr<GpuFence> mpFence;
+		uint32_t mDescCount;
+		uint32_t mHead = 0;
+		uint32_t mUsed = 0;
+		std::deque<Frame> mFrames;
+		std::vector<UINT> mSrcRangeSizes;   // All ones, for CopyDescriptors()
+	};
 
-		Chunk::SharedPtr mpCurrentChunk;
-		std::vector<Chunk::SharedPtr> mFreeChunks; // Free list for standard sized chunks (1 chunk * kDescPerChunk)
-		std::multiset<Chunk::SharedPtr, ChunkComparator> mFreeLargeChunks; // Free list for large chunks with the capacity of multiple chunks (>1 chunk * kDescPerChunk)
+	/** Cache of persistent descriptor tables in a shader-visible heap, keyed by their content.
+		A table's content is identified by the layout hash of the set and the source descriptor sets (the views) bound to each slot. The entry keeps the sources alive, so their CPU descriptors can't be recycled into a different view while the table is cached.
+		Sets with the same content share a single table, so the descriptors are only copied once. Entries which weren't used for a number of frames are evicted once the GPU is done with them.
+		Thread-safe, so contexts recording on worker threads can share the cache.
+	*/
+	class DescriptorTableCache
+	{
+	public:
+		using SharedPtr = std::shared_ptr<DescriptorTableCache>;
+		using SharedConstPtr = std::shared_ptr<const DescriptorTableCache>;
+		using GpuHandle = HeapGpuHandle;
+
+		struct Stats
+		{
+			uint32_t entryCount = 0;
+			uint32_t cachedDescCount = 0;
+			uint64_t hitCount = 0;
+			uint64_t missCount = 0;
+			uint64_t evictionCount = 0;
+		};
+
+		~DescriptorTableCache();
+
+		/** Create a new cache.
+			\param[in] pHeap Shader-visible heap to allocate the tables from.
+			\param[in] pFence Fence to use for synchronization. Every signal is considered a frame.
+			\param[in] maxAge Number of frames an entry can go unused before it's evicted.
+			\return A new object, or throws an exception if creation failed.
+		*/
+		static SharedPtr create(const D3D12DescriptorHeap::SharedPtr& pHeap, const std::shared_ptr<GpuFence>& pFence, uint32_t maxAge = 16);
+
+		/** Find the table matching the content, or create it.
+			\param[in] layoutHash Hash of the set layout.
+			\param[in] contentHash Hash of the layout and the source sets, see hashContent().
+			\param[in] pSrcSets Source descriptor set for each slot. Every slot must be valid.
+			\param[in] descCount Number of slots.
+			\return The GPU handle of the table, or a null handle if the heap is exhausted.
+		*/
+		GpuHandle findOrCreate(uint64_t layoutHash, uint64_t contentHash, const std::shared_ptr<DescriptorSet>* pSrcSets, uint32_t descCount);
+
+		/** Evict the entries which weren't used for maxAge frames and which the GPU is done with
+		*/
+		void executeDeferredReleases();
+
+		/** Drop all the entries which the GPU is done with
+		*/
+		void clear();
+
+		static uint64_t hashContent(uint64_t layoutHash, const std::shared_ptr<DescriptorSet>* pSrcSets, uint32_t descCount);
+
+		Stats getStats() const;
+
+	private:
+		DescriptorTableCache(const D3D12DescriptorHeap::SharedPtr& pHeap, const std::shared_ptr<GpuFence>& pFence, uint32_t maxAge);
+
+		struct Entry
+		{
+			uint64_t layoutHash;
+			std::vector<std::shared_ptr<DescriptorSet>> pSrcSets;
+			D3D12DescriptorHeap::Allocation allocation;
+			uint64_t lastUsedFenceValue;
+		};
+
+		void evict(uint64_t maxFenceValue);
+
+		mutable std::mutex mMutex;
+
+		D3D12DescriptorHeap::SharedPtr mpHeap;
+		std::shared_ptr<GpuFence> mpFence;
+		uint32_t mMaxAge;
+		std::unordered_multimap<uint64_t, Entry> mEntries;  // Keyed by the content hash
+		uint32_t mCachedDescCount = 0;
+		uint64_t mHitCount = 0;
+		uint64_t mMissCount = 0;
+		uint64_t mEvictionCount = 0;
+		std::vector<D3D12DescriptorHeap::CpuHandle> mSrcHandles;
+		std::vector<UINT> mSrcRangeSizes;   // All ones, for CopyDescriptors()
+	};
+
+	class CopyContext;
+
+	/** A single large SRV/UAV table in a shader-visible heap, for bindless access.
+		Texture/buffer SRVs and UAVs get a slot when ResourceView::requestBindlessIndex() is called for them. The slot index is stable for the lifetime of the view and is what shaders use to index the table.
+		Released slots are recycled once the GPU passes the fence value of the release.
+		Shaders declare unbounded arrays in kSrvSpace and kUavSpace, both aliasing the start of the table. allocate() and release() are thread-safe.
+	*/
+	class BindlessDescriptorTable
+	{
+	public:
+		using SharedPtr = std::shared_ptr<BindlessDescriptorTable>;
+		using SharedConstPtr = std::shared_ptr<const BindlessDescriptorTable>;
+		using CpuHandle = HeapCpuHandle;
+		using GpuHandle = HeapGpuHandle;
+
+		static const uint32_t kInvalidIndex = 0xffffffff;
+		static const uint32_t kSrvSpace = 100;
+		static const uint32_t kUavSpace = 101;
+
+		~BindlessDescriptorTable();
+
+		/** Create a new table.
+			\param[in] pHeap Shader-visible CBV/SRV/UAV heap to reserve the table from.
+			\param[in] descCount Number of slots.
+			\param[in] pFence Fence to use for synchronization.
+			\return A new object, or throws an exception if creation failed.
+		*/
+		static SharedPtr create(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence);
+
+		/** Allocate a slot and copy a descriptor into it.
+			\return The slot index, or kInvalidIndex if the table is full.
+		*/
+		uint32_t allocate(CpuHandle srcHandle);
+
+		/** Release a slot. It is recycled once the GPU is done with the current frame.
+		*/
+		void release(uint32_t index);
+
+		/** Recycle the slots the GPU is done with
+		*/
+		void executeDeferredReleases();
+
+		/** Fill the descriptor ranges of the table's root parameter. Both ranges are unbounded and start at the beginning of the table.
+		*/
+		static void getDescriptorRanges(D3D12_DESCRIPTOR_RANGE1 ranges[2]);
+
+		void bindForGraphics(CopyContext* pCtx, uint32_t rootIndex) const;
+		void bindForCompute(CopyContext* pCtx, uint32_t rootIndex) const;
+
+		GpuHandle getGpuHandle() const { return mpHeap->getGpuHandle(mAllocation, 0); }
+		uint32_t getDescCount() const { return mDescCount; }
+		uint32_t getUsedDescCount() const;
+
+	private:
+		BindlessDescriptorTable(const D3D12DescriptorHeap::SharedPtr& pHeap, uint32_t descCount, const std::shared_ptr<GpuFence>& pFence);
+
+		struct DeferredRelease
+		{
+			uint32_t index;
+			uint64_t fenceValue;
+		};
+
+		D3D12DescriptorHeap::SharedPtr mpHeap;
+		D3D12DescriptorHeap::Allocation mAllocation;
+		std::shared_ptr<GpuFence> mpFence;
+		uint32_t mDescCount;
+
+		mutable std::mutex mMutex;
+		uint32_t mBumpIndex = 0;
+		std::vector<uint32_t> mFreeIndices;
+		std::deque<DeferredRelease> mDeferredReleases;
 	};
 
 	struct DescriptorPoolApiData
@@ -247,8 +437,16 @@ namespace WIP3D
 
 	struct DescriptorSetApiData
 	{
-		D3D12DescriptorHeap::Allocation::SharedPtr pAllocation; // The heap-allocation. We always allocate a single contiguous block, even if there are multiple ranges.
+		~DescriptorSetApiData() { if (pHeap && allocation != D3D12DescriptorHeap::kInvalidAllocation) pHeap->releaseDescriptors(allocation); }
+
+		D3D12DescriptorHeap* pHeap = nullptr;   // Owned by the pool, which outlives its descriptor sets
+		D3D12DescriptorHeap::Allocation allocation = D3D12DescriptorHeap::kInvalidAllocation; // The heap-allocation. We always allocate a single contiguous block, even if there are multiple ranges.
 		std::vector<uint32_t> rangeBaseOffset;                  // For each range, we store the base offset into the allocation. We need it because many set calls accept a range index.
+		uint32_t descCount = 0;                                 // Total number of descriptors in all ranges
+		uint64_t layoutHash = 0;
+		std::vector<std::shared_ptr<DescriptorSet>> pSrcSets;  // The view bound to each descriptor. Only tracked for sets in CPU-only pools, which are staged before binding
+		uint64_t contentHash = 0;                               // Hash of the layout and pSrcSets, used to look up the table cache
+		bool contentDirty = true;
 	};
 
 	inline DXGI_FORMAT getTypelessFormatFromDepthFormat(ResourceFormat format)
@@ -0,0 +1,133 @@
+#include <cassert>
+#include <stdexcept>
+#include "DescriptorAllocator.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        uint64_t makeHead(uint64_t prevHead, uint32_t index) { return (((prevHead >> 32) + 1) << 32) | index; }
+        uint32_t getHeadIndex(uint64_t head) { return (uint32_t)head; }
+    }
+
+    DescriptorAllocator::SharedPtr DescriptorAllocator::create(uint32_t descCount)
+    {
+        if (descCount == 0 || descCount > kMaxDescCount) throw std::invalid_argument("DescriptorAllocator::create() - invalid descriptor count");
+        return SharedPtr(new DescriptorAllocator(descCount));
+    }
+
+    DescriptorAllocator::DescriptorAllocator(uint32_t descCount)
+        : mDescCount(descCount)
+        , mCachedDescCount(0)
+        , mpAllocator(TLSFAllocator::create(descCount, descCount))
+        , mpNodes(new uint32_t[descCount])
+        , mpRangeSizes(new uint32_t[descCount])
+        , mpNext(new std::atomic<uint32_t>[descCount])
+    {
+        for (auto& list : mFreeLists) list.head.store(kInvalidHandle);
+    }
+
+    DescriptorAllocator::Handle DescriptorAllocator::popFreeList(uint32_t count)
+    {
+        std::atomic<uint64_t>& head = mFreeLists[count - 1].head;
+        uint64_t oldHead = head.load(std::memory_order_acquire);
+        while (getHeadIndex(oldHead) != kInvalidHandle)
+        {
+            // The range can be popped by another thread before the exchange, then the tag won't match and the link we read is discarded
+            uint32_t next = mpNext[getHeadIndex(oldHead)].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(oldHead, makeHead(oldHead, next), std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return getHeadIndex(oldHead);
+            }
+        }
+        return kInvalidHandle;
+    }
+
+    void DescriptorAllocator::pushFreeList(Handle handle, uint32_t count)
+    {
+        std::atomic<uint64_t>& head = mFreeLists[count - 1].head;
+        uint64_t oldHead = head.load(std::memory_order_relaxed);
+        do
+        {
+            mpNext[handle].store(getHeadIndex(oldHead), std::memory_order_relaxed);
+        } while (head.compare_exchange_weak(oldHead, makeHead(oldHead, handle), std::memory_order_release, std::memory_order_relaxed) == false);
+    }
+
+    void DescriptorAllocator::drainFreeLists()
+    {
+        // Called with the lock held. Detach every list and return its ranges to the TLSF allocator, so they can merge with their neighbors
+        for (uint32_t i = 0; i < kCachedRangeSize; i++)
+        {
+            std::atomic<uint64_t>& head = mFreeLists[i].head;
+            uint64_t oldHead = head.load(std::memory_order_acquire);
+            while (head.compare_exchange_weak(oldHead, makeHead(oldHead, kInvalidHandle), std::memory_order_acquire, std::memory_order_acquire) == false) {}
+
+            for (uint32_t index = getHeadIndex(oldHead); index != kInvalidHandle; )
+            {
+                uint32_t next = mpNext[index].load(std::memory_order_relaxed);
+                TLSFAllocator::Allocation allocation;
+                allocation.offset = index;
+                allocation.node = mpNodes[index];
+                mpAllocator->release(allocation);
+                mCachedDescCount.fetch_sub(i + 1, std::memory_order_relaxed);
+                index = next;
+            }
+        }
+    }
+
+    DescriptorAllocator::Handle DescriptorAllocator::allocate(uint32_t count)
+    {
+        assert(count > 0);
+        if (count <= kCachedRangeSize)
+        {
+            Handle handle = popFreeList(count);
+            if (handle != kInvalidHandle)
+            {
+                mCachedDescCount.fetch_sub(count, std::memory_order_relaxed);
+                return handle;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        TLSFAllocator::Allocation allocation = mpAllocator->allocate(count);
+        if (allocation.isValid() == false && mCachedDescCount.load(std::memory_order_relaxed))
+        {
+            drainFreeLists();
+            allocation = mpAllocator->allocate(count);
+        }
+        if (allocation.isValid() == false) return kInvalidHandle;
+
+        Handle handle = (Handle)allocation.offset;
+        mpNodes[handle] = allocation.node;
+        mpRangeSizes[handle] = count;
+        return handle;
+    }
+
+    void DescriptorAllocator::release(Handle handle)
+    {
+        assert(handle < mDescCount);
+        uint32_t count = mpRangeSizes[handle];
+        if (count <= kCachedRangeSize)
+        {
+            // Count the range before publishing it, so the count never drops below the cached entries
+            mCachedDescCount.fetch_add(count, std::memory_order_relaxed);
+            pushFreeList(handle, count);
+            return;
+        }
+
+        TLSFAllocator::Allocation allocation;
+        allocation.offset = handle;
+        std::lock_guard<std::mutex> lock(mMutex);
+        allocation.node = mpNodes[handle];
+        assert(mpAllocator->getAllocationSize(allocation) == count);
+        mpAllocator->release(allocation);
+    }
+
+    uint32_t DescriptorAllocator::getUsedDescCount() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        uint32_t usedCount = (uint32_t)mpAllocator->getStats().usedSize;
+        uint32_t cachedCount = getCachedDescCount();
+        return (usedCount > cachedCount) ? usedCount - cachedCount : 0;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "TLSFAllocator.h"
+
+namespace WIP3D
+{
+    /** Allocator for ranges of descriptor-heap entries.
+        Ranges have the exact size that was requested. They are managed by a TLSFAllocator, which splits free blocks on allocation and merges adjacent free blocks on release, so a heap doesn't stay fragmented once its ranges are released.
+        The TLSF allocator is serialized by a lock. Ranges of up to kCachedRangeSize entries, which is what descriptor sets and tables use, are recycled through lock-free free lists, one per size, so threads recording in parallel don't contend on the lock in the steady state.
+        Cached ranges aren't merged with their neighbors. They are returned to the TLSF allocator when an allocation would fail otherwise.
+        allocate() and release() can be called concurrently from any thread.
+        The allocator only hands out indices and has no graphics API dependencies. The heap that owns it is responsible for deferring releases until the GPU is done with the descriptors.
+    */
+    class DescriptorAllocator
+    {
+    public:
+        using SharedPtr = std::shared_ptr<DescriptorAllocator>;
+        using SharedConstPtr = std::shared_ptr<const DescriptorAllocator>;
+
+        /** A handle to an allocated range, which is the base index of the range. The allocator keeps the size, see getRangeSize().
+        */
+        using Handle = uint32_t;
+        static const Handle kInvalidHandle = 0xffffffff;
+
+        static const uint32_t kMaxDescCount = 1u << 27;
+
+        /** Ranges up to this size are recycled through the lock-free free lists
+        */
+        static const uint32_t kCachedRangeSize = 64;
+
+        /** Create a new allocator.
+            \param[in] descCount Number of entries to manage. Can't be larger than kMaxDescCount.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint32_t descCount);
+
+        /** Allocate a range of count entries.
+            \return A handle to the range, or kInvalidHandle if there is no free range large enough.
+        */
+        Handle allocate(uint32_t count);
+
+        /** Return a range to the allocator. It can be reused immediately.
+        */
+        void release(Handle handle);
+
+        static uint32_t getBaseIndex(Handle handle) { return handle; }
+
+        /** Get the size of a live range
+        */
+        uint32_t getRangeSize(Handle handle) const { return mpRangeSizes[handle]; }
+
+        uint32_t getDescCount() const { return mDescCount; }
+
+        /** Get the number of entries in live ranges
+        */
+        uint32_t getUsedDescCount() const;
+
+        /** Get the number of entries held by the free lists
+        */
+        uint32_t getCachedDescCount() const { return mCachedDescCount.load(std::memory_order_relaxed); }
+
+    private:
+        DescriptorAllocator(uint32_t descCount);
+
+        // Tagged list head, the tag is in the high 32 bits and the base index of the first range in the low 32 bits. The tag changes on every update, so a stale head can't be swapped in (ABA)
+        struct FreeList
+        {
+            std::atomic<uint64_t> head;
+            uint8_t padding[64 - sizeof(std::atomic<uint64_t>)];    // Keep each list on its own cache line
+        };
+
+        Handle popFreeList(uint32_t count);
+        void pushFreeList(Handle handle, uint32_t count);
+        void drainFreeLists();
+
+        uint32_t mDescCount;
+        std::atomic<uint32_t> mCachedDescCount;
+        FreeList mFreeLists[kCachedRangeSize];
+
+        mutable std::mutex mMutex;
+        TLSFAllocator::SharedPtr mpAllocator;
+
+        // Indexed by the range's base index
+        std::unique_ptr<uint32_t[]> mpNodes;                // TLSF node of each live range
+        std::unique_ptr<uint32_t[]> mpRangeSizes;
+        std::unique_ptr<std::atomic<uint32_t>[]> mpNext;    // Free-list link of each cached range
+    };
+}
@@ -52,12 +52,33 @@ namespace WIP3D
         poolDesc.setShaderVisible(false).setDescCount(DescriptorPool::Type::Rtv, 16 * 1024).setDescCount(DescriptorPool::Type::Dsv, 1024);
         mpCpuDescPool = DescriptorPool::create(poolDesc, mpFrameFence);
 
+        // The bindless table takes a quarter of the SRV/UAV heap
+        mpBindlessTable = BindlessDescriptorTable::create(mpGpuDescPool->getApiData()->pHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV], 256 * 1024, mpFrameFence);
+
+        // Reserve a quarter of every shader-visible heap, up to 64K descriptors, for per-frame descriptor tables
+        for (uint32_t i = 0; i < ARRAY_COUNT(mpTransientDescRings); i++)
+        {
+            const auto& pHeap = mpGpuDescPool->getApiData()->pHeaps[i];
+            if (pHeap == nullptr) continue;
+            uint32_t ringSize = 1;
+            while (ringSize * 2 <= std::min(pHeap->getDescCount() / 4, 64u * 1024)) ringSize *= 2;
+            mpTransientDescRings[i] = TransientDescriptorRing::create(pHeap, ringSize, mpFrameFence);
+            mpDescTableCaches[i] = DescriptorTableCache::create(pHeap, mpFrameFence);
+        }
+
         mpUploadHeap = GpuMemoryHeap::create(GpuMemoryHeap::Type::Upload, 1024 * 1024 * 2, mpFrameFence);
+        mpPlacedHeap = PlacedResourceHeap::create(1024 * 1024 * 64, mpFrameFence);
+        mpMemoryTelemetry = MemoryTelemetry::create();
         createNullViews();
         mpRenderContext = RenderContext::create(mCmdQueues[(uint32_t)LowLevelContextData::CommandQueueType::Direct][0]);
 
         assert(mpRenderContext);
         mpRenderContext->flush();  // This will bind the descriptor heaps.
+
+        const auto& copyQueues = mCmdQueues[(uint32_t)LowLevelContextData::CommandQueueType::Copy];
+        if (copyQueues.size()) mpUploadStreamer = UploadStreamer::create(copyQueues[0]);
+        mpProfiler = Profiler::create();
+        mpPipelineStateCache = PipelineStateCache::create(mDesc.pipelineCacheFile, mDesc.pipelineCompileThreadCount);
         // TODO: Do we need to flush here or should RenderContext::create() bind the descriptor heaps automatically without flush? See #749.
 
         // Update the FBOs
@@ -143,8 +164,48 @@ namespace WIP3D
         {
             mDeferredReleases.pop();
         }
+        mpPlacedHeap->executeDeferredReleases();
         mpCpuDescPool->executeDeferredReleases();
         mpGpuDescPool->executeDeferredReleases();
+        for (auto& pRing : mpTransientDescRings)
+        {
+            if (pRing) pRing->executeDeferredReleases();
+        }
+        for (auto& pCache : mpDescTableCaches)
+        {
+            if (pCache) pCache->executeDeferredReleases();
+        }
+        mpBindlessTable->executeDeferredReleases();
+    }
+
+    MemoryStats Device::getMemoryStats() const
+    {
+        MemoryStats stats;
+        stats.frameID = mFrameID;
+        stats.uploadHeap = mpUploadHeap->getStats();
+        stats.placedHeap = mpPlacedHeap->getStats();
+        stats.cpuDescriptorPool = mpCpuDescPool->getStats();
+        stats.gpuDescriptorPool = mpGpuDescPool->getStats();
+        stats.deferredResourceReleaseCount = (uint32_t)mDeferredReleases.size();
+        for (const auto& pRing : mpTransientDescRings)
+        {
+            if (pRing == nullptr) continue;
+            stats.transientDescCount += pRing->getDescCount();
+            stats.transientUsedDescCount += pRing->getUsedDescCount();
+        }
+        for (const auto& pCache : mpDescTableCaches)
+        {
+            if (pCache == nullptr) continue;
+            DescriptorTableCache::Stats cacheStats = pCache->getStats();
+            stats.descTableCache.entryCount += cacheStats.entryCount;
+            stats.descTableCache.cachedDescCount += cacheStats.cachedDescCount;
+            stats.descTableCache.hitCount += cacheStats.hitCount;
+            stats.descTableCache.missCount += cacheStats.missCount;
+            stats.descTableCache.evictionCount += cacheStats.evictionCount;
+        }
+        stats.bindlessDescCount = mpBindlessTable->getDescCount();
+        stats.bindlessUsedDescCount = mpBindlessTable->getUsedDescCount();
+        return stats;
     }
 
     void Device::toggleVSync(bool enable)
@@ -156,6 +217,9 @@ namespace WIP3D
     {
         toggleFullScreen(false);
         mpRenderContext->flush(true);
+        mpUploadStreamer.reset();   // Waits for the pending jobs
+        mpProfiler.reset();
+        mpPipelineStateCache.reset();   // Writes the PSOs created since the last save
         // Release all the bound resources. Need to do that before deleting the RenderContext
         for (uint32_t i = 0; i < ARRAY_COUNT(mCmdQueues); i++) mCmdQueues[i].clear();
         for (uint32_t i = 0; i < kSwapChainBuffersCount; i++) mpSwapChainFbos[i].reset();
@@ -163,6 +227,10 @@ namespace WIP3D
         releaseNullViews();
         mpRenderContext.reset();
         mpUploadHeap.reset();
+        mpPlacedHeap.reset();
+        for (auto& pRing : mpTransientDescRings) pRing.reset();
+        for (auto& pCache : mpDescTableCaches) pCache.reset();
+        mpBindlessTable.reset();
         mpCpuDescPool.reset();
         mpGpuDescPool.reset();
         mpFrameFence.reset();
@@ -175,11 +243,20 @@ namespace WIP3D
     void Device::present()
     {
         mpRenderContext->resourceBarrier(mpSwapChainFbos[mCurrentBackBufferIndex]->getColorTexture(0).get(), Resource::State::Present);
+        mpProfiler->endFrame(mpRenderContext.get());
         mpRenderContext->flush();
+        mpRenderContext->endStateFilterFrame();
         apiPresent();
         mpFrameFence->gpuSignal(mpRenderContext->getLowLevelData()->getCommandQueue());
         if (mpFrameFence->getCpuValue() >= kSwapChainBuffersCount) mpFrameFence->syncCpu(mpFrameFence->getCpuValue() - kSwapChainBuffersCount);
         executeDeferredReleases();
+        if (mpUploadStreamer)
+        {
+            mpUploadStreamer->submit();
+            mpUploadStreamer->executeCallbacks();
+        }
+        mpMemoryTelemetry->record(getMemoryStats());
+        if (mFrameID && (mFrameID % kPipelineCacheSaveInterval) == 0) mpPipelineStateCache->saveAsync();
         mFrameID++;
     }
 
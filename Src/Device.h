@@ -6,6 +6,10 @@
 #include "GraphicsContext.h"
 #include "RenderTarget.h"
 #include "Application.h"
+#include "MemoryTelemetry.h"
+#include "PipelineStateCache.h"
+#include "Profiler.h"
+#include "UploadStreamer.h"
 namespace WIP3D
 {
 #ifdef _DEBUG
@@ -36,9 +40,12 @@ namespace WIP3D
 
             static_assert((uint32_t)LowLevelContextData::CommandQueueType::Direct == 2, "Default initialization of cmdQueues assumes that Direct queue index is 2");
             //ָҪcommand queue͵ֱӦcopycomputegraphics
-            //˴Ĭֻһgraphics queue
-            ///< Command queues to create. If no direct-queues are created, mpRenderContext will not be initialized
-            std::array<uint32_t, kQueueTypeCount> cmdQueues = { 0, 0, 1 };  
+            //˴Ĭϴһcopy queueһgraphics queue
+            ///< Command queues to create. If no direct-queues are created, mpRenderContext will not be initialized. The first copy queue is used by the upload streamer, which also uploads the initial data of textures created without mip generation.
+            std::array<uint32_t, kQueueTypeCount> cmdQueues = { 1, 0, 1 };  
+
+            std::string pipelineCacheFile = "PipelineCache.bin";            ///< Pipeline library file used by the PSO cache. If empty, PSOs are only cached in memory.
+            uint32_t pipelineCompileThreadCount = 2;                        ///< Threads compiling PSOs in the background. If 0, PSOs are compiled on first use.
 
             // GUID list for experimental features
             std::vector<UUID> experimentalFeatures;
@@ -128,15 +135,52 @@ namespace WIP3D
         const DescriptorPool::SharedPtr& getCpuDescriptorPool() const { return mpCpuDescPool; }
         const DescriptorPool::SharedPtr& getGpuDescriptorPool() const { return mpGpuDescPool; }
         const GpuMemoryHeap::SharedPtr& getUploadHeap() const { return mpUploadHeap; }
+        const PlacedResourceHeap::SharedPtr& getPlacedResourceHeap() const { return mpPlacedHeap; }
+
+        /** Get the per-frame descriptor ring of a shader-visible heap. Tables allocated from it are valid until the frame fence passes.
+            \return The ring, or nullptr if the GPU pool has no heap of this type.
+        */
+        const TransientDescriptorRing::SharedPtr& getTransientDescriptorRing(D3D12_DESCRIPTOR_HEAP_TYPE type) const { return mpTransientDescRings[type]; }
+
+        /** Get the content-hashed table cache of a shader-visible heap. Staging descriptor sets with identical content share a table from it.
+            \return The cache, or nullptr if the GPU pool has no heap of this type.
+        */
+        const DescriptorTableCache::SharedPtr& getDescriptorTableCache(D3D12_DESCRIPTOR_HEAP_TYPE type) const { return mpDescTableCaches[type]; }
+
+        /** Get the bindless SRV/UAV table. Texture and buffer views get a slot in it when they are created.
+        */
+        const BindlessDescriptorTable::SharedPtr& getBindlessTable() const { return mpBindlessTable; }
         void releaseResource(ApiObjectHandle pResource);
         double getGpuTimestampFrequency() const { return mGpuTimestampFrequency; } // ms/tick
 
+        /** Get a snapshot of the current GPU memory usage
+        */
+        MemoryStats getMemoryStats() const;
+
+        /** Get the memory telemetry. A snapshot is recorded at the end of every present()
+        */
+        const MemoryTelemetry::SharedPtr& getMemoryTelemetry() const { return mpMemoryTelemetry; }
+
+        /** Get the upload streamer. It submits to the first copy queue, and is nullptr if no copy queue was created.
+            The device submits its pending jobs and executes the completion callbacks at the end of every present()
+        */
+        const UploadStreamer::SharedPtr& getUploadStreamer() const { return mpUploadStreamer; }
+
+        /** Get the profiler. Events recorded into the default render-context are resolved a few frames after present(), see PROFILE()
+        */
+        const Profiler::SharedPtr& getProfiler() const { return mpProfiler; }
+
+        /** Get the PSO cache. present() writes new PSOs to Desc::pipelineCacheFile every kPipelineCacheSaveInterval frames, on a compile thread, and cleanup() writes the rest
+        */
+        const PipelineStateCache::SharedPtr& getPipelineStateCache() const { return mpPipelineStateCache; }
+
         /** Check if features are supported by the device
         */
         bool isFeatureSupported(SupportedFeatures flags) const;
 
     private:
         static constexpr uint32_t kSwapChainBuffersCount = 3;
+        static constexpr uint32_t kPipelineCacheSaveInterval = 600;
         struct ResourceRelease
         {
             size_t frameID;
@@ -156,8 +200,16 @@ namespace WIP3D
         Desc mDesc;
         ApiHandle mApiHandle;
         GpuMemoryHeap::SharedPtr mpUploadHeap;
+        PlacedResourceHeap::SharedPtr mpPlacedHeap;
+        MemoryTelemetry::SharedPtr mpMemoryTelemetry;
+        UploadStreamer::SharedPtr mpUploadStreamer;
+        Profiler::SharedPtr mpProfiler;
+        PipelineStateCache::SharedPtr mpPipelineStateCache;
         DescriptorPool::SharedPtr mpCpuDescPool;
         DescriptorPool::SharedPtr mpGpuDescPool;
+        TransientDescriptorRing::SharedPtr mpTransientDescRings[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+        DescriptorTableCache::SharedPtr mpDescTableCaches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+        BindlessDescriptorTable::SharedPtr mpBindlessTable;
         bool mIsWindowOccluded = false;
         GpuFence::SharedPtr mpFrameFence;
 
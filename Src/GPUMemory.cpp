@@ -1,22 +1,51 @@
+#include <algorithm>
 #include "Common.h"
+#include "CommandCapture.h"
 #include "GPUMemory.h"
 
 namespace WIP3D
 {
-	GpuMemoryHeap::SharedPtr GpuMemoryHeap::create(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence)
+	namespace
 	{
-		return SharedPtr(new GpuMemoryHeap(type, pageSize, pFence));
+		/** Get the power-of-two size class of a mega-page request
+		*/
+		uint32_t getMegaPageBucket(size_t size)
+		{
+			uint32_t bucket = 0;
+			while (((size_t)1 << bucket) < size) bucket++;
+			return bucket;
+		}
+	}
+
+	GpuMemoryHeap::SharedPtr GpuMemoryHeap::create(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence, Mode mode)
+	{
+		return SharedPtr(new GpuMemoryHeap(type, pageSize, pFence, mode));
 	}
 	GpuMemoryHeap::~GpuMemoryHeap()
 	{
 		mDeferredReleases = decltype(mDeferredReleases)();
+
+		auto deleteList = [](SharedPage* pPage)
+		{
+			while (pPage)
+			{
+				SharedPage* pNext = pPage->pNext;
+				delete pPage;
+				pPage = pNext;
+			}
+		};
+		deleteList(mFreeSharedPages.takeAll());
+		deleteList(mRetiredSharedPages.takeAll());
+		for (SharedPage* pPage : mPendingSharedPages) delete pPage;
 	}
-	GpuMemoryHeap::GpuMemoryHeap(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence)
+	GpuMemoryHeap::GpuMemoryHeap(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence, Mode mode)
 		: mType(type)
+		, mMode(mode)
 		, mPageSize(pageSize)
 		, mpFence(pFence)
 	{
 		allocateNewPage();
+		if (mMode == Mode::Ring) mpRing = RingAllocator::create(mPageSize);
 	}
     void GpuMemoryHeap::allocateNewPage()
     {
@@ -42,13 +71,43 @@ namespace WIP3D
         mCurrentPageId++;
     }
 
+    bool GpuMemoryHeap::allocateFromRing(size_t size, size_t alignment, Allocation& data)
+    {
+        uint64_t fenceValue = mpFence->getCpuValue();
+        uint64_t offset = mpRing->allocate(size, alignment, fenceValue);
+        if (offset == RingAllocator::kInvalidOffset)
+        {
+            // Only read the GPU fence when the ring is full
+            mpRing->retire(mpFence->getGpuValue());
+            offset = mpRing->allocate(size, alignment, fenceValue);
+            if (offset == RingAllocator::kInvalidOffset) return false;
+        }
+
+        data.pageID = Allocation::kRingPageId;
+        data.offset = offset;
+        data.pData = mpActivePage->pData + offset;
+        data.pResourceHandle = mpActivePage->pResourceHandle;
+        return true;
+    }
+
     GpuMemoryHeap::Allocation GpuMemoryHeap::allocate(size_t size, size_t alignment)
     {
+        CAPTURE_COMMAND(HeapAllocate, this, size, alignment);
         Allocation data;
-        if (size > mPageSize)
+        data.size = size;
+        if (mMode == Mode::Ring)
+        {
+            if (allocateFromRing(size, alignment, data) == false)
+            {
+                // The ring is full. Use a dedicated buffer and retire it together with the current frame
+                allocateMegaPage(data, size);
+                data.fenceValue = mpFence->getCpuValue();
+                mDeferredReleases.push(data);
+            }
+        }
+        else if (size > mPageSize)
         {
-            data.pageID = GpuMemoryHeap::Allocation::kMegaPageId;
-            initBasePageData(data, size);
+            allocateMegaPage(data, size);
         }
         else
         {
@@ -69,21 +128,33 @@ namespace WIP3D
         }
 
         data.fenceValue = mpFence->getCpuValue();
+        mTotalAllocationCount++;
+        mTotalAllocatedSize += size;
+        if (data.pageID != Allocation::kRingPageId) mLiveSize += size;
         return data;
     }
 
     void GpuMemoryHeap::release(Allocation& data)
     {
+        CAPTURE_COMMAND(HeapRelease, this, data.size);
         assert(data.pResourceHandle);
+        // Ring and thread allocations are reclaimed in bulk by executeDeferredReleases()
+        if (mMode == Mode::Ring || data.pageID == Allocation::kThreadPageId) return;
         mDeferredReleases.push(data);
     }
 
     void GpuMemoryHeap::executeDeferredReleases()
     {
         uint64_t gpuVal = mpFence->getGpuValue();
+        if (mMode == Mode::Ring)
+        {
+            mpRing->retire(gpuVal);
+        }
+        recycleSharedPages(gpuVal);
         while (mDeferredReleases.size() && mDeferredReleases.top().fenceValue <= gpuVal)
         {
             const Allocation& data = mDeferredReleases.top();
+            mLiveSize -= data.size;
             if (data.pageID == mCurrentPageId)
             {
                 mpActivePage->allocationsCount--;
@@ -104,9 +175,338 @@ namespace WIP3D
                         mUsedPages.erase(data.pageID);
                     }
                 }
-                // else it's a mega-page. Popping it will release the resource
+                else
+                {
+                    releaseMegaPage(data);
+                }
+            }
+            mDeferredReleases.pop();
+        }
+    }
+
+    GpuMemoryHeap::Stats GpuMemoryHeap::getStats() const
+    {
+        Stats stats;
+        stats.pageSize = mPageSize;
+        stats.ringUsedSize = mpRing ? (size_t)mpRing->getUsedSize() : 0;
+        stats.liveSize = mLiveSize + stats.ringUsedSize;
+        stats.usedPageCount = (uint32_t)mUsedPages.size() + (mpActivePage ? 1 : 0);
+        stats.availablePageCount = (uint32_t)mAvailablePages.size();
+        stats.deferredReleaseCount = (uint32_t)mDeferredReleases.size();
+        stats.totalAllocationCount = mTotalAllocationCount;
+        stats.totalAllocatedSize = mTotalAllocatedSize;
+        stats.sharedPageCount = mSharedPageCount;
+
+        std::lock_guard<std::mutex> lock(mMegaPageMutex);
+        stats.megaPageCount = mMegaPageCount;
+        stats.cachedMegaPageCount = (uint32_t)mMegaPageCache.size();
+        stats.cachedMegaPageSize = mMegaPageCacheSize;
+        return stats;
+    }
+
+    GpuMemoryHeap::ThreadAllocator::UniquePtr GpuMemoryHeap::createThreadAllocator()
+    {
+        if (mMode != Mode::Paged) throw std::exception("GpuMemoryHeap::createThreadAllocator() is only supported for paged heaps");
+        return ThreadAllocator::UniquePtr(new ThreadAllocator(shared_from_this()));
+    }
+
+    GpuMemoryHeap::SharedPage* GpuMemoryHeap::createSharedPage(size_t size)
+    {
+        SharedPage* pPage = new SharedPage;
+        mSharedPageCount++;
+        pPage->size = size;
+        initBasePageData(*pPage, size);
+        return pPage;
+    }
+
+    GpuMemoryHeap::SharedPage* GpuMemoryHeap::createSharedMegaPage(size_t size)
+    {
+        Allocation data;
+        allocateMegaPage(data, size);
+        SharedPage* pPage = new SharedPage;
+        static_cast<BaseData&>(*pPage) = data;
+        pPage->size = data.megaPageSize;
+        return pPage;
+    }
+
+    GpuMemoryHeap::SharedPage* GpuMemoryHeap::leaseSharedPage()
+    {
+        // A thread racing with another lease can see an empty stack, it creates a new page then
+        SharedPage* pPage = mFreeSharedPages.pop();
+        if (pPage == nullptr) return createSharedPage(mPageSize);
+        mFreeSharedPageCount--;
+        pPage->currentOffset = 0;
+        return pPage;
+    }
+
+    void GpuMemoryHeap::retireSharedPage(SharedPage* pPage)
+    {
+        mRetiredSharedPages.push(pPage);
+    }
+
+    void GpuMemoryHeap::recycleSharedPages(uint64_t gpuVal)
+    {
+        SharedPage* pRetired = mRetiredSharedPages.takeAll();
+        while (pRetired)
+        {
+            SharedPage* pNext = pRetired->pNext;
+            mPendingSharedPages.push_back(pRetired);
+            pRetired = pNext;
+        }
+
+        for (size_t i = 0; i < mPendingSharedPages.size();)
+        {
+            SharedPage* pPage = mPendingSharedPages[i];
+            if (pPage->fenceValue > gpuVal)
+            {
+                i++;
+                continue;
+            }
+
+            mPendingSharedPages[i] = mPendingSharedPages.back();
+            mPendingSharedPages.pop_back();
+            if (pPage->size != mPageSize)
+            {
+                // Mega-page of a large allocation
+                Allocation data;
+                static_cast<BaseData&>(data) = *pPage;
+                data.megaPageSize = pPage->size;
+                releaseMegaPage(data);
+                delete pPage;
+            }
+            else if ((mFreeSharedPageCount + 1) * mPageSize <= mSharedPageCacheBudget)
+            {
+                mFreeSharedPageCount++;
+                mFreeSharedPages.push(pPage);
+            }
+            else
+            {
+                delete pPage;
+                mSharedPageCount--;
+            }
+        }
+
+        // The budget may have been lowered. Racing leases see an empty stack while it's trimmed, same as in leaseSharedPage()
+        if (mFreeSharedPageCount * mPageSize > mSharedPageCacheBudget)
+        {
+            SharedPage* pFree = mFreeSharedPages.takeAll();
+            SharedPage* pKeepFirst = nullptr;
+            SharedPage* pKeepLast = nullptr;
+            size_t keptSize = 0;
+            mFreeSharedPageCount = 0;
+            while (pFree)
+            {
+                SharedPage* pNext = pFree->pNext;
+                if (keptSize + mPageSize <= mSharedPageCacheBudget)
+                {
+                    pFree->pNext = pKeepFirst;
+                    pKeepFirst = pFree;
+                    if (pKeepLast == nullptr) pKeepLast = pFree;
+                    keptSize += mPageSize;
+                    mFreeSharedPageCount++;
+                }
+                else
+                {
+                    delete pFree;
+                    mSharedPageCount--;
+                }
+                pFree = pNext;
+            }
+            if (pKeepFirst) mFreeSharedPages.push(pKeepFirst, pKeepLast);
+        }
+    }
+
+    GpuMemoryHeap::ThreadAllocator::~ThreadAllocator()
+    {
+        flush();
+    }
+
+    void GpuMemoryHeap::ThreadAllocator::flush()
+    {
+        if (mpPage)
+        {
+            mpHeap->retireSharedPage(mpPage);
+            mpPage = nullptr;
+        }
+    }
+
+    GpuMemoryHeap::Allocation GpuMemoryHeap::ThreadAllocator::allocate(size_t size, size_t alignment)
+    {
+        Allocation data;
+        data.pageID = Allocation::kThreadPageId;
+        data.fenceValue = mpHeap->mpFence->getCpuValue();
+
+        if (size > mpHeap->mPageSize)
+        {
+            // Mega-page from the heap's cache, retired right away together with the current frame
+            SharedPage* pPage = mpHeap->createSharedMegaPage(size);
+            pPage->fenceValue = data.fenceValue;
+            data.pResourceHandle = pPage->pResourceHandle;
+            data.pData = pPage->pData;
+            data.offset = 0;
+            mpHeap->retireSharedPage(pPage);
+            return data;
+        }
+
+        size_t offset = mpPage ? align_to(alignment, mpPage->currentOffset) : 0;
+        if (mpPage == nullptr || offset + size > mpHeap->mPageSize)
+        {
+            flush();
+            mpPage = mpHeap->leaseSharedPage();
+            offset = 0;
+        }
+
+        data.pResourceHandle = mpPage->pResourceHandle;
+        data.pData = mpPage->pData + offset;
+        data.offset = offset;
+        mpPage->currentOffset = offset + size;
+        mpPage->fenceValue = data.fenceValue;
+        return data;
+    }
+
+    void GpuMemoryHeap::allocateMegaPage(Allocation& data, size_t size)
+    {
+        uint32_t bucket = getMegaPageBucket(size);
+        data.pageID = Allocation::kMegaPageId;
+        std::lock_guard<std::mutex> lock(mMegaPageMutex);
+        mMegaPageCount++;
+
+        // Rounding up only pays off if the page can be cached, see releaseMegaPage()
+        if (((size_t)1 << bucket) > mMegaPageCacheBudget)
+        {
+            data.megaPageSize = size;
+            initBasePageData(data, data.megaPageSize);
+            return;
+        }
+
+        data.megaPageSize = (size_t)1 << bucket;
+        auto& freePages = mMegaPageBuckets[bucket];
+        if (freePages.size())
+        {
+            // Reuse the most recently released page of this size class
+            MegaPageList::iterator it = freePages.back();
+            freePages.pop_back();
+            static_cast<BaseData&>(data) = *it;
+            mMegaPageCacheSize -= it->size;
+            mMegaPageCache.erase(it);
+        }
+        else
+        {
+            initBasePageData(data, data.megaPageSize);
+        }
+    }
+
+    void GpuMemoryHeap::releaseMegaPage(const Allocation& data)
+    {
+        std::lock_guard<std::mutex> lock(mMegaPageMutex);
+        mMegaPageCount--;
+
+        // Exact-size pages are smaller than their bucket's size class, so they can't be reused
+        bool isSizeClass = (data.megaPageSize & (data.megaPageSize - 1)) == 0;
+        if (isSizeClass == false || data.megaPageSize > mMegaPageCacheBudget) return;
+
+        MegaPage page;
+        static_cast<BaseData&>(page) = data;
+        page.offset = 0;
+        page.size = data.megaPageSize;
+        mMegaPageCache.push_back(page);
+        mMegaPageBuckets[getMegaPageBucket(page.size)].push_back(std::prev(mMegaPageCache.end()));
+        mMegaPageCacheSize += page.size;
+        trimMegaPageCache(mMegaPageCacheBudget);
+    }
+
+    void GpuMemoryHeap::trimMegaPageCache(size_t budget)
+    {
+        while (mMegaPageCacheSize > budget)
+        {
+            // The oldest page in the cache is also the oldest page in its bucket
+            MegaPageList::iterator it = mMegaPageCache.begin();
+            auto& freePages = mMegaPageBuckets[getMegaPageBucket(it->size)];
+            assert(freePages.front() == it);
+            freePages.pop_front();
+            mMegaPageCacheSize -= it->size;
+            mMegaPageCache.erase(it);
+        }
+    }
+
+    void GpuMemoryHeap::setMegaPageCacheBudget(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMegaPageMutex);
+        mMegaPageCacheBudget = bytes;
+        trimMegaPageCache(bytes);
+    }
+
+    PlacedResourceHeap::SharedPtr PlacedResourceHeap::create(uint64_t blockSize, const GpuFence::SharedPtr& pFence)
+    {
+        return SharedPtr(new PlacedResourceHeap(blockSize, pFence));
+    }
+
+    PlacedResourceHeap::Allocation PlacedResourceHeap::allocate(uint64_t size, uint64_t alignment)
+    {
+        Allocation data;
+        if (size > mBlockSize) return data;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+        {
+            data.range = mBlocks[i].pAllocator->allocate(size, alignment);
+            if (data.range.isValid())
+            {
+                data.blockIndex = i;
+                break;
             }
+        }
+
+        if (data.range.isValid() == false)
+        {
+            Block block;
+            block.pHeap = createApiHeap(mBlockSize);
+            block.pAllocator = TLSFAllocator::create(mBlockSize);
+            data.range = block.pAllocator->allocate(size, alignment);
+            data.blockIndex = (uint32_t)mBlocks.size();
+            mBlocks.push_back(block);
+            assert(data.range.isValid());
+        }
+
+        data.pHeap = mBlocks[data.blockIndex].pHeap;
+        data.offset = data.range.offset;
+        return data;
+    }
+
+    void PlacedResourceHeap::release(const Allocation& allocation)
+    {
+        assert(allocation.isValid());
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDeferredReleases.push({ allocation, mpFence->getCpuValue() });
+    }
+
+    void PlacedResourceHeap::executeDeferredReleases()
+    {
+        uint64_t gpuVal = mpFence->getGpuValue();
+        std::lock_guard<std::mutex> lock(mMutex);
+        while (mDeferredReleases.size() && mDeferredReleases.front().fenceValue <= gpuVal)
+        {
+            const Allocation& allocation = mDeferredReleases.front().allocation;
+            mBlocks[allocation.blockIndex].pAllocator->release(allocation.range);
             mDeferredReleases.pop();
         }
     }
+
+    PlacedResourceHeap::Stats PlacedResourceHeap::getStats() const
+    {
+        Stats stats;
+        std::lock_guard<std::mutex> lock(mMutex);
+        stats.blockCount = (uint32_t)mBlocks.size();
+        stats.pendingReleaseCount = (uint32_t)mDeferredReleases.size();
+        for (const auto& block : mBlocks)
+        {
+            TLSFAllocator::Stats blockStats = block.pAllocator->getStats();
+            stats.reservedSize += blockStats.capacity;
+            stats.usedSize += blockStats.usedSize;
+            stats.allocationCount += blockStats.allocationCount;
+            stats.freeBlockCount += blockStats.freeBlockCount;
+            stats.largestFreeBlock = std::max(stats.largestFreeBlock, blockStats.largestFreeBlock);
+        }
+        return stats;
+    }
 }
@@ -1,14 +1,23 @@
 #pragma once
 #include <memory>
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 #include "GraphicsCommon.h"
+#include "LockFreeStack.h"
+#include "RingAllocator.h"
+#include "TLSFAllocator.h"
 
 namespace WIP3D
 {
-    class GpuMemoryHeap
+    class GpuMemoryHeap : public std::enable_shared_from_this<GpuMemoryHeap>
     {
     public:
         using SharedPtr = std::shared_ptr<GpuMemoryHeap>;
@@ -21,6 +30,14 @@ namespace WIP3D
             Readback
         };
 
+        /** How the heap hands out and reclaims memory
+        */
+        enum class Mode
+        {
+            Paged,      ///< Fixed-size pages, recycled once every allocation in the page was released. Each allocation must be released with release().
+            Ring,       ///< A single ring buffer of pageSize bytes. Space is reclaimed in bulk per fence value, release() is a no-op.
+        };
+
         struct BaseData
         {
             ResourceHandle pResourceHandle;
@@ -32,28 +49,102 @@ namespace WIP3D
         {
             uint64_t pageID = 0;
             uint64_t fenceValue = 0;
+            size_t size = 0;            ///< Requested size
+            size_t megaPageSize = 0;    ///< Size of the backing buffer for mega-page allocations, 0 otherwise
 
             static const uint64_t kMegaPageId = -1;
+            static const uint64_t kRingPageId = -2;
+            static const uint64_t kThreadPageId = -3;
             bool operator<(const Allocation& other)  const { return fenceValue > other.fenceValue; }
         };
 
+        /** Heap statistics. The totals are cumulative, sample them every frame to get the per-frame allocation rate.
+        */
+        struct Stats
+        {
+            size_t pageSize = 0;
+            size_t liveSize = 0;                ///< Bytes allocated and not yet retired, including released allocations waiting for the fence. Doesn't include thread allocators
+            uint32_t usedPageCount = 0;         ///< Pages holding live allocations, including the active page
+            uint32_t availablePageCount = 0;
+            uint32_t megaPageCount = 0;         ///< Live mega-page allocations
+            uint32_t cachedMegaPageCount = 0;
+            size_t cachedMegaPageSize = 0;
+            uint32_t sharedPageCount = 0;       ///< Pages owned by thread allocators, leased or not
+            size_t ringUsedSize = 0;            ///< Ring mode only, including wrap padding
+            uint32_t deferredReleaseCount = 0;
+            uint64_t totalAllocationCount = 0;
+            uint64_t totalAllocatedSize = 0;
+        };
+
+    private:
+        struct SharedPage;
+
+    public:
+        /** Per-thread sub-allocator.
+            Leases whole pages from a pool shared by all the heap's thread allocators and hands them back once they are full. The hand-off is lock-free.
+            Each worker thread should own its own object. Allocations don't need to be released, a page is recycled by executeDeferredReleases() once the GPU passes the fence value of its last allocation.
+            The heap's fence must not be signaled while worker threads are allocating.
+        */
+        class ThreadAllocator
+        {
+        public:
+            using UniquePtr = std::unique_ptr<ThreadAllocator>;
+            ~ThreadAllocator();
+
+            Allocation allocate(size_t size, size_t alignment = 1);
+
+            /** Return the current page to the heap. Call it when the thread is done allocating for the frame, otherwise the page stays leased.
+            */
+            void flush();
+
+        private:
+            friend GpuMemoryHeap;
+            ThreadAllocator(const GpuMemoryHeap::SharedPtr& pHeap) : mpHeap(pHeap) {}
+
+            GpuMemoryHeap::SharedPtr mpHeap;
+            SharedPage* mpPage = nullptr;
+        };
+
         ~GpuMemoryHeap();
 
         /** Create a new GPU memory heap.
             \param[in] type The type of heap.
             \param[in] pageSize Page size in bytes.
             \param[in] pFence Fence to use for synchronization.
+            \param[in] mode Allocation mode. In Ring mode pageSize is the size of the ring.
             \return A new object, or throws an exception if creation failed.
         */
-        static SharedPtr create(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence);
+        static SharedPtr create(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence, Mode mode = Mode::Paged);
 
+        /** Allocate memory from the heap.
+            In Ring mode, requests that don't fit into the free part of the ring get a dedicated buffer which is retired with the rest of the frame.
+        */
         Allocation allocate(size_t size, size_t alignment = 1);
         void release(Allocation& data);
         size_t getPageSize() const { return mPageSize; }
+        Mode getMode() const { return mMode; }
         void executeDeferredReleases();
+        Stats getStats() const;
+
+        /** Set the maximum number of bytes kept alive by the mega-page cache.
+            Requests larger than the page size get a dedicated buffer, rounded up to a power of two if the rounded size fits in the budget, and allocated with the exact size otherwise. Once the GPU is done with a rounded buffer it's kept in a size-class bucket and reused by the next request of the same class.
+            When the cache exceeds the budget the least recently released buffers are destroyed. Setting the budget to 0 disables the cache.
+        */
+        void setMegaPageCacheBudget(size_t bytes);
+        size_t getMegaPageCacheBudget() const { return mMegaPageCacheBudget; }
+
+        /** Set the maximum number of bytes kept alive by the free pages of the thread allocators.
+            Pages handed back by the thread allocators are recycled once the GPU is done with them. Pages that would push the free pages over the budget are destroyed instead.
+        */
+        void setSharedPageCacheBudget(size_t bytes) { mSharedPageCacheBudget = bytes; }
+        size_t getSharedPageCacheBudget() const { return mSharedPageCacheBudget; }
+
+        /** Create a sub-allocator for a worker thread. Only supported in Paged mode.
+        */
+        ThreadAllocator::UniquePtr createThreadAllocator();
 
     private:
-        GpuMemoryHeap(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence);
+        GpuMemoryHeap(Type type, size_t pageSize, const GpuFence::SharedPtr& pFence, Mode mode);
 
         struct PageData : public BaseData
         {
@@ -63,17 +154,151 @@ namespace WIP3D
             using UniquePtr = std::unique_ptr<PageData>;
         };
 
+        /** Retired mega-page waiting in the cache
+        */
+        struct MegaPage : public BaseData
+        {
+            size_t size = 0;
+        };
+        using MegaPageList = std::list<MegaPage>;
+
+        /** Page leased by a ThreadAllocator. Linked into the shared lock-free stacks through pNext.
+            Pages larger than the page size are mega-pages serving a single allocation, they go back to the mega-page cache once retired.
+        */
+        struct SharedPage : public BaseData
+        {
+            size_t size = 0;
+            size_t currentOffset = 0;
+            uint64_t fenceValue = 0;
+            SharedPage* pNext = nullptr;
+        };
+
         Type mType;
+        Mode mMode;
         GpuFence::SharedPtr mpFence;
         size_t mPageSize = 0;
         size_t mCurrentPageId = 0;
         PageData::UniquePtr mpActivePage;
 
+        size_t mLiveSize = 0;
+        uint32_t mMegaPageCount = 0;
+        uint64_t mTotalAllocationCount = 0;
+        uint64_t mTotalAllocatedSize = 0;
+
         std::priority_queue<Allocation> mDeferredReleases;
         std::unordered_map<size_t, PageData::UniquePtr> mUsedPages;
         std::queue<PageData::UniquePtr> mAvailablePages;
 
+        // Ring mode. The ring is backed by mpActivePage, mpRing hands out offsets into it
+        RingAllocator::SharedPtr mpRing;
+
+        // Mega-page cache. The list is in LRU order (oldest first), each bucket holds the pages of one power-of-two size class in the same order.
+        // Guarded by mMegaPageMutex, since the thread allocators take their mega-pages from it too
+        static const size_t kDefaultMegaPageCacheBudget = 64 * 1024 * 1024;
+        mutable std::mutex mMegaPageMutex;
+        MegaPageList mMegaPageCache;
+        std::array<std::deque<MegaPageList::iterator>, 64> mMegaPageBuckets;
+        size_t mMegaPageCacheSize = 0;
+        size_t mMegaPageCacheBudget = kDefaultMegaPageCacheBudget;
+
+        void allocateMegaPage(Allocation& data, size_t size);
+        void releaseMegaPage(const Allocation& data);
+        void trimMegaPageCache(size_t budget);
+
+        // Thread allocators. Free and retired pages are lock-free stacks, pending pages are only touched by executeDeferredReleases()
+        LockFreeStack<SharedPage> mFreeSharedPages;
+        LockFreeStack<SharedPage> mRetiredSharedPages;
+        std::vector<SharedPage*> mPendingSharedPages;
+        std::atomic<uint32_t> mSharedPageCount { 0 };
+        std::atomic<uint32_t> mFreeSharedPageCount { 0 };
+        static const size_t kDefaultSharedPageCacheBudget = 64 * 1024 * 1024;
+        size_t mSharedPageCacheBudget = kDefaultSharedPageCacheBudget;
+
+        SharedPage* createSharedPage(size_t size);
+        SharedPage* createSharedMegaPage(size_t size);
+        SharedPage* leaseSharedPage();
+        void retireSharedPage(SharedPage* pPage);
+        void recycleSharedPages(uint64_t gpuVal);
+
         void allocateNewPage();
+        bool allocateFromRing(size_t size, size_t alignment, Allocation& data);
         void initBasePageData(BaseData& data, size_t size);
     };
-}
\ No newline at end of file
+
+    /** Sub-allocator for long-lived resources in the default heap.
+        Memory is reserved in large API heaps (blocks) and handed out by a TLSFAllocator per block, resources are then created as placed resources.
+        Releases are deferred until the GPU passed the fence value at the time of the release.
+        Blocks only hold buffers, since that is what resource heap tier 1 allows for every heap.
+    */
+    class PlacedResourceHeap
+    {
+    public:
+        using SharedPtr = std::shared_ptr<PlacedResourceHeap>;
+        using SharedConstPtr = std::shared_ptr<const PlacedResourceHeap>;
+
+        struct Allocation
+        {
+            HeapHandle pHeap;
+            uint64_t offset = 0;
+            uint32_t blockIndex = 0;
+            TLSFAllocator::Allocation range;
+            bool isValid() const { return range.isValid(); }
+        };
+
+        struct Stats
+        {
+            uint32_t blockCount = 0;
+            uint64_t reservedSize = 0;          ///< Total size of all the blocks
+            uint64_t usedSize = 0;
+            uint64_t largestFreeBlock = 0;
+            uint32_t allocationCount = 0;
+            uint32_t freeBlockCount = 0;
+            uint32_t pendingReleaseCount = 0;   ///< Allocations waiting for the fence
+
+            float getFragmentation() const { uint64_t freeSize = reservedSize - usedSize; return freeSize ? 1.0f - (float)largestFreeBlock / (float)freeSize : 0.0f; }
+        };
+
+        /** Create a new heap. All functions are thread-safe, so resources can be created from loader threads.
+            \param[in] blockSize Size of each API heap in bytes.
+            \param[in] pFence Fence to use for synchronization.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint64_t blockSize, const GpuFence::SharedPtr& pFence);
+
+        /** Allocate memory for a placed resource.
+            \return The allocation, or an invalid allocation if the size is larger than the block size. The caller should fall back to a committed resource in that case.
+        */
+        Allocation allocate(uint64_t size, uint64_t alignment);
+
+        /** Release an allocation once the GPU is done with it
+        */
+        void release(const Allocation& allocation);
+
+        void executeDeferredReleases();
+        uint64_t getBlockSize() const { return mBlockSize; }
+        Stats getStats() const;
+
+    private:
+        PlacedResourceHeap(uint64_t blockSize, const GpuFence::SharedPtr& pFence) : mBlockSize(blockSize), mpFence(pFence) {}
+
+        struct Block
+        {
+            HeapHandle pHeap;
+            TLSFAllocator::SharedPtr pAllocator;
+        };
+
+        struct DeferredRelease
+        {
+            Allocation allocation;
+            uint64_t fenceValue;
+        };
+
+        uint64_t mBlockSize;
+        GpuFence::SharedPtr mpFence;
+        std::vector<Block> mBlocks;
+        std::queue<DeferredRelease> mDeferredReleases;
+        mutable std::mutex mMutex;
+
+        HeapHandle createApiHeap(uint64_t size);
+    };
+}
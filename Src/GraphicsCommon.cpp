@@ -7,33 +7,56 @@ namespace WIP3D
     {
     }
 
-    D3D12DescriptorHeap::SharedPtr WIP3D::D3D12DescriptorHeap::create(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descCount, bool shaderVisible)
+    D3D12DescriptorHeap::D3D12DescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descCount)
+        : mType(type)
     {
-        return SharedPtr();
+        ID3D12Device* pDevice = gpDevice->getApiHandle();
+        mDescriptorSize = pDevice->GetDescriptorHandleIncrementSize(type);
+        mpAllocator = DescriptorAllocator::create(descCount);
     }
 
-
-    WIP3D::D3D12DescriptorHeap::Allocation::~Allocation()
+    D3D12DescriptorHeap::SharedPtr WIP3D::D3D12DescriptorHeap::create(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descCount, bool shaderVisible)
     {
+        assert(gpDevice);
+        ID3D12Device* pDevice = gpDevice->getApiHandle();
+
+        D3D12DescriptorHeap::SharedPtr pHeap = SharedPtr(new D3D12DescriptorHeap(type, descCount));
+        D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+        desc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+        desc.Type = type;
+        desc.NumDescriptors = descCount;
+        if (FAILED(pDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&pHeap->mApiHandle))))
+        {
+            throw std::exception("Can't create descriptor heap");
+        }
+
+        pHeap->mCpuHeapStart = pHeap->mApiHandle->GetCPUDescriptorHandleForHeapStart();
+        if (shaderVisible) pHeap->mGpuHeapStart = pHeap->mApiHandle->GetGPUDescriptorHandleForHeapStart();
+        return pHeap;
     }
 
-    D3D12DescriptorHeap::Allocation::SharedPtr WIP3D::D3D12DescriptorHeap::Allocation::create(D3D12DescriptorHeap::SharedPtr pHeap, uint32_t baseIndex, uint32_t descCount, std::shared_ptr<Chunk> pChunk)
+    D3D12DescriptorHeap::Allocation WIP3D::D3D12DescriptorHeap::allocateDescriptors(uint32_t count)
     {
-        return D3D12DescriptorHeap::Allocation::SharedPtr();
+        return mpAllocator->allocate(count);
     }
-    D3D12DescriptorHeap::Allocation::SharedPtr WIP3D::D3D12DescriptorHeap::allocateDescriptors(uint32_t count)
+
+    void D3D12DescriptorHeap::releaseDescriptors(Allocation allocation)
     {
-        return Allocation::SharedPtr();
+        mpAllocator->release(allocation);
     }
 
     D3D12DescriptorHeap::CpuHandle WIP3D::D3D12DescriptorHeap::getCpuHandle(uint32_t index) const
     {
-        return D3D12DescriptorHeap::CpuHandle();
+        D3D12_CPU_DESCRIPTOR_HANDLE cpuDesc = mCpuHeapStart;
+        cpuDesc.ptr += (SIZE_T)mDescriptorSize * index;
+        return cpuDesc;
     }
 
     D3D12DescriptorHeap::GpuHandle WIP3D::D3D12DescriptorHeap::getGpuHandle(uint32_t index) const
     {
-        return D3D12DescriptorHeap::GpuHandle();
+        D3D12_GPU_DESCRIPTOR_HANDLE gpuDesc = mGpuHeapStart;
+        gpuDesc.ptr += (UINT64)mDescriptorSize * index;
+        return gpuDesc;
     }
 	
     DescriptorPool::SharedPtr DescriptorPool::create(const Desc& desc, const GpuFence::SharedPtr& pFence)
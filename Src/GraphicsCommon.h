@@ -146,9 +146,10 @@ namespace WIP3D
         */
         uint64_t getCpuValue() const { return mCpuValue; }
 
-        /** Tell the GPU to wait until the fence reaches the last GPU-value signaled (which is (mCpuValue - 1))
+        /** Tell the GPU to wait until the fence reaches a value
+            \param[in] val The value to wait for. 0 means the last GPU-value signaled (which is (mCpuValue - 1)).
         */
-        void syncGpu(CommandQueueHandle pQueue);
+        void syncGpu(CommandQueueHandle pQueue, uint64_t val = 0);
 
         /** Tell the CPU to wait until the fence reaches the current value
         */
@@ -297,6 +298,16 @@ namespace WIP3D
         */
         static SharedPtr create(const Desc& desc, const GpuFence::SharedPtr& pFence);
 
+        /** Pool statistics
+        */
+        struct Stats
+        {
+            uint32_t totalDescCount = 0;        ///< Descriptors reserved by the pool, over all types
+            uint32_t usedDescCount = 0;         ///< Descriptors in live allocations, including allocations waiting for the fence
+            uint32_t deferredReleaseCount = 0;
+        };
+
+        Stats getStats() const;
         uint32_t getDescCount(Type type) const { return mDesc.mDescCount[(uint32_t)type]; }
         uint32_t getTotalDescCount() const { return mDesc.mTotalDescCount; }
         bool isShaderVisible() const { return mDesc.mShaderVisible; }
@@ -327,6 +338,11 @@ namespace WIP3D
     // һObjectTypeĳ
     // ʹfenceֵط䣬cacheֵСڵfencegpuֵ˵ʹ
     // 
+    /** Pool of objects which are recycled once the GPU is done with them.
+        Every retired object is tagged with a (fence, value) pair, so objects used on different queues can share a pool.
+        Retired objects are kept in one FIFO per fence. Values of a fence only grow, so only the front of each FIFO has to be checked to find reclaimable objects.
+        The pool can be capped. When the cap is reached and nothing can be reclaimed, the pool waits for the oldest retired object.
+    */
     template<typename ObjectType>
     class FencedPool : public std::enable_shared_from_this<FencedPool<ObjectType>>
     {
@@ -335,53 +351,123 @@ namespace WIP3D
         using SharedConstPtr = std::shared_ptr<const FencedPool<ObjectType>>;
         using NewObjectFuncType = ObjectType(*)(void*);
 
+        struct Stats
+        {
+            uint32_t objectCount = 0;       ///< Objects created by the pool
+            uint32_t retiredCount = 0;      ///< Objects waiting for their fence
+            uint32_t freeCount = 0;         ///< Reclaimed objects which weren't handed out yet
+            uint64_t hitCount = 0;          ///< Requests served with a recycled object
+            uint64_t missCount = 0;         ///< Requests which created a new object
+            uint64_t waitCount = 0;         ///< Requests which waited for the GPU because the pool was at its cap
+            uint64_t overflowCount = 0;     ///< Requests which went over the cap because the oldest object's fence value wasn't signaled yet
+        };
+
         /** Create a new fenced pool.
-            \param[in] pFence GPU fence to use for synchronization.
+            \param[in] pFence GPU fence used by newObject().
             \param[in] newFunc Ptr to function called to create new objects.
             \param[in] pUserData Optional ptr to user data passed to the object creation function.
+            \param[in] maxObjectCount Maximum number of objects to create, 0 means unbounded.
             \return A new object, or throws an exception if creation failed.
         */
-        static SharedPtr create(GpuFence::SharedConstPtr pFence, NewObjectFuncType newFunc, void* pUserData = nullptr)
+        static SharedPtr create(GpuFence::SharedPtr pFence, NewObjectFuncType newFunc, void* pUserData = nullptr, uint32_t maxObjectCount = 0)
         {
-            return SharedPtr(new FencedPool(pFence, newFunc, pUserData));
+            return SharedPtr(new FencedPool(pFence, newFunc, pUserData, maxObjectCount));
         }
 
-        /** Return an object.
+        /** Retire the active object using the current CPU value of the pool's fence, and return a new active object.
             \return An object, or throws an exception on failure.
         */
         ObjectType newObject()
         {
-            // Retire the active object
-            Data data;
-            // ѾȥֵԶһηʱѹqueueԲй¶
-            data.alloc = mActiveObject;
-            data.timestamp = mpFence->getCpuValue();
-            mQueue.push(data);
-
-            // The queue is sorted based on time. Check if the first object is free
-            data = mQueue.front();
-            // fenceֻҪһֻflushʱ򱻸ı
-            // һfencegpuﵽĳֵ˵ֵ֮ǰжѾʹ
-            // mQueueӦflushǰеķ
-            if (data.timestamp <= mpFence->getGpuValue())
+            return newObject(mpFence, mpFence->getCpuValue());
+        }
+
+        /** Retire the active object and return a new active object.
+            \param[in] pFence Fence protecting the active object.
+            \param[in] fenceValue The active object can be reused once pFence reaches this value.
+            \return An object, or throws an exception on failure.
+        */
+        ObjectType newObject(const GpuFence::SharedPtr& pFence, uint64_t fenceValue)
+        {
+            retire(mActiveObject, pFence, fenceValue);
+            mActiveObject = acquire();
+            return mActiveObject;
+        }
+
+        /** Get an object, without touching the active object. Return it with retire().
+            \return An object, or throws an exception on failure.
+        */
+        ObjectType acquire()
+        {
+            if (reclaim())
             {
-                mQueue.pop();
+                mHitCount++;
+                ObjectType obj = mFreeObjects.back();
+                mFreeObjects.pop_back();
+                return obj;
             }
-            else
+
+            if (mMaxObjectCount == 0 || mObjectCount < mMaxObjectCount)
             {
-                // allocԭĶûpopͻqueueУڶʧ
-                data.alloc = createObject();
+                mMissCount++;
+                return createObject();
             }
 
-            mActiveObject = data.alloc;
-            return mActiveObject;
+            // The pool is full, wait for the oldest object. It can only be waited on if its value was already signaled
+            FenceQueue* pOldest = nullptr;
+            for (auto& q : mFenceQueues)
+            {
+                if (q.entries.size() && (pOldest == nullptr || q.entries.front().sequence < pOldest->entries.front().sequence)) pOldest = &q;
+            }
+
+            if (pOldest && pOldest->entries.front().fenceValue < pOldest->pFence->getCpuValue())
+            {
+                mWaitCount++;
+                mHitCount++;
+                pOldest->pFence->syncCpu(pOldest->entries.front().fenceValue);
+                ObjectType obj = pOldest->entries.front().obj;
+                pOldest->entries.pop_front();
+                mRetiredCount--;
+                return obj;
+            }
+
+            mOverflowCount++;
+            mMissCount++;
+            return createObject();
+        }
+
+        /** Return an object to the pool.
+            \param[in] obj The object.
+            \param[in] pFence Fence protecting the object.
+            \param[in] fenceValue The object can be reused once pFence reaches this value. Must not be smaller than the previous value used with the same fence.
+        */
+        void retire(ObjectType obj, const GpuFence::SharedPtr& pFence, uint64_t fenceValue)
+        {
+            FenceQueue& q = getFenceQueue(pFence);
+            assert(q.entries.empty() || q.entries.back().fenceValue <= fenceValue);
+            q.entries.push_back({ obj, fenceValue, mNextSequence++ });
+            mRetiredCount++;
+        }
+
+        Stats getStats() const
+        {
+            Stats stats;
+            stats.objectCount = mObjectCount;
+            stats.retiredCount = mRetiredCount;
+            stats.freeCount = (uint32_t)mFreeObjects.size();
+            stats.hitCount = mHitCount;
+            stats.missCount = mMissCount;
+            stats.waitCount = mWaitCount;
+            stats.overflowCount = mOverflowCount;
+            return stats;
         }
 
     private:
-        FencedPool(GpuFence::SharedConstPtr pFence, NewObjectFuncType newFunc, void* pUserData)
+        FencedPool(GpuFence::SharedPtr pFence, NewObjectFuncType newFunc, void* pUserData, uint32_t maxObjectCount)
             : mpUserData(pUserData)
             , mpFence(pFence)
             , mNewObjFunc(newFunc)
+            , mMaxObjectCount(maxObjectCount)
         {
             assert(pFence && newFunc);
             mActiveObject = createObject();
@@ -391,20 +477,65 @@ namespace WIP3D
         {
             ObjectType pObj = mNewObjFunc(mpUserData);
             if (pObj == nullptr) throw std::exception("Failed to create new object in fenced pool");
+            mObjectCount++;
             return pObj;
         }
 
         struct Data
         {
-            ObjectType alloc;
-            uint64_t timestamp;
+            ObjectType obj;
+            uint64_t fenceValue;
+            uint64_t sequence;      // Retirement order across all fences
+        };
+
+        struct FenceQueue
+        {
+            GpuFence::SharedPtr pFence;
+            std::deque<Data> entries;
         };
 
+        FenceQueue& getFenceQueue(const GpuFence::SharedPtr& pFence)
+        {
+            for (auto& q : mFenceQueues)
+            {
+                if (q.pFence == pFence) return q;
+            }
+            mFenceQueues.push_back({ pFence, {} });
+            return mFenceQueues.back();
+        }
+
+        // Move every object whose fence value was reached to the free list. Reads each fence once
+        bool reclaim()
+        {
+            for (auto& q : mFenceQueues)
+            {
+                if (q.entries.empty()) continue;
+                uint64_t gpuVal = q.pFence->getGpuValue();
+                while (q.entries.size() && q.entries.front().fenceValue <= gpuVal)
+                {
+                    mFreeObjects.push_back(q.entries.front().obj);
+                    q.entries.pop_front();
+                    mRetiredCount--;
+                }
+            }
+            return mFreeObjects.size() != 0;
+        }
+
         ObjectType mActiveObject;
         NewObjectFuncType mNewObjFunc = nullptr;
-        std::queue<Data> mQueue;
-        GpuFence::SharedConstPtr mpFence;
+        std::deque<FenceQueue> mFenceQueues;    // deque, so references stay valid when a fence is added
+        std::vector<ObjectType> mFreeObjects;
+        GpuFence::SharedPtr mpFence;
         void* mpUserData;
+
+        uint32_t mMaxObjectCount;
+        uint32_t mObjectCount = 0;
+        uint32_t mRetiredCount = 0;
+        uint64_t mNextSequence = 0;
+        uint64_t mHitCount = 0;
+        uint64_t mMissCount = 0;
+        uint64_t mWaitCount = 0;
+        uint64_t mOverflowCount = 0;
     };
 
     /** Describes the layout of a vertex buffer that will be bound to a render operation as part of a VAO.
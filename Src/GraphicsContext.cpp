@@ -1,4 +1,9 @@
+#include <sstream>
+#include "CommandCapture.h"
+#include "Device.h"
 #include "GraphicsContext.h"
+#include "PipeplineStateObject.h"
+#include "WorkerPool.h"
 
 namespace WIP3D
 {
@@ -10,9 +15,9 @@ namespace WIP3D
 
     CopyContext::~CopyContext() = default;
 
-    CopyContext::CopyContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue)
+    CopyContext::CopyContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence)
     {
-        mpLowLevelData = LowLevelContextData::create(type, queue);
+        mpLowLevelData = LowLevelContextData::create(type, queue, pFence);
         assert(mpLowLevelData);
     }
 
@@ -24,10 +29,21 @@ namespace WIP3D
 
     void CopyContext::flush(bool wait)
     {
-        if (mCommandsPending)
+        CAPTURE_COMMAND(Flush, this, wait);
+        assert(!mIsSecondary);
+        while (mSplitTransitions.size()) endTransition(mSplitTransitions.back().pResource);
+        flushBarriers();
+
+        // The first-use states of the local tracker may need fix-ups even if nothing was recorded
+        if (mpStateTracker) resolveTrackedStates();
+
+        if (mCommandsPending || mFixupBarriers.size())
         {
-            mpLowLevelData->flush();
+            mpLowLevelData->flush(mFixupBarriers.data(), (uint32_t)mFixupBarriers.size());
+            mFixupBarriers.clear();
             mCommandsPending = false;
+            if (mpStagingHeap) mpStagingHeap->executeDeferredReleases();
+            if (mpReadbackHeap) mpReadbackHeap->executeDeferredReleases();
         }
         else
         {
@@ -58,6 +74,10 @@ namespace WIP3D
 
     bool CopyContext::resourceBarrier(const Resource * pResource, Resource::State newState, const ResourceViewInfo * pViewInfo)
     {
+        CAPTURE_COMMAND(ResourceBarrier, this, pResource, newState);
+        if (mSplitTransitions.size()) endTransition(pResource);
+        if (mpStateTracker) return trackedResourceBarrier(pResource, newState, pViewInfo);
+
         const Texture* pTexture = dynamic_cast<const Texture*>(pResource);
         if (pTexture)
         {
@@ -139,6 +159,7 @@ namespace WIP3D
 
     void CopyContext::updateBuffer(const Buffer * pBuffer, const void* pData, size_t offset, size_t numBytes)
     {
+        CAPTURE_COMMAND(UpdateBuffer, this, pBuffer, offset, numBytes);
         if (numBytes == 0)
         {
             numBytes = pBuffer->getSize() - offset;
@@ -151,10 +172,7 @@ namespace WIP3D
         }
 
         mCommandsPending = true;
-        // Allocate a buffer on the upload heap
-        Buffer::SharedPtr pUploadBuffer = Buffer::create(numBytes, Buffer::BindFlags::None, Buffer::CpuAccess::Write, pData);
-
-        copyBufferRegion(pBuffer, offset, pUploadBuffer.get(), 0, numBytes);
+        uploadBufferData(pBuffer, pData, offset, numBytes);
     }
 
     ComputeContext::SharedPtr ComputeContext::create(CommandQueueHandle queue)
@@ -173,6 +191,12 @@ namespace WIP3D
 
         if (pVars->apply(this, varsChanged, pRootSignature) == false)
         {
+            // A secondary context can't flush, the draw is dropped and the primary context flushes after the join
+            if (mIsSecondary)
+            {
+                logError("ComputeContext::applyComputeVars() - applying ComputeVars failed in a secondary context, most likely because we ran out of descriptors");
+                return false;
+            }
             logWarning("ComputeContext::applyComputeVars() - applying ComputeVars failed, most likely because we ran out of descriptors. Flushing the GPU and retrying");
             flush(true);
             if (!pVars->apply(this, varsChanged, pRootSignature))
@@ -181,6 +205,9 @@ namespace WIP3D
                 return false;
             }
         }
+
+        // Setting the root signature discards the bindless table, so it's only rebound when the vars rebind the root signature
+        if (varsChanged && pRootSignature->getDesc().hasBindlessTable()) gpDevice->getBindlessTable()->bindForCompute(this, pRootSignature->getBindlessTableIndex());
         return true;
     }
 
@@ -188,6 +215,7 @@ namespace WIP3D
     {
         CopyContext::flush(wait);
         mpLastBoundComputeVars = nullptr;
+        mpBoundPipelineState = nullptr;
     }
 
     RenderContext::SharedPtr RenderContext::create(CommandQueueHandle queue)
@@ -257,6 +285,11 @@ namespace WIP3D
         bool bindRootSig = (pVars != mpLastBoundGraphicsVars);
         if (pVars->apply(this, bindRootSig, pRootSignature) == false)
         {
+            if (mIsSecondary)
+            {
+                logError("RenderContext::applyGraphicsVars() - applying GraphicsVars failed in a secondary context, most likely because we ran out of descriptors");
+                return false;
+            }
             logWarning("RenderContext::prepareForDraw() - applying GraphicsVars failed, most likely because we ran out of descriptors. Flushing the GPU and retrying");
             flush(true);
             if (!pVars->apply(this, bindRootSig, pRootSignature))
@@ -265,12 +298,161 @@ namespace WIP3D
                 return false;
             }
         }
+
+        // Same as applyComputeVars(), draws using the table don't bind any other SRV/UAV tables
+        if (bindRootSig && pRootSignature->getDesc().hasBindlessTable()) gpDevice->getBindlessTable()->bindForGraphics(this, pRootSignature->getBindlessTableIndex());
         return true;
     }
 
     void RenderContext::flush(bool wait)
     {
+        assert(mForkedCount == 0);
         ComputeContext::flush(wait);
         mpLastBoundGraphicsVars = nullptr;
+        invalidateBoundState();
+    }
+
+    void RenderContext::invalidateBoundState()
+    {
+        mBoundState = BoundState();
+        mpBoundPipelineState = nullptr;
+    }
+
+    void RenderContext::endStateFilterFrame()
+    {
+        if (mStateFilterStats.pendingPipelineSkips + mStateFilterStats.pendingPipelineFallbacks > 0) mAvoidedStallFrameCount++;
+        mFrameStateFilterStats = mStateFilterStats;
+        mStateFilterStats = StateFilterStats();
+    }
+
+#define for_each_counter(f_) f_(pipelineState) f_(rootSignature) f_(primitiveTopology) f_(vertexBuffers) f_(indexBuffer) f_(renderTargets) f_(viewports) f_(scissors) f_(blendFactor) f_(stencilRef)
+
+    RenderContext::StateFilterStats& RenderContext::StateFilterStats::operator+=(const StateFilterStats& other)
+    {
+        drawCount += other.drawCount;
+        pendingPipelineWaits += other.pendingPipelineWaits;
+        pendingPipelineSkips += other.pendingPipelineSkips;
+        pendingPipelineFallbacks += other.pendingPipelineFallbacks;
+#define add_counter(c_) c_.issued += other.c_.issued; c_.avoided += other.c_.avoided;
+        for_each_counter(add_counter);
+#undef add_counter
+        return *this;
+    }
+
+    uint64_t RenderContext::StateFilterStats::getIssuedCallCount() const
+    {
+        uint64_t count = 0;
+#define add_issued(c_) count += c_.issued;
+        for_each_counter(add_issued);
+#undef add_issued
+        return count;
+    }
+
+    uint64_t RenderContext::StateFilterStats::getAvoidedCallCount() const
+    {
+        uint64_t count = 0;
+#define add_avoided(c_) count += c_.avoided;
+        for_each_counter(add_avoided);
+#undef add_avoided
+        return count;
+    }
+
+    std::string RenderContext::StateFilterStats::toString() const
+    {
+        std::stringstream ss;
+        ss << "draws: " << drawCount << "\n";
+        ss << "pending PSOs: waited " << pendingPipelineWaits << ", skipped " << pendingPipelineSkips << ", fallback " << pendingPipelineFallbacks << "\n";
+#define print_counter(c_) ss << #c_ << ": issued " << c_.issued << ", avoided " << c_.avoided << "\n";
+        for_each_counter(print_counter);
+#undef print_counter
+        ss << "total: issued " << getIssuedCallCount() << ", avoided " << getAvoidedCallCount() << "\n";
+        return ss.str();
+    }
+#undef for_each_counter
+
+    std::vector<RenderContext*> RenderContext::forkSecondaryContexts(uint32_t count)
+    {
+        assert(mForkedCount == 0);
+        while (mSecondaryContexts.size() < count)
+        {
+            SharedPtr pCtx = SharedPtr(new RenderContext(mpLowLevelData->getCommandQueue(), mpLowLevelData->getFence()));
+            pCtx->setStateTracker(ResourceStateTracker::create());
+            pCtx->bindDescriptorHeaps();
+            pCtx->mIsSecondary = true;
+            mSecondaryContexts.push_back(pCtx);
+        }
+
+        mForkedCount = count;
+        std::vector<RenderContext*> contexts(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            contexts[i] = mSecondaryContexts[i].get();
+            contexts[i]->mBindFlags = mBindFlags;
+            contexts[i]->mPendingPipelinePolicy = mPendingPipelinePolicy;
+            contexts[i]->mpFallbackGraphicsState = mpFallbackGraphicsState;
+        }
+        return contexts;
+    }
+
+    void RenderContext::joinSecondaryContexts()
+    {
+        while (mSplitTransitions.size()) endTransition(mSplitTransitions.back().pResource);
+        flushBarriers();
+
+        // Resolve in submission order, each list's fix-ups go at the end of the list before it
+        std::vector<LowLevelContextData*> secondaries(mForkedCount);
+        RenderContext* pPrev = this;
+        for (uint32_t i = 0; i < mForkedCount; i++)
+        {
+            RenderContext* pCtx = mSecondaryContexts[i].get();
+            pCtx->flushBarriers();
+            pCtx->resolveTrackedStates();
+            for (const auto& barrier : pCtx->mFixupBarriers) pPrev->addPendingBarrier(barrier);
+            pPrev->flushBarriers();
+            pCtx->mFixupBarriers.clear();
+            secondaries[i] = pCtx->mpLowLevelData.get();
+            pPrev = pCtx;
+        }
+
+        mpLowLevelData->flushWithSecondaries(secondaries.data(), mForkedCount);
+
+        for (uint32_t i = 0; i < mForkedCount; i++)
+        {
+            RenderContext* pCtx = mSecondaryContexts[i].get();
+            pCtx->mCommandsPending = false;
+            pCtx->mpLastBoundComputeVars = nullptr;
+            pCtx->mpLastBoundGraphicsVars = nullptr;
+            pCtx->invalidateBoundState();
+            pCtx->bindDescriptorHeaps();
+            if (pCtx->mpStagingHeap) pCtx->mpStagingHeap->executeDeferredReleases();
+            if (pCtx->mpReadbackHeap) pCtx->mpReadbackHeap->executeDeferredReleases();
+
+            // The secondary contexts' counters are part of the frame
+            pCtx->endStateFilterFrame();
+            mStateFilterStats += pCtx->mFrameStateFilterStats;
+        }
+        mForkedCount = 0;
+
+        mCommandsPending = false;
+        mpLastBoundComputeVars = nullptr;
+        mpLastBoundGraphicsVars = nullptr;
+        invalidateBoundState();
+        bindDescriptorHeaps();
+        if (mpStagingHeap) mpStagingHeap->executeDeferredReleases();
+        if (mpReadbackHeap) mpReadbackHeap->executeDeferredReleases();
+    }
+
+    void RenderContext::recordParallel(WorkerPool* pPool, uint32_t count, const RecordFunc& record)
+    {
+        std::vector<RenderContext*> contexts = forkSecondaryContexts(count);
+        if (pPool)
+        {
+            pPool->parallelFor(count, [&](uint32_t i) { record(contexts[i], i); });
+        }
+        else
+        {
+            for (uint32_t i = 0; i < count; i++) record(contexts[i], i);
+        }
+        joinSecondaryContexts();
     }
 }
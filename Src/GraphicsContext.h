@@ -1,8 +1,12 @@
 #pragma once
+#include <array>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include "GraphicsCommon.h"
 #include "GraphicsResource.h"
+#include "ResourceStateTracker.h"
 
 #define def_shared_ptr(T) \
 using SharedPtr = std::shared_ptr<T>;\
@@ -30,20 +34,37 @@ namespace WIP3D
         /** Create a new low-level context data object.
             \param[in] type Command queue type.
             \param[in] queue Command queue handle. Can be nullptr.
+            \param[in] pFence Optional. Fence shared with another object whose command lists are submitted together with this one. If nullptr, a new fence is created.
             \return A new object, or throws an exception if creation failed.
         */
-        static SharedPtr create(CommandQueueType type, CommandQueueHandle queue);
+        static SharedPtr create(CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence = nullptr);
 
-        void flush();
+        /** Close and submit the command list, then reset it with a new allocator.
+            \param[in] pFixups Barriers to execute before the command list. They are recorded into a separate command list submitted in the same ExecuteCommandLists() call.
+            \param[in] fixupCount Number of barriers in pFixups.
+        */
+        void flush(const D3D12_RESOURCE_BARRIER* pFixups = nullptr, uint32_t fixupCount = 0);
+
+        /** Close and submit this command list followed by the secondary command lists, in order, with a single ExecuteCommandLists() call. All the lists are reset with new allocators.
+            \param[in] ppSecondaries The secondary objects. They must share this object's fence.
+            \param[in] secondaryCount Number of secondary objects.
+        */
+        void flushWithSecondaries(LowLevelContextData* const* ppSecondaries, uint32_t secondaryCount);
 
         const CommandListHandle& getCommandList() const { return mpList; }
         const CommandQueueHandle& getCommandQueue() const { return mpQueue; }
         const CommandAllocatorHandle& getCommandAllocator() const { return mpAllocator; }
         const GpuFence::SharedPtr& getFence() const { return mpFence; }
+        CommandQueueType getType() const { return mType; }
         LowLevelContextApiData* getApiData() const { return mpApiData; }
         void setCommandList(CommandListHandle pList) { mpList = pList; }
     protected:
-        LowLevelContextData(CommandQueueType type, CommandQueueHandle queue);
+        LowLevelContextData(CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence);
+
+        /** Reset the command list with a new allocator, once the list was submitted
+            \param[in] fenceValue The fence value signaled after the list.
+        */
+        void resetCommandList(uint64_t fenceValue);
 
         LowLevelContextApiData* mpApiData = nullptr;
         CommandQueueType mType;
@@ -54,6 +75,7 @@ namespace WIP3D
     };
 
     class Texture;
+    class WorkerPool;
 
     class CopyContext
     {
@@ -61,20 +83,67 @@ namespace WIP3D
         using SharedPtr = std::shared_ptr<CopyContext>;
         using SharedConstPtr = std::shared_ptr<const CopyContext>;
 
+        /** Reads back a texture subresource.
+            The data is copied into memory from the context's readback heap, a pool of persistently mapped pages synchronized with the context's fence. The memory returns to the pool when the task is destroyed.
+            Tasks must be destroyed on the thread recording into the context that created them.
+        */
         class ReadTextureTask
         {
         public:
             using SharedPtr = std::shared_ptr<ReadTextureTask>;
+
+            /** The data as written by the GPU. Rows are rowPitch bytes apart, and depth slices are depthPitch bytes apart.
+            */
+            struct MappedData
+            {
+                const uint8_t* pData = nullptr;
+                uint32_t rowSize = 0;       ///< Bytes of texel data in a row
+                uint32_t rowPitch = 0;
+                uint32_t rowCount = 0;      ///< Rows per depth slice, in blocks for compressed formats
+                uint32_t depthPitch = 0;
+                uint32_t depth = 0;
+            };
+
+            ~ReadTextureTask();
             static SharedPtr create(CopyContext* pCtx, const Texture* pTexture, uint32_t subresourceIndex);
+
+            /** Check if the GPU finished the copy
+            */
+            bool isReady() const { return mpFence->getGpuValue() >= mFenceValue; }
+
+            /** Get the size of the data without row padding
+            */
+            size_t getDataSize() const { return (size_t)mMappedData.rowSize * mMappedData.rowCount * mMappedData.depth; }
+
+            /** Wait for the copy and return the data without row padding
+            */
             std::vector<uint8_t> getData();
+
+            /** Wait for the copy and write the data without row padding into a caller-provided buffer.
+                \param[in] pDst Destination buffer.
+                \param[in] size Size of the destination buffer. Must be at least getDataSize().
+            */
+            void getData(void* pDst, size_t size);
+
+            /** Same as getData(), but doesn't wait.
+                \return false if the copy is not done yet, in which case the outputs are untouched.
+            */
+            bool tryGetData(std::vector<uint8_t>& data);
+            bool tryGetData(void* pDst, size_t size);
+
+            /** Wait for the copy and return the mapped memory, without copying it. The pointer is valid while the task is alive.
+            */
+            const MappedData& getMappedData();
+
         private:
             ReadTextureTask() = default;
+            void copyData(void* pDst, size_t size) const;
+
             GpuFence::SharedPtr mpFence;
-            Buffer::SharedPtr mpBuffer;
-            CopyContext* mpContext;
-            uint32_t mRowCount;
-            ResourceFormat mTextureFormat;
-            D3D12_PLACED_SUBRESOURCE_FOOTPRINT mFootprint;
+            uint64_t mFenceValue = 0;
+            GpuMemoryHeap::SharedPtr mpHeap;
+            GpuMemoryHeap::Allocation mAllocation;
+            MappedData mMappedData;
         };
 
         virtual ~CopyContext();
@@ -94,6 +163,10 @@ namespace WIP3D
         */
         bool hasPendingCommands() const { return mCommandsPending; }
 
+        /** Check if this is a secondary context returned by RenderContext::forkSecondaryContexts(). Secondary contexts are submitted by their primary and can't be flushed
+        */
+        bool isSecondary() const { return mIsSecondary; }
+
         /** Signal the context that we have pending commands. Useful in case you make raw API calls
         */
         void setPendingCommands(bool commandsPending) { mCommandsPending = commandsPending; }
@@ -108,6 +181,39 @@ namespace WIP3D
         */
         virtual void uavBarrier(const Resource* pResource);
 
+        /** Begin a split transition of an entire resource. The GPU can overlap the transition with the commands recorded until endTransition() is called.
+            The resource can't be used in between. A barrier on the resource, or flush(), ends the transition.
+            \return true if a transition was started, false if the resource is already in the new state or its subresources are in different states.
+        */
+        bool beginTransition(const Resource* pResource, Resource::State newState);
+
+        /** End a split transition started with beginTransition(). Does nothing if the resource has no outstanding transition.
+        */
+        void endTransition(const Resource* pResource);
+
+        /** Record the pending barriers, followed by the pending uploads.
+            Barriers and texture/buffer uploads are batched until the next command which depends on them. Call this before recording commands directly into the command list.
+        */
+        void flushBarriers();
+
+        /** Record resource states into a command-list-local tracker instead of the global resource states.
+            Contexts with a tracker can record concurrently. Their barriers are computed from the states the resources are in inside the command list, and the states expected on first use are fixed up when the list is submitted.
+            Set or clear the tracker right after a flush(). Split transitions are not supported while a tracker is set, beginTransition() records a regular barrier instead.
+            \param[in] pTracker The tracker, or nullptr to use the global resource states.
+        */
+        void setStateTracker(const ResourceStateTracker::SharedPtr& pTracker);
+
+        /** Get the command-list-local state tracker. Returns nullptr when recording with the global resource states.
+        */
+        const ResourceStateTracker::SharedPtr& getStateTracker() const { return mpStateTracker; }
+
+        /** Set a worker pool used to split large CPU copies into the upload ring, see copyPitched().
+            The pool must not run other jobs while the context records uploads.
+            \param[in] pPool The pool, or nullptr to copy on the calling thread.
+        */
+        void setWorkerPool(WorkerPool* pPool) { mpWorkerPool = pPool; }
+        WorkerPool* getWorkerPool() const { return mpWorkerPool; }
+
         /** Copy an entire resource
         */
         void copyResource(const Resource* pDst, const Resource* pSrc);
@@ -135,7 +241,8 @@ namespace WIP3D
         */
         void updateTextureData(const Texture* pTexture, const void* pData);
 
-        /** Update a buffer
+        /** Update a buffer.
+            The data is staged in the context's upload ring, the copy is recorded together with the other pending uploads.
         */
         void updateBuffer(const Buffer* pBuffer, const void* pData, size_t offset = 0, size_t numBytes = 0);
 
@@ -160,7 +267,7 @@ namespace WIP3D
         void bindDescriptorHeaps();
 
     protected:
-        CopyContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue);
+        CopyContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence = nullptr);
 
         bool textureBarrier(const Texture* pTexture, Resource::State newState);
         bool bufferBarrier(const Buffer* pBuffer, Resource::State newState);
@@ -168,8 +275,64 @@ namespace WIP3D
         void apiSubresourceBarrier(const Texture* pTexture, Resource::State newState, Resource::State oldState, uint32_t arraySlice, uint32_t mipLevel);
         void updateTextureSubresources(const Texture* pTexture, uint32_t firstSubresource, uint32_t subresourceCount, const void* pData, const RBVector3IU& offset = RBVector3IU(0), const RBVector3IU& size = RBVector3IU(-1));
 
+        /** Add a barrier to the pending list. A transition is merged with the previous barrier on the same subresource, or both are dropped if they cancel each other out. An UnorderedAccess round trip is replaced with a UAV barrier.
+        */
+        void addPendingBarrier(const D3D12_RESOURCE_BARRIER& barrier);
+
+        /** Stage data in the context's upload ring. The memory is reclaimed once the GPU is done with the command list.
+        */
+        GpuMemoryHeap::Allocation allocateStagingMemory(size_t size, size_t alignment);
+        void uploadBufferData(const Buffer* pBuffer, const void* pData, size_t offset, size_t numBytes);
+
+        /** Transition a resource using the command-list-local tracker
+        */
+        bool trackedResourceBarrier(const Resource* pResource, Resource::State newState, const ResourceViewInfo* pViewInfo);
+
+        /** Resolve the local tracker into the fix-up barriers that must execute before the command list. Commits the final states to the resources.
+        */
+        void resolveTrackedStates();
+
+        struct SplitTransition
+        {
+            const Resource* pResource;
+            Resource::State oldState;
+            Resource::State newState;
+        };
+
         bool mCommandsPending = false;
         LowLevelContextData::SharedPtr mpLowLevelData;
+        std::vector<D3D12_RESOURCE_BARRIER> mPendingBarriers;
+        std::vector<SplitTransition> mSplitTransitions;
+
+        ResourceStateTracker::SharedPtr mpStateTracker;
+        std::vector<ResourceStateTracker::Transition> mTrackedTransitions;
+        std::vector<D3D12_RESOURCE_BARRIER> mFixupBarriers;
+
+        /** A copy from the upload ring, recorded by flushBarriers() after the pending CopyDest transitions
+        */
+        struct PendingUpload
+        {
+            ID3D12Resource* pDst = nullptr;
+            ID3D12Resource* pSrc = nullptr;
+            uint64_t size = 0;          ///< Buffer copies only, 0 for texture copies
+            uint64_t dstOffset = 0;
+            uint64_t srcOffset = 0;
+            uint32_t dstSubresource = 0;
+            RBVector3IU dstOrigin;
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT srcFootprint = {};
+        };
+
+        static const size_t kStagingRingSize = 8 * 1024 * 1024;
+        GpuMemoryHeap::SharedPtr mpStagingHeap;     // Created on first use, in Ring mode, synchronized with the context's fence
+        std::vector<PendingUpload> mPendingUploads;
+        bool mStagingUpload = false;                // Barriers added while true belong to the pending uploads
+
+        WorkerPool* mpWorkerPool = nullptr;
+
+        static const size_t kReadbackPageSize = 4 * 1024 * 1024;
+        GpuMemoryHeap::SharedPtr mpReadbackHeap;    // Created on first use, in Paged mode, synchronized with the context's fence
+
+        bool mIsSecondary = false;
     };
 
     class ComputeContext : public CopyContext
@@ -219,15 +382,17 @@ namespace WIP3D
         virtual void flush(bool wait = false) override;
 
     protected:
-        ComputeContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue);
+        ComputeContext(LowLevelContextData::CommandQueueType type, CommandQueueHandle queue, const GpuFence::SharedPtr& pFence = nullptr);
         bool prepareForDispatch(ComputeState* pState, ComputeVars* pVars);
         bool applyComputeVars(ComputeVars* pVars, RootSignature* pRootSignature);
 
         const ComputeVars* mpLastBoundComputeVars = nullptr;
+        ID3D12PipelineState* mpBoundPipelineState = nullptr;    // Shared by the compute and graphics pipelines, nullptr if unknown
 #endif
     };
 
     class FullScreenPass;
+    class GraphicsStateObject;
 
     /** The rendering context. Use it to bind state and dispatch calls to the GPU
     */
@@ -255,6 +420,15 @@ namespace WIP3D
             All = uint32_t(-1)
         };
 
+        /** What a draw does when its PSO is still compiling on the PipelineStateCache threads
+        */
+        enum class PendingPipelinePolicy
+        {
+            Block,      ///< Wait until the PSO is ready
+            Skip,       ///< Drop the draw
+            Fallback,   ///< Draw with the fallback PSO, see setFallbackGraphicsState(). Drops the draw if no fallback is set
+        };
+
         ~RenderContext();
 
         /** Create a new render context.
@@ -356,6 +530,62 @@ namespace WIP3D
         */
         void flush(bool wait = false) override;
 
+        /** Number of state-setting API calls prepareForDraw() made, and skipped because the command list already had the same value bound
+        */
+        struct StateFilterStats
+        {
+            struct Counter
+            {
+                uint64_t issued = 0;
+                uint64_t avoided = 0;
+            };
+
+            uint64_t drawCount = 0;
+            uint64_t pendingPipelineWaits = 0;      ///< Draws that blocked until their PSO finished compiling
+            uint64_t pendingPipelineSkips = 0;      ///< Draws dropped because their PSO was still compiling
+            uint64_t pendingPipelineFallbacks = 0;  ///< Draws that used the fallback PSO because theirs was still compiling
+            Counter pipelineState;
+            Counter rootSignature;
+            Counter primitiveTopology;
+            Counter vertexBuffers;
+            Counter indexBuffer;
+            Counter renderTargets;
+            Counter viewports;
+            Counter scissors;
+            Counter blendFactor;
+            Counter stencilRef;
+
+            StateFilterStats& operator+=(const StateFilterStats& other);
+            uint64_t getIssuedCallCount() const;
+            uint64_t getAvoidedCallCount() const;
+
+            /** Get a human-readable report, one line per call type
+            */
+            std::string toString() const;
+        };
+
+        /** Get the state-filter counters of the last completed frame
+        */
+        const StateFilterStats& getStateFilterStats() const { return mFrameStateFilterStats; }
+
+        /** Close the current frame of state-filter counters. Called by the device on present.
+        */
+        void endStateFilterFrame();
+
+        /** Get the number of frames in which draws were skipped or used the fallback PSO instead of waiting for a PSO to compile
+        */
+        uint64_t getAvoidedStallFrameCount() const { return mAvoidedStallFrameCount; }
+
+        /** Set what draws do while their PSO is still compiling. The default is Block, which is the same as compiling on first use
+        */
+        void setPendingPipelinePolicy(PendingPipelinePolicy policy) { mPendingPipelinePolicy = policy; }
+        PendingPipelinePolicy getPendingPipelinePolicy() const { return mPendingPipelinePolicy; }
+
+        /** Set the PSO used by PendingPipelinePolicy::Fallback. The vars of the replaced draws are bound with its root signature, so it must be compatible with all of them, and with the bound FBO's formats.
+            \param[in] pFallback The fallback PSO. It's used even if it's still compiling itself. nullptr drops the draws instead.
+        */
+        void setFallbackGraphicsState(const std::shared_ptr<GraphicsStateObject>& pFallback) { mpFallbackGraphicsState = pFallback; }
+
         /** Tell the render context what it should and shouldn't bind before drawing
         */
         void setBindFlags(StateBindFlags flags) { mBindFlags = flags; }
@@ -379,13 +609,77 @@ namespace WIP3D
         void raytrace(RtProgram* pProgram, RtProgramVars* pVars, uint32_t width, uint32_t height, uint32_t depth);
 #endif
 
+        using RecordFunc = std::function<void(RenderContext* pCtx, uint32_t index)>;
+
+        /** Fork secondary contexts for recording on worker threads.
+            Each secondary context has its own command list, its own allocators and a local resource state tracker, so they can record concurrently. They share this context's queue and fence.
+            Commands recorded into this context before the fork execute first. This context can't record until joinSecondaryContexts() is called, and the secondary contexts must not be flushed.
+            \param[in] count Number of secondary contexts. The contexts are created on first use and reused by later forks.
+            \return The secondary contexts. Only valid until the join.
+        */
+        std::vector<RenderContext*> forkSecondaryContexts(uint32_t count);
+
+        /** Submit this context's command list followed by the secondary command lists, in fork order, with a single ExecuteCommandLists() call.
+            The resource states each secondary list expects are resolved in the same order, the fix-up barriers are recorded at the end of the preceding list.
+        */
+        void joinSecondaryContexts();
+
+        /** Fork secondary contexts, call record(pCtx, index) for each of them on the worker pool, and join them.
+            \param[in] pPool The worker pool. If nullptr, the secondary contexts are recorded on the calling thread, in order.
+            \param[in] count Number of secondary contexts.
+            \param[in] record The recording function.
+        */
+        void recordParallel(WorkerPool* pPool, uint32_t count, const RecordFunc& record);
+
     private:
-        RenderContext(CommandQueueHandle queue);
+        RenderContext(CommandQueueHandle queue, const GpuFence::SharedPtr& pFence = nullptr);
         bool applyGraphicsVars(GraphicsVars* pVars, RootSignature* pRootSignature);
         bool prepareForDraw(GraphicsState* pState, GraphicsVars* pVars);
 
         StateBindFlags mBindFlags = StateBindFlags::All;
         GraphicsVars* mpLastBoundGraphicsVars = nullptr;
+        PendingPipelinePolicy mPendingPipelinePolicy = PendingPipelinePolicy::Block;
+        std::shared_ptr<GraphicsStateObject> mpFallbackGraphicsState;
+        uint64_t mAvoidedStallFrameCount = 0;
+
+        template<typename T>
+        struct BoundValue
+        {
+            T value = {};
+            bool valid = false;
+        };
+
+        /** Shadow of the state prepareForDraw() last set in the command list. Values are only valid until the command list is reset.
+        */
+        struct BoundState
+        {
+            BoundValue<ID3D12RootSignature*> rootSignature;
+            BoundValue<D3D12_PRIMITIVE_TOPOLOGY> primitiveTopology;
+            BoundValue<std::array<D3D12_VERTEX_BUFFER_VIEW, D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT>> vertexBuffers;
+            BoundValue<D3D12_INDEX_BUFFER_VIEW> indexBuffer;
+            BoundValue<std::array<HeapCpuHandle, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1>> renderTargets;  // The last entry is the DSV
+            BoundValue<std::array<D3D12_VIEWPORT, D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE>> viewports;
+            BoundValue<std::array<D3D12_RECT, D3D12_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE>> scissors;
+            BoundValue<std::array<float, 4>> blendFactor;
+            BoundValue<UINT> stencilRef;
+        };
+
+        /** Update a shadow value and count the call.
+            \return true if the value changed and the API call must be made.
+        */
+        template<typename T>
+        static bool updateBoundValue(BoundValue<T>& bound, const T& value, StateFilterStats::Counter& counter);
+
+        /** Forget the bound state, after the command list was reset
+        */
+        void invalidateBoundState();
+
+        BoundState mBoundState;
+        StateFilterStats mStateFilterStats;
+        StateFilterStats mFrameStateFilterStats;
+
+        std::vector<SharedPtr> mSecondaryContexts;
+        uint32_t mForkedCount = 0;
 #endif
     };
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "D3D12/WIPD3D12.h"
+#include <atomic>
 #include <vector>
 #include <memory>
 
@@ -77,10 +78,22 @@ namespace WIP3D
         */
         Resource* getResource() const { return mpResource.lock().get(); }
 
+        /** Register the view in the device's bindless table. Views don't take a slot until this is called, so only call it for views which shaders index through a root signature declaring the table (RootSignature::Desc::addBindlessTable()).
+            The first call copies the view's descriptor into the table, later calls return the same slot. Thread-safe. The slot is released with the view.
+            eturn The slot index, or BindlessDescriptorTable::kInvalidIndex if the view can't be registered (only texture and buffer SRVs/UAVs can) or the table is full.
+        */
+        uint32_t requestBindlessIndex();
+
+        /** Get the slot of the view in the device's bindless table, or BindlessDescriptorTable::kInvalidIndex if requestBindlessIndex() wasn't called.
+        */
+        uint32_t getBindlessIndex() const { return mBindlessIndex.load(); }
+
     protected:
         ApiHandle mApiHandle;
         ResourceViewInfo mViewInfo;
         ResourceWeakPtr mpResource;
+        bool mBindlessAllowed = false;  // Set by the SRV/UAV factories for views of a resource
+        std::atomic<uint32_t> mBindlessIndex{ BindlessDescriptorTable::kInvalidIndex };
     };
 
     class ShaderResourceView : public ResourceView<SrvHandle>
@@ -287,6 +287,7 @@ namespace WIP3D
         else
         {
             gpDevice->releaseResource(mApiHandle);
+            if (mPlacedData.isValid()) gpDevice->getPlacedResourceHeap()->release(mPlacedData);
         }
     }
 
@@ -595,13 +596,25 @@ namespace WIP3D
 
     void Texture::uploadInitData(const void* pData, bool autoGenMips)
     {
+        assert(gpDevice);
+        auto pRenderContext = gpDevice->getRenderContext();
+
+        // Without mip generation the data only needs a copy. Stream it on the copy queue and make the direct queue wait for it, instead of recording the copy into the render context
+        const auto& pStreamer = gpDevice->getUploadStreamer();
+        if (pStreamer && autoGenMips == false)
+        {
+            // The resource was just created in the Common state, nothing else can use it yet
+            setGlobalState(Resource::State::Common);
+            UploadStreamer::Ticket ticket = pStreamer->uploadTexture(std::static_pointer_cast<Texture>(shared_from_this()), pData);
+            pStreamer->waitOnGpu(pRenderContext->getLowLevelData()->getCommandQueue(), ticket);
+            return;
+        }
+
         // TODO: This is a hack to allow multi-threaded texture loading using AsyncTextureLoader.
         // Replace with something better.
         static std::mutex mutex;
         std::lock_guard<std::mutex> lock(mutex);
 
-        assert(gpDevice);
-        auto pRenderContext = gpDevice->getRenderContext();
         if (autoGenMips)
         {
             // Upload just the first mip-level
@@ -172,6 +172,7 @@ namespace WIP3D
 
     protected:
         friend class CopyContext;
+        friend class ResourceStateTracker;
 
         Resource(Type type, BindFlags bindFlags, uint64_t size) : mType(type), mBindFlags(bindFlags), mSize(size) {}
 
@@ -420,6 +421,8 @@ namespace WIP3D
     protected:
         Texture(uint32_t width, uint32_t height, uint32_t depth, uint32_t arraySize, uint32_t mipLevels, uint32_t sampleCount, ResourceFormat format, Type Type, BindFlags bindFlags);
         void apiInit(const void* pData, bool autoGenMips);
+        /** Upload the initial data. If the device has an upload streamer and no mips are generated, the copy goes through the streamer and the direct queue waits for it on the GPU. Otherwise it's recorded into the render context.
+        */
         void uploadInitData(const void* pData, bool autoGenMips);
 
         bool mReleaseRtvsAfterGenMips = true;
@@ -697,6 +700,7 @@ namespace WIP3D
 
         CpuAccess mCpuAccess;
         GpuMemoryHeap::Allocation mDynamicData;
+        PlacedResourceHeap::Allocation mPlacedData;
         Buffer::SharedPtr mpStagingResource; // For buffers that have both CPU read flag and can be used by the GPU
         Resource::SharedPtr mpAliasedResource;
         uint32_t mElementCount = 0;
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+
+namespace WIP3D
+{
+    /** Lock-free intrusive stack, used to hand pages between threads. T needs a `T* pNext` member, which the stack owns while the node is in it.
+        Consumers never pop a single node. They take the entire stack and push back what they don't need, which keeps the stack ABA-free without tagged pointers.
+        A consumer racing with another one can see an empty stack while the other one pushes the remainder back.
+        The stack doesn't own the nodes.
+    */
+    template<typename T>
+    class LockFreeStack
+    {
+    public:
+        /** Push a chain of nodes linked through pNext, from pFirst to pLast
+        */
+        void push(T* pFirst, T* pLast)
+        {
+            pLast->pNext = mpHead.load(std::memory_order_relaxed);
+            while (!mpHead.compare_exchange_weak(pLast->pNext, pFirst, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        void push(T* pNode) { push(pNode, pNode); }
+
+        /** Detach the entire stack.
+            \return The first node of the chain, or nullptr if the stack is empty.
+        */
+        T* takeAll() { return mpHead.exchange(nullptr, std::memory_order_acquire); }
+
+        /** Take the top node and push the rest back. The cost is linear in the stack size.
+            \return The node, or nullptr if the stack is empty.
+        */
+        T* pop()
+        {
+            T* pNode = takeAll();
+            if (pNode == nullptr) return nullptr;
+            if (pNode->pNext)
+            {
+                T* pLast = pNode->pNext;
+                while (pLast->pNext) pLast = pLast->pNext;
+                push(pNode->pNext, pLast);
+            }
+            pNode->pNext = nullptr;
+            return pNode;
+        }
+
+        bool isEmpty() const { return mpHead.load(std::memory_order_relaxed) == nullptr; }
+
+    private:
+        std::atomic<T*> mpHead { nullptr };
+    };
+}
@@ -0,0 +1,154 @@
+#include <fstream>
+#include <sstream>
+#include "Common.h"
+#include "Util.h"
+#include "Common/FileSystem.h"
+#include "Common/Logger.h"
+#include "MemoryTelemetry.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        // Column name and accessor for every exported value
+        struct Column
+        {
+            const char* name;
+            uint64_t(*get)(const MemoryTelemetry& telemetry, uint32_t index);
+        };
+
+#define stat_column(name_, member_) { name_, [](const MemoryTelemetry& t, uint32_t i) { return (uint64_t)t.getFrame(i).member_; } }
+        const Column kColumns[] =
+        {
+            stat_column("frameID", frameID),
+            stat_column("uploadLiveSize", uploadHeap.liveSize),
+            stat_column("uploadUsedPages", uploadHeap.usedPageCount),
+            stat_column("uploadAvailablePages", uploadHeap.availablePageCount),
+            stat_column("uploadMegaPages", uploadHeap.megaPageCount),
+            stat_column("uploadCachedMegaPages", uploadHeap.cachedMegaPageCount),
+            stat_column("uploadCachedMegaPageSize", uploadHeap.cachedMegaPageSize),
+            stat_column("uploadSharedPages", uploadHeap.sharedPageCount),
+            stat_column("uploadRingUsedSize", uploadHeap.ringUsedSize),
+            stat_column("uploadDeferredReleases", uploadHeap.deferredReleaseCount),
+            { "uploadFrameAllocations", [](const MemoryTelemetry& t, uint32_t i) { return t.getUploadAllocationCount(i); } },
+            { "uploadFrameAllocatedSize", [](const MemoryTelemetry& t, uint32_t i) { return t.getUploadAllocatedSize(i); } },
+            stat_column("placedBlocks", placedHeap.blockCount),
+            stat_column("placedReservedSize", placedHeap.reservedSize),
+            stat_column("placedUsedSize", placedHeap.usedSize),
+            stat_column("placedLargestFreeBlock", placedHeap.largestFreeBlock),
+            stat_column("placedAllocations", placedHeap.allocationCount),
+            stat_column("placedPendingReleases", placedHeap.pendingReleaseCount),
+            stat_column("cpuDescTotal", cpuDescriptorPool.totalDescCount),
+            stat_column("cpuDescUsed", cpuDescriptorPool.usedDescCount),
+            stat_column("cpuDescDeferredReleases", cpuDescriptorPool.deferredReleaseCount),
+            stat_column("gpuDescTotal", gpuDescriptorPool.totalDescCount),
+            stat_column("gpuDescUsed", gpuDescriptorPool.usedDescCount),
+            stat_column("gpuDescDeferredReleases", gpuDescriptorPool.deferredReleaseCount),
+            stat_column("deferredResourceReleases", deferredResourceReleaseCount),
+            stat_column("transientDescTotal", transientDescCount),
+            stat_column("transientDescUsed", transientUsedDescCount),
+            stat_column("descTableCacheEntries", descTableCache.entryCount),
+            stat_column("descTableCacheDescs", descTableCache.cachedDescCount),
+            stat_column("descTableCacheHits", descTableCache.hitCount),
+            stat_column("descTableCacheMisses", descTableCache.missCount),
+            stat_column("descTableCacheEvictions", descTableCache.evictionCount),
+            stat_column("bindlessDescTotal", bindlessDescCount),
+            stat_column("bindlessDescUsed", bindlessUsedDescCount),
+        };
+#undef stat_column
+    }
+
+    MemoryTelemetry::SharedPtr MemoryTelemetry::create(uint32_t historySize)
+    {
+        if (historySize == 0) throw std::exception("MemoryTelemetry::create() - historySize must be greater than 0");
+        return SharedPtr(new MemoryTelemetry(historySize));
+    }
+
+    void MemoryTelemetry::record(const MemoryStats& stats)
+    {
+        uint32_t capacity = (uint32_t)mFrames.size();
+        if (mFrameCount < capacity)
+        {
+            mFrames[(mFirstFrame + mFrameCount) % capacity] = stats;
+            mFrameCount++;
+        }
+        else
+        {
+            mFrames[mFirstFrame] = stats;
+            mFirstFrame = (mFirstFrame + 1) % capacity;
+        }
+    }
+
+    void MemoryTelemetry::clear()
+    {
+        mFirstFrame = 0;
+        mFrameCount = 0;
+    }
+
+    const MemoryStats& MemoryTelemetry::getFrame(uint32_t index) const
+    {
+        assert(index < mFrameCount);
+        return mFrames[(mFirstFrame + index) % mFrames.size()];
+    }
+
+    uint64_t MemoryTelemetry::getUploadAllocationCount(uint32_t index) const
+    {
+        if (index == 0) return 0;
+        return getFrame(index).uploadHeap.totalAllocationCount - getFrame(index - 1).uploadHeap.totalAllocationCount;
+    }
+
+    uint64_t MemoryTelemetry::getUploadAllocatedSize(uint32_t index) const
+    {
+        if (index == 0) return 0;
+        return getFrame(index).uploadHeap.totalAllocatedSize - getFrame(index - 1).uploadHeap.totalAllocatedSize;
+    }
+
+    std::string MemoryTelemetry::toCSV() const
+    {
+        std::stringstream ss;
+        for (uint32_t c = 0; c < ARRAY_COUNT(kColumns); c++)
+        {
+            ss << (c ? "," : "") << kColumns[c].name;
+        }
+        ss << "\n";
+
+        for (uint32_t i = 0; i < mFrameCount; i++)
+        {
+            for (uint32_t c = 0; c < ARRAY_COUNT(kColumns); c++)
+            {
+                ss << (c ? "," : "") << kColumns[c].get(*this, i);
+            }
+            ss << "\n";
+        }
+        return ss.str();
+    }
+
+    std::string MemoryTelemetry::toJSON() const
+    {
+        std::stringstream ss;
+        ss << "[\n";
+        for (uint32_t i = 0; i < mFrameCount; i++)
+        {
+            ss << "  {";
+            for (uint32_t c = 0; c < ARRAY_COUNT(kColumns); c++)
+            {
+                ss << (c ? ", " : "") << "\"" << kColumns[c].name << "\": " << kColumns[c].get(*this, i);
+            }
+            ss << ((i + 1 < mFrameCount) ? "},\n" : "}\n");
+        }
+        ss << "]\n";
+        return ss.str();
+    }
+
+    bool MemoryTelemetry::dumpToFile(const std::string& filename) const
+    {
+        std::ofstream fout(filename);
+        if (fout.is_open() == false)
+        {
+            LOG_WARN(("MemoryTelemetry::dumpToFile() - can't open " + filename).c_str());
+            return false;
+        }
+        fout << ((WIPFileSystem::get_extension(filename) == ".json") ? toJSON() : toCSV());
+        return true;
+    }
+}
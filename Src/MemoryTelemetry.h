@@ -0,0 +1,87 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GPUMemory.h"
+#include "GraphicsCommon.h"
+
+namespace WIP3D
+{
+    /** Snapshot of the device's GPU memory usage at the end of a frame
+    */
+    struct MemoryStats
+    {
+        uint64_t frameID = 0;
+        GpuMemoryHeap::Stats uploadHeap;
+        PlacedResourceHeap::Stats placedHeap;
+        DescriptorPool::Stats cpuDescriptorPool;
+        DescriptorPool::Stats gpuDescriptorPool;
+        uint32_t deferredResourceReleaseCount = 0;  ///< API objects waiting for the frame fence
+        uint32_t transientDescCount = 0;            ///< Descriptors reserved by the transient rings, summed over the heap types
+        uint32_t transientUsedDescCount = 0;        ///< Descriptors of the transient rings the GPU may still read
+        DescriptorTableCache::Stats descTableCache; ///< Summed over the heap types
+        uint32_t bindlessDescCount = 0;
+        uint32_t bindlessUsedDescCount = 0;
+    };
+
+    /** Keeps a rolling history of per-frame memory snapshots and exports it as CSV or JSON.
+        Per-frame allocation rates are derived from the difference between consecutive snapshots.
+    */
+    class MemoryTelemetry
+    {
+    public:
+        using SharedPtr = std::shared_ptr<MemoryTelemetry>;
+        using SharedConstPtr = std::shared_ptr<const MemoryTelemetry>;
+
+        /** Create a new object.
+            \param[in] historySize Number of frames to keep.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint32_t historySize = 300);
+
+        /** Add a snapshot. Once the history is full the oldest frame is dropped.
+        */
+        void record(const MemoryStats& stats);
+
+        /** Drop all recorded frames
+        */
+        void clear();
+
+        /** Get the number of recorded frames
+        */
+        uint32_t getFrameCount() const { return mFrameCount; }
+
+        /** Get a recorded frame.
+            \param[in] index Frame index, 0 is the oldest recorded frame.
+        */
+        const MemoryStats& getFrame(uint32_t index) const;
+
+        /** Get the most recent frame. Only valid if getFrameCount() > 0.
+        */
+        const MemoryStats& getLatest() const { return getFrame(mFrameCount - 1); }
+
+        /** Get the number of upload-heap allocations made during a recorded frame.
+            Returns 0 for the oldest frame, since there is no previous snapshot to compare against.
+        */
+        uint64_t getUploadAllocationCount(uint32_t index) const;
+        uint64_t getUploadAllocatedSize(uint32_t index) const;
+
+        /** Export the history. Each recorded frame is a row/object.
+        */
+        std::string toCSV() const;
+        std::string toJSON() const;
+
+        /** Write the history to a file. The format is picked based on the extension, '.json' writes JSON, anything else writes CSV.
+            \return true on success, false if the file couldn't be opened.
+        */
+        bool dumpToFile(const std::string& filename) const;
+
+    private:
+        MemoryTelemetry(uint32_t historySize) : mFrames(historySize) {}
+
+        std::vector<MemoryStats> mFrames;   // Circular buffer
+        uint32_t mFirstFrame = 0;
+        uint32_t mFrameCount = 0;
+    };
+}
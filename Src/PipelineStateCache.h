@@ -0,0 +1,146 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "D3D12/WIPD3D12.h"
+
+namespace WIP3D
+{
+    /** Cache of pipeline state objects, backed by an on-disk pipeline library.
+        PSOs are keyed by a stable 64-bit hash of the full API description: shader bytecode, root signature, blend/rasterizer/depth-stencil state,
+        render-target formats and input layout. Pointers are never hashed, so a key found in the library file refers to the same PSO on the next run.
+        The library file is loaded when the cache is created. New PSOs are added to the library as they are created, and save() only rewrites the file when something was added.
+        The library is only valid for the driver and adapter that wrote it. A stale or corrupted file is discarded and rebuilt.
+        All functions are thread-safe. PSOs are compiled outside of the lock, so different PSOs can be compiled concurrently.
+        PSOs can also be requested asynchronously. Requests are compiled in order by the cache's compile threads, and the caller gets a future it can poll from the render loop.
+    */
+    class PipelineStateCache
+    {
+    public:
+        using SharedPtr = std::shared_ptr<PipelineStateCache>;
+        using SharedConstPtr = std::shared_ptr<const PipelineStateCache>;
+
+        /** Handle to a requested PSO. get() blocks until the PSO is ready, and returns nullptr if creation failed. It never throws, creation errors are logged by the compiling thread.
+        */
+        using StateFuture = std::shared_future<ID3D12PipelineStatePtr>;
+
+        struct Stats
+        {
+            uint32_t entryCount = 0;        ///< PSOs in the in-memory cache
+            uint64_t memoryHits = 0;        ///< Requests served from the in-memory cache
+            uint64_t libraryHits = 0;       ///< PSOs loaded from the pipeline library
+            uint64_t misses = 0;            ///< PSOs that had to be compiled
+            uint32_t pendingCount = 0;      ///< Requested PSOs that haven't finished compiling
+            double libraryLoadTime = 0;     ///< Time spent in library loads, in ms
+            double compileTime = 0;         ///< Time spent compiling missing PSOs, in ms
+        };
+
+        /** Create a new cache.
+            \param[in] filename The pipeline library file. If empty, the cache only lives in memory.
+            \param[in] compileThreadCount Number of threads compiling asynchronous requests. If 0, requests are compiled on the calling thread.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(const std::string& filename, uint32_t compileThreadCount = 2);
+
+        /** Finishes the pending requests and saves the library if it changed since the last save()
+        */
+        ~PipelineStateCache();
+
+        /** Find or create a graphics PSO.
+            \param[in] desc The full description. pRootSignature is only used for creation, the root signature is identified by rootSignatureHash.
+            \param[in] rootSignatureHash Stable hash of the root signature layout, see RootSignature::Desc::getHash().
+            \return The PSO, or nullptr if creation failed.
+        */
+        ID3D12PipelineStatePtr getGraphicsState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+        /** Find or create a compute PSO. See getGraphicsState()
+        */
+        ID3D12PipelineStatePtr getComputeState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+        /** Request a graphics PSO without waiting for it to compile.
+            Cached PSOs and PSOs found in the library are returned as ready futures. Otherwise the desc is copied, including the shaders and the input layout, and queued for the compile threads.
+            Requesting a PSO that is already pending returns the pending future.
+            \param[in] desc The full description, see getGraphicsState(). It doesn't need to outlive the call.
+            \param[in] rootSignatureHash Stable hash of the root signature layout.
+            \return The future PSO.
+        */
+        StateFuture requestGraphicsState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+        /** Request a compute PSO without waiting for it to compile. See requestGraphicsState()
+        */
+        StateFuture requestComputeState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+        /** Check if a requested PSO finished compiling, without blocking
+        */
+        static bool isReady(const StateFuture& future) { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+        /** Get the cache key of a PSO description
+        */
+        static uint64_t hashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+        static uint64_t hashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+        /** Write the library to disk if PSOs were added since the last save.
+            The library is serialized under the lock, but the file is written after releasing it, so compilations and requests only wait for the serialization.
+            \return false if the file couldn't be written, true otherwise.
+        */
+        bool save();
+
+        /** Run save() on a compile thread, so the caller doesn't wait for the file write. Does nothing if a save is already queued.
+            If there are no compile threads, save() runs on the calling thread.
+        */
+        void saveAsync();
+
+        /** Check if PSOs were added since the last save
+        */
+        bool isDirty() const;
+
+        const std::string& getFilename() const { return mFilename; }
+        Stats getStats() const;
+
+    private:
+        PipelineStateCache(const std::string& filename, uint32_t compileThreadCount);
+
+        using Promise = std::promise<ID3D12PipelineStatePtr>;
+        using CreateFunc = std::function<ID3D12PipelineStatePtr()>;
+        using LoadFunc = std::function<HRESULT(const wchar_t* name, ID3D12PipelineStatePtr& pState)>;
+
+        struct CompileJob
+        {
+            uint64_t hash;
+            CreateFunc create;
+            std::shared_ptr<Promise> pPromise;  // nullptr for a save job
+        };
+
+        /** Look for the PSO in memory, then in the library. On a miss, a pending entry is added and pPromise is set. The caller must then call compile()
+        */
+        StateFuture find(uint64_t hash, const LoadFunc& load, std::shared_ptr<Promise>& pPromise);
+        void compile(uint64_t hash, const CreateFunc& create, Promise& promise);
+        void enqueue(uint64_t hash, const CreateFunc& create, const std::shared_ptr<Promise>& pPromise);
+        void compileLoop();
+
+        std::string mFilename;
+        std::vector<uint8_t> mLibraryBlob;  // The library references this memory for its whole lifetime
+        ID3D12PipelineLibraryPtr mpLibrary; // nullptr if the driver doesn't support pipeline libraries
+
+        mutable std::mutex mMutex;
+        std::unordered_map<uint64_t, StateFuture> mStates;   // Includes the pending requests
+        bool mDirty = false;
+        bool mSaveQueued = false;
+        Stats mStats;
+        std::mutex mFileMutex;  // Serializes the file writes, without holding mMutex
+
+        std::vector<std::thread> mCompileThreads;
+        std::condition_variable mJobQueued;
+        std::deque<CompileJob> mJobs;
+        bool mTerminate = false;
+    };
+}
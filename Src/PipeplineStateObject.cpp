@@ -0,0 +1,137 @@
+#include <algorithm>
+#include "PipeplineStateObject.h"
+#include "StableHash.h"
+
+namespace WIP3D
+{
+    std::mutex RootSignature::sInternMutex;
+    std::unordered_multimap<uint64_t, std::weak_ptr<RootSignature>> RootSignature::sInterned;
+
+    namespace
+    {
+        bool isSameLayout(const DescriptorSet::Layout& a, const DescriptorSet::Layout& b)
+        {
+            if (a.getVisibility() != b.getVisibility() || a.getRangeCount() != b.getRangeCount()) return false;
+            for (size_t i = 0; i < a.getRangeCount(); i++)
+            {
+                const auto& rangeA = a.getRange(i);
+                const auto& rangeB = b.getRange(i);
+                if (rangeA.type != rangeB.type || rangeA.baseRegIndex != rangeB.baseRegIndex || rangeA.descCount != rangeB.descCount || rangeA.regSpace != rangeB.regSpace) return false;
+            }
+            return true;
+        }
+
+        bool isSameRootDescriptor(const RootSignature::RootDescriptorDesc& a, const RootSignature::RootDescriptorDesc& b)
+        {
+            return a.type == b.type && a.regIndex == b.regIndex && a.spaceIndex == b.spaceIndex && a.visibility == b.visibility;
+        }
+
+        bool isSameRootConstants(const RootSignature::RootConstantsDesc& a, const RootSignature::RootConstantsDesc& b)
+        {
+            return a.regIndex == b.regIndex && a.spaceIndex == b.spaceIndex && a.count == b.count;
+        }
+    }
+
+    uint64_t RootSignature::Desc::getHash() const
+    {
+        StableHash hash;
+        hash.add((uint64_t)mSets.size());
+        for (const auto& set : mSets)
+        {
+            hash.add(set.getVisibility()).add((uint64_t)set.getRangeCount());
+            for (size_t i = 0; i < set.getRangeCount(); i++)
+            {
+                const auto& range = set.getRange(i);
+                hash.add(range.type).add(range.baseRegIndex).add(range.descCount).add(range.regSpace);
+            }
+        }
+
+        hash.add((uint64_t)mRootDescriptors.size());
+        for (const auto& desc : mRootDescriptors) hash.add(desc.type).add(desc.regIndex).add(desc.spaceIndex).add(desc.visibility);
+
+        hash.add((uint64_t)mRootConstants.size());
+        for (const auto& desc : mRootConstants) hash.add(desc.regIndex).add(desc.spaceIndex).add(desc.count);
+
+        hash.add(mHasBindlessTable);
+#ifdef FALCOR_D3D12
+        hash.add(mIsLocal);
+#endif
+        return hash.get();
+    }
+
+    bool RootSignature::Desc::operator==(const Desc& other) const
+    {
+#ifdef FALCOR_D3D12
+        if (mIsLocal != other.mIsLocal) return false;
+#endif
+        return mHasBindlessTable == other.mHasBindlessTable
+            && std::equal(mSets.begin(), mSets.end(), other.mSets.begin(), other.mSets.end(), isSameLayout)
+            && std::equal(mRootDescriptors.begin(), mRootDescriptors.end(), other.mRootDescriptors.begin(), other.mRootDescriptors.end(), isSameRootDescriptor)
+            && std::equal(mRootConstants.begin(), mRootConstants.end(), other.mRootConstants.begin(), other.mRootConstants.end(), isSameRootConstants);
+    }
+
+    RootSignature::SharedPtr RootSignature::create(const Desc& desc)
+    {
+        uint64_t hash = desc.getHash();
+
+        // The lock is held while creating, so concurrent requests for the same layout serialize it once
+        std::lock_guard<std::mutex> lock(sInternMutex);
+        auto range = sInterned.equal_range(hash);
+        for (auto it = range.first; it != range.second;)
+        {
+            SharedPtr pSig = it->second.lock();
+            if (pSig == nullptr)
+            {
+                it = sInterned.erase(it);
+                continue;
+            }
+            if (pSig->mDesc == desc) return pSig;
+            ++it;
+        }
+
+        SharedPtr pSig = SharedPtr(new RootSignature(desc));
+        sInterned.emplace(hash, pSig);
+        return pSig;
+    }
+
+    BlendState::SharedPtr GraphicsStateObject::spDefaultBlendState;
+    RasterizerState::SharedPtr GraphicsStateObject::spDefaultRasterizerState;
+    DepthStencilState::SharedPtr GraphicsStateObject::spDefaultDepthStencilState;
+
+    bool GraphicsStateObject::Desc::operator==(const Desc& other) const
+    {
+        // create() replaces missing states with the defaults, so a desc without a state matches one with the default state
+        auto sameState = [](const auto& a, const auto& b, const auto& pDefault) { return (a ? a : pDefault) == (b ? b : pDefault); };
+        return mpLayout == other.mpLayout
+            && mFboDesc == other.mFboDesc
+            && mpProgram == other.mpProgram
+            && mSampleMask == other.mSampleMask
+            && mPrimType == other.mPrimType
+            && mpRootSignature == other.mpRootSignature
+            && sameState(mpBlendState, other.mpBlendState, spDefaultBlendState)
+            && sameState(mpRasterizerState, other.mpRasterizerState, spDefaultRasterizerState)
+            && sameState(mpDepthStencilState, other.mpDepthStencilState, spDefaultDepthStencilState);
+    }
+
+    GraphicsStateObject::GraphicsStateObject(const Desc& desc)
+        : mDesc(desc)
+    {
+    }
+
+    GraphicsStateObject::SharedPtr GraphicsStateObject::create(const Desc& desc)
+    {
+        if (spDefaultBlendState == nullptr)
+        {
+            spDefaultBlendState = BlendState::create(BlendState::Desc());
+            spDefaultRasterizerState = RasterizerState::create(RasterizerState::Desc());
+            spDefaultDepthStencilState = DepthStencilState::create(DepthStencilState::Desc());
+        }
+
+        SharedPtr pState = SharedPtr(new GraphicsStateObject(desc));
+        if (pState->mDesc.mpBlendState == nullptr) pState->mDesc.mpBlendState = spDefaultBlendState;
+        if (pState->mDesc.mpRasterizerState == nullptr) pState->mDesc.mpRasterizerState = spDefaultRasterizerState;
+        if (pState->mDesc.mpDepthStencilState == nullptr) pState->mDesc.mpDepthStencilState = spDefaultDepthStencilState;
+        pState->apiInit();
+        return pState;
+    }
+}
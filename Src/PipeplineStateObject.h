@@ -1,6 +1,7 @@
 #pragma once
 #include "./D3D12/WIPD3D12.h"
 #include "DescriptorSet.h"
+#include "PipelineStateCache.h"
 #include "RenderTarget.h"
 #include "Shader.h"
 
@@ -17,8 +18,9 @@ namespace WIP3D
         arranged consecutively in the following order in the root signature:
 
         1. descriptor tables
-        2. root descriptors
-        3. root constants
+        2. the bindless table, if requested
+        3. root descriptors
+        4. root constants
 
         The get*BaseIndex() functions return the base index of the
         corresponding root parameter type in the root signature.
@@ -55,6 +57,11 @@ namespace WIP3D
             Desc& addRootDescriptor(DescType type, uint32_t regIndex, uint32_t spaceIndex, ShaderVisibility visibility = ShaderVisibility::All);
             Desc& addRootConstants(uint32_t regIndex, uint32_t spaceIndex, uint32_t count); // #SHADER_VAR Make sure this works with the reflectors
 
+            /** Expose the device's bindless SRV/UAV table. It's a single table, see BindlessDescriptorTable::getDescriptorRanges() for its layout.
+            */
+            Desc& addBindlessTable() { mHasBindlessTable = true; return *this; }
+            bool hasBindlessTable() const { return mHasBindlessTable; }
+
 #ifdef FALCOR_D3D12
             Desc& setLocal(bool isLocal) { mIsLocal = isLocal; return *this; }
 #endif
@@ -68,12 +75,20 @@ namespace WIP3D
             size_t getRootConstantCount() const { return mRootConstants.size(); }
             const RootConstantsDesc& getRootConstantDesc(size_t index) const { return mRootConstants[index]; }
 
+            /** Get a hash of the layout. It only depends on the desc's content, so it's stable across runs, see PipelineStateCache
+            */
+            uint64_t getHash() const;
+
+            bool operator==(const Desc& other) const;
+            bool operator!=(const Desc& other) const { return !(*this == other); }
+
         private:
             friend class RootSignature;
 
             std::vector<DescriptorSetLayout> mSets;
             std::vector<RootDescriptorDesc> mRootDescriptors;
             std::vector<RootConstantsDesc> mRootConstants;
+            bool mHasBindlessTable = false;
 
 #ifdef FALCOR_D3D12
             bool mIsLocal = false;
@@ -88,14 +103,16 @@ namespace WIP3D
         static SharedPtr getEmpty();
 
         /** Create a root signature.
+            Root signatures are interned: while a root signature with the same layout is alive, it's returned instead of serializing a new one.
+            Programs with identical layouts then share one API handle, and switching between them doesn't rebind the root signature.
             \param[in] desc Root signature description.
-            \return New object, or throws an exception if creation failed.
+            \return New or existing object, or throws an exception if creation failed.
         */
         static SharedPtr create(const Desc& desc);
 
-        /** Create a root signature from program reflection.
+        /** Create a root signature from program reflection. The desc built from the reflection goes through create(const Desc&), so it's interned too.
             \param[in] pReflection Reflection object.
-            \return New object, or throws an exception if creation failed.
+            \return New or existing object, or throws an exception if creation failed.
         */
         static SharedPtr create(const ProgramReflection* pReflection);
 
@@ -111,7 +128,8 @@ namespace WIP3D
         const DescriptorSetLayout& getDescriptorSet(size_t index) const { return mDesc.mSets[index]; }
 
         uint32_t getDescriptorSetBaseIndex() const { return 0; }
-        uint32_t getRootDescriptorBaseIndex() const { return getDescriptorSetBaseIndex() + (uint32_t)mDesc.mSets.size(); }
+        uint32_t getBindlessTableIndex() const { return getDescriptorSetBaseIndex() + (uint32_t)mDesc.mSets.size(); }
+        uint32_t getRootDescriptorBaseIndex() const { return getBindlessTableIndex() + (mDesc.mHasBindlessTable ? 1 : 0); }
         uint32_t getRootConstantBaseIndex() const { return getRootDescriptorBaseIndex() + (uint32_t)mDesc.mRootDescriptors.size(); }
 
         uint32_t getSizeInBytes() const { return mSizeInBytes; }
@@ -133,6 +151,10 @@ namespace WIP3D
         static SharedPtr spEmptySig;
         static uint64_t sObjCount;
 
+        // Live root signatures by Desc::getHash(). Entries are weak, so interning doesn't keep unused root signatures alive
+        static std::mutex sInternMutex;
+        static std::unordered_multimap<uint64_t, std::weak_ptr<RootSignature>> sInterned;
+
         uint32_t mSizeInBytes;
         std::vector<uint32_t> mElementByteOffset;
     };
@@ -244,7 +266,14 @@ namespace WIP3D
         */
         static SharedPtr create(const Desc& desc);
 
-        const ApiHandle& getApiHandle() { return mApiHandle; }
+        /** Get the PSO. Blocks if it's still compiling, see isReady(). Returns nullptr if creation failed, it never throws
+        */
+        const ApiHandle& getApiHandle() { return mPendingHandle.valid() ? mPendingHandle.get() : mApiHandle; }
+
+        /** Check if the PSO finished compiling, without blocking.
+            apiInit() requests the PSO from the device's PipelineStateCache without waiting, so a new state object starts out pending. RenderContext decides what draws do in the meantime, see RenderContext::PendingPipelinePolicy.
+        */
+        bool isReady() const { return mPendingHandle.valid() == false || PipelineStateCache::isReady(mPendingHandle); }
 
         const Desc& getDesc() const { return mDesc; }
 
@@ -254,6 +283,7 @@ namespace WIP3D
 
         Desc mDesc;
         ApiHandle mApiHandle;
+        PipelineStateCache::StateFuture mPendingHandle;  // Valid if the PSO was requested asynchronously, mApiHandle is unused then
 
         // Default state objects
         static BlendState::SharedPtr spDefaultBlendState;
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define WIP_STREAMING_STORES
+#endif
+#include "PitchedCopy.h"
+#include "WorkerPool.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        // Smallest amount of work worth handing to a worker thread
+        const size_t kMinTaskSize = 512 * 1024;
+
+        void streamCopy(uint8_t* pDst, const uint8_t* pSrc, size_t size)
+        {
+#ifdef WIP_STREAMING_STORES
+            // Regular stores until the destination is 16-byte aligned
+            size_t head = std::min(size, (size_t)((16 - ((uintptr_t)pDst & 15)) & 15));
+            memcpy(pDst, pSrc, head);
+            pDst += head;
+            pSrc += head;
+            size -= head;
+
+            // Write whole cache lines, so the write-combining buffers are flushed without partial writes
+            for (; size >= 64; size -= 64, pDst += 64, pSrc += 64)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)pSrc);
+                __m128i b = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+                __m128i c = _mm_loadu_si128((const __m128i*)(pSrc + 32));
+                __m128i d = _mm_loadu_si128((const __m128i*)(pSrc + 48));
+                _mm_stream_si128((__m128i*)pDst, a);
+                _mm_stream_si128((__m128i*)(pDst + 16), b);
+                _mm_stream_si128((__m128i*)(pDst + 32), c);
+                _mm_stream_si128((__m128i*)(pDst + 48), d);
+            }
+            for (; size >= 16; size -= 16, pDst += 16, pSrc += 16)
+            {
+                _mm_stream_si128((__m128i*)pDst, _mm_loadu_si128((const __m128i*)pSrc));
+            }
+#endif
+            memcpy(pDst, pSrc, size);
+        }
+
+        // Copy rows [firstRow, firstRow + rowCount) of the layout, counting the rows of all the slices
+        void copyRows(const PitchedCopyDesc& desc, uint64_t firstRow, uint64_t rowCount)
+        {
+            const uint8_t* pSrc = reinterpret_cast<const uint8_t*>(desc.pSrc);
+            uint8_t* pDst = reinterpret_cast<uint8_t*>(desc.pDst);
+            for (uint64_t row = firstRow; row < firstRow + rowCount; row++)
+            {
+                uint64_t z = row / desc.rowCount;
+                uint64_t y = row % desc.rowCount;
+                const uint8_t* pSrcRow = pSrc + z * desc.srcSlicePitch + y * desc.srcRowPitch;
+                uint8_t* pDstRow = pDst + z * desc.dstSlicePitch + y * desc.dstRowPitch;
+                if (desc.writeCombinedDst) streamCopy(pDstRow, pSrcRow, desc.rowSize);
+                else memcpy(pDstRow, pSrcRow, desc.rowSize);
+            }
+
+#ifdef WIP_STREAMING_STORES
+            // Non-temporal stores are weakly ordered. Make them visible before the GPU work is submitted by another thread
+            if (desc.writeCombinedDst) _mm_sfence();
+#endif
+        }
+    }
+
+    void copyPitched(const PitchedCopyDesc& desc, WorkerPool* pPool)
+    {
+        assert(desc.pSrc && desc.pDst);
+        if (desc.rowSize == 0 || desc.rowCount == 0 || desc.sliceCount == 0) return;
+        assert(desc.srcRowPitch >= desc.rowSize || desc.rowCount == 1);
+        assert(desc.dstRowPitch >= desc.rowSize || desc.rowCount == 1);
+
+        // Merge contiguous rows, then contiguous slices
+        PitchedCopyDesc d = desc;
+        if (d.rowCount > 1 && d.srcRowPitch == d.rowSize && d.dstRowPitch == d.rowSize)
+        {
+            d.rowSize *= d.rowCount;
+            d.rowCount = 1;
+        }
+        if (d.sliceCount > 1 && d.rowCount == 1 && d.srcSlicePitch == d.rowSize && d.dstSlicePitch == d.rowSize)
+        {
+            d.rowSize *= d.sliceCount;
+            d.sliceCount = 1;
+        }
+        d.srcRowPitch = d.rowCount > 1 ? d.srcRowPitch : d.rowSize;
+        d.dstRowPitch = d.rowCount > 1 ? d.dstRowPitch : d.rowSize;
+
+        uint64_t totalRows = (uint64_t)d.rowCount * d.sliceCount;
+        size_t totalSize = d.rowSize * totalRows;
+        if (pPool == nullptr || pPool->getThreadCount() == 1 || totalSize < kParallelPitchedCopySize)
+        {
+            copyRows(d, 0, totalRows);
+            return;
+        }
+
+        // A single large row is split into rows of the same layout
+        if (totalRows == 1)
+        {
+            size_t chunkSize = std::max(kMinTaskSize, d.rowSize / pPool->getThreadCount());
+            chunkSize = (chunkSize + 63) & ~(size_t)63;
+            totalRows = d.rowSize / chunkSize;
+            size_t remainder = d.rowSize - totalRows * chunkSize;
+            if (remainder)
+            {
+                // The tail is copied by the calling thread, after the full chunks
+                PitchedCopyDesc tail = d;
+                tail.pSrc = reinterpret_cast<const uint8_t*>(d.pSrc) + totalRows * chunkSize;
+                tail.pDst = reinterpret_cast<uint8_t*>(d.pDst) + totalRows * chunkSize;
+                tail.rowSize = remainder;
+                copyRows(tail, 0, 1);
+            }
+            d.rowSize = chunkSize;
+            d.rowCount = (uint32_t)totalRows;
+            d.srcRowPitch = chunkSize;
+            d.dstRowPitch = chunkSize;
+        }
+
+        // A few tasks per thread, so uneven progress still balances out
+        uint64_t taskCount = std::min<uint64_t>(totalRows, pPool->getThreadCount() * 4);
+        taskCount = std::max<uint64_t>(1, std::min<uint64_t>(taskCount, totalSize / kMinTaskSize));
+        uint64_t rowsPerTask = (totalRows + taskCount - 1) / taskCount;
+        taskCount = (totalRows + rowsPerTask - 1) / rowsPerTask;
+        pPool->parallelFor((uint32_t)taskCount, [&](uint32_t i)
+        {
+            uint64_t firstRow = i * rowsPerTask;
+            copyRows(d, firstRow, std::min(rowsPerTask, totalRows - firstRow));
+        });
+    }
+}
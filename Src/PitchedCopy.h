@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace WIP3D
+{
+    class WorkerPool;
+
+    /** A copy between two pitched layouts, such as a subresource in CPU memory and its footprint in an upload or readback buffer.
+        Each slice holds rowCount rows of rowSize bytes. Rows are rowPitch bytes apart inside a slice, and slices are slicePitch bytes apart.
+    */
+    struct PitchedCopyDesc
+    {
+        const void* pSrc = nullptr;
+        void* pDst = nullptr;
+        size_t rowSize = 0;
+        uint32_t rowCount = 1;
+        uint32_t sliceCount = 1;
+        size_t srcRowPitch = 0;
+        size_t srcSlicePitch = 0;
+        size_t dstRowPitch = 0;
+        size_t dstSlicePitch = 0;
+        bool writeCombinedDst = false;      ///< The destination is write-combined memory, such as an upload heap. The copy uses non-temporal stores, the destination must not be read back by the CPU.
+    };
+
+    /** Copies with at least this many bytes are split across the threads of the worker pool
+    */
+    static const size_t kParallelPitchedCopySize = 4 * 1024 * 1024;
+
+    /** Copy the rows of a pitched layout.
+        Rows and slices which are contiguous in both layouts are merged, so layouts with matching pitches are copied in one go.
+        \param[in] desc The copy.
+        \param[in] pPool Optional. Large copies are split across the pool's threads. The pool must not be running another job.
+    */
+    void copyPitched(const PitchedCopyDesc& desc, WorkerPool* pPool = nullptr);
+}
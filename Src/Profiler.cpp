@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "Common.h"
+#include "Common/Logger.h"
+#include "Device.h"
+#include "GraphicsContext.h"
+#include "Profiler.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        std::string escapeJson(const std::string& str)
+        {
+            std::string result;
+            for (char c : str)
+            {
+                if (c == '"' || c == '\\') result += '\\';
+                if ((unsigned char)c < 0x20) result += ' ';
+                else result += c;
+            }
+            return result;
+        }
+    }
+
+    Profiler::SharedPtr Profiler::create(uint32_t maxEventsPerFrame, uint32_t historySize)
+    {
+        if (maxEventsPerFrame < 2) throw std::exception("Profiler::create() - maxEventsPerFrame must be at least 2");
+        if (historySize == 0) throw std::exception("Profiler::create() - historySize must be greater than 0");
+        return SharedPtr(new Profiler(maxEventsPerFrame, historySize));
+    }
+
+    Profiler::Profiler(uint32_t maxEventsPerFrame, uint32_t historySize)
+        : mMaxEventsPerFrame(maxEventsPerFrame)
+        , mHistorySize(historySize)
+    {
+        Node root;
+        root.name = "Frame";
+        mNodes.push_back(root);
+        mCpuHistory.resize(mHistorySize);
+        mGpuHistory.resize(mHistorySize);
+        apiInit();
+    }
+
+    Profiler::~Profiler()
+    {
+        apiShutdown();
+    }
+
+    uint32_t Profiler::findOrCreateNode(uint32_t parent, const std::string& name)
+    {
+        for (uint32_t child : mNodes[parent].children)
+        {
+            if (mNodes[child].name == name) return child;
+        }
+
+        Node node;
+        node.name = name;
+        node.parent = parent;
+        node.depth = mNodes[parent].depth + 1;
+        uint32_t index = (uint32_t)mNodes.size();
+        mNodes.push_back(node);
+        mNodes[parent].children.push_back(index);
+        mCpuHistory.resize(mNodes.size() * mHistorySize);
+        mGpuHistory.resize(mNodes.size() * mHistorySize);
+        return index;
+    }
+
+    void Profiler::beginFrame(CopyContext* pContext)
+    {
+        // The slot is reused. Its frame is the oldest one in flight, so the frames before it were already read
+        Frame& frame = mFrames[mFrameIndex];
+        if (frame.pending)
+        {
+            frame.pFence->syncCpu(frame.fenceValue);
+            resolveFrame(mFrameIndex);
+        }
+
+        frame.events.clear();
+        frame.events.push_back({ 0, getCpuTicks(), 0 });
+        writeTimestamp(pContext, getQueryIndex(mFrameIndex, 0));
+        mFrameStarted = true;
+    }
+
+    void Profiler::startEvent(CopyContext* pContext, const std::string& name)
+    {
+        if (mEnabled == false) return;
+        if (mFrameStarted == false) beginFrame(pContext);
+
+        // Children of dropped events are dropped too
+        Frame& frame = mFrames[mFrameIndex];
+        uint32_t parentEvent = mEventStack.size() ? mEventStack.back() : 0;
+        if (parentEvent == kInvalidNode || frame.events.size() >= mMaxEventsPerFrame)
+        {
+            mEventStack.push_back(kInvalidNode);
+            return;
+        }
+
+        uint32_t eventIndex = (uint32_t)frame.events.size();
+        frame.events.push_back({ findOrCreateNode(frame.events[parentEvent].node, name), getCpuTicks(), 0 });
+        writeTimestamp(pContext, getQueryIndex(mFrameIndex, eventIndex));
+        mEventStack.push_back(eventIndex);
+    }
+
+    void Profiler::endEvent(CopyContext* pContext)
+    {
+        if (mEnabled == false) return;
+        assert(mEventStack.size());
+        uint32_t eventIndex = mEventStack.back();
+        mEventStack.pop_back();
+        if (eventIndex == kInvalidNode) return;
+
+        writeTimestamp(pContext, getQueryIndex(mFrameIndex, eventIndex) + 1);
+        mFrames[mFrameIndex].events[eventIndex].cpuEnd = getCpuTicks();
+    }
+
+    void Profiler::endFrame(CopyContext* pContext)
+    {
+        if (mEnabled)
+        {
+            assert(mEventStack.empty());
+            if (mFrameStarted == false) beginFrame(pContext);
+
+            Frame& frame = mFrames[mFrameIndex];
+            frame.events[0].cpuEnd = getCpuTicks();
+            writeTimestamp(pContext, getQueryIndex(mFrameIndex, 0) + 1);
+            resolveTimestamps(pContext, mFrameIndex, (uint32_t)frame.events.size());
+            sampleClocks(pContext, frame.calibrationGpu, frame.calibrationCpu);
+
+            // The caller flushes the context next
+            frame.pFence = pContext->getLowLevelData()->getFence();
+            frame.fenceValue = frame.pFence->getCpuValue();
+            frame.frameID = mFrameID;
+            frame.pending = true;
+            mFrameIndex = (mFrameIndex + 1) % kFrameLatency;
+            mFrameStarted = false;
+        }
+        mFrameID++;
+
+        // Read the frames the GPU is done with, oldest first
+        for (uint32_t i = 0; i < kFrameLatency; i++)
+        {
+            uint32_t frameIndex = (mFrameIndex + i) % kFrameLatency;
+            const Frame& frame = mFrames[frameIndex];
+            if (frame.pending == false) continue;
+            if (frame.pFence->getGpuValue() < frame.fenceValue) break;
+            resolveFrame(frameIndex);
+        }
+
+        // The next frame starts right away, so the root covers the whole frame
+        mEnabled = mEnableRequested;
+        if (mEnabled) beginFrame(pContext);
+    }
+
+    void Profiler::resolveFrame(uint32_t frameIndex)
+    {
+        Frame& frame = mFrames[frameIndex];
+        assert(frame.pending);
+        frame.pending = false;
+
+        const uint64_t* pTimestamps = mpTimestamps + getQueryIndex(frameIndex, 0);
+        double msPerGpuTick = gpDevice->getGpuTimestampFrequency();
+        double cpuTicksPerMs = getCpuTicksPerSecond() / 1000.0;
+        bool capture = mCapturing && frame.frameID >= mCaptureFirstFrame;
+
+        for (auto& node : mNodes)
+        {
+            node.cpuTime = 0;
+            node.gpuTime = 0;
+            node.callCount = 0;
+        }
+
+        for (uint32_t e = 0; e < (uint32_t)frame.events.size(); e++)
+        {
+            const Event& event = frame.events[e];
+            uint64_t gpuStart = pTimestamps[e * 2];
+            uint64_t gpuEnd = pTimestamps[e * 2 + 1];
+            double cpuTime = (double)(event.cpuEnd - event.cpuStart) / cpuTicksPerMs;
+            double gpuTime = (gpuEnd > gpuStart) ? (double)(gpuEnd - gpuStart) * msPerGpuTick : 0.0;
+
+            Node& node = mNodes[event.node];
+            node.cpuTime += (float)cpuTime;
+            node.gpuTime += (float)gpuTime;
+            node.callCount++;
+
+            if (capture)
+            {
+                // Convert the GPU timestamp to CPU ticks using the clocks sampled at the end of the frame
+                double gpuStartTicks = (double)frame.calibrationCpu + (double)(int64_t)(gpuStart - frame.calibrationGpu) * msPerGpuTick * cpuTicksPerMs;
+                double cpuStartMs = (double)(int64_t)(event.cpuStart - mCaptureStart) / cpuTicksPerMs;
+                double gpuStartMs = (gpuStartTicks - (double)mCaptureStart) / cpuTicksPerMs;
+                mCapturedEvents.push_back({ event.node, frame.frameID, cpuStartMs * 1000.0, cpuTime * 1000.0, false });
+                mCapturedEvents.push_back({ event.node, frame.frameID, gpuStartMs * 1000.0, gpuTime * 1000.0, true });
+            }
+        }
+
+        // Update the rolling averages
+        uint32_t slot = (uint32_t)(mResolvedFrameCount % mHistorySize);
+        mResolvedFrameCount++;
+        uint32_t count = (uint32_t)std::min<uint64_t>(mResolvedFrameCount, mHistorySize);
+        for (uint32_t n = 0; n < (uint32_t)mNodes.size(); n++)
+        {
+            float* pCpu = mCpuHistory.data() + n * mHistorySize;
+            float* pGpu = mGpuHistory.data() + n * mHistorySize;
+            pCpu[slot] = mNodes[n].cpuTime;
+            pGpu[slot] = mNodes[n].gpuTime;
+
+            float cpuSum = 0;
+            float gpuSum = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                cpuSum += pCpu[i];
+                gpuSum += pGpu[i];
+            }
+            mNodes[n].cpuTimeAverage = cpuSum / count;
+            mNodes[n].gpuTimeAverage = gpuSum / count;
+        }
+    }
+
+    std::string Profiler::getReport() const
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3);
+
+        // Depth-first, children in creation order
+        std::vector<uint32_t> stack = { 0 };
+        while (stack.size())
+        {
+            const Node& node = mNodes[stack.back()];
+            stack.pop_back();
+            ss << std::string(node.depth * 2, ' ') << node.name << ": CPU " << node.cpuTime << " ms (avg " << node.cpuTimeAverage << "), GPU " << node.gpuTime << " ms (avg " << node.gpuTimeAverage << ")";
+            if (node.callCount > 1) ss << ", " << node.callCount << " calls";
+            ss << "\n";
+            stack.insert(stack.end(), node.children.rbegin(), node.children.rend());
+        }
+        return ss.str();
+    }
+
+    void Profiler::startCapture()
+    {
+        mCapturedEvents.clear();
+        mCapturing = true;
+        mCaptureStart = getCpuTicks();
+        mCaptureFirstFrame = mFrameID;
+    }
+
+    std::string Profiler::toChromeTrace() const
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3);
+        ss << "{\"traceEvents\":[\n";
+        ss << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        ss << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        for (const auto& event : mCapturedEvents)
+        {
+            ss << ",\n{\"name\":\"" << escapeJson(mNodes[event.node].name) << "\",\"cat\":\"" << (event.gpu ? "GPU" : "CPU") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (event.gpu ? 1 : 0);
+            ss << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"args\":{\"frame\":" << event.frameID << "}}";
+        }
+        ss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return ss.str();
+    }
+
+    bool Profiler::dumpChromeTrace(const std::string& filename) const
+    {
+        std::ofstream fout(filename);
+        if (fout.is_open() == false)
+        {
+            LOG_WARN(("Profiler::dumpChromeTrace() - can't open " + filename).c_str());
+            return false;
+        }
+        fout << toChromeTrace();
+        return true;
+    }
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GraphicsCommon.h"
+#include "GraphicsResource.h"
+
+namespace WIP3D
+{
+    class CopyContext;
+
+    /** Hierarchical CPU/GPU profiler.
+        Events are opened and closed around the work of a pass, and can be nested. Each event records its CPU time and a pair of GPU timestamps written into the command list.
+        The timestamps are resolved into a readback ring and read a few frames later, once the GPU is done with the frame, so profiling never stalls the CPU.
+        Resolved events are aggregated into a tree, nodes are identified by their name and parent. Every node keeps its time for the last resolved frame and an average over the last historySize frames.
+        The profiler is not thread-safe. Events must be recorded from the thread owning the render context, secondary contexts are not supported.
+    */
+    class Profiler
+    {
+    public:
+        using SharedPtr = std::shared_ptr<Profiler>;
+        using SharedConstPtr = std::shared_ptr<const Profiler>;
+
+        static const uint32_t kInvalidNode = (uint32_t)-1;
+
+        /** Number of frames in flight. A frame is resolved this many frames after it was recorded, unless the GPU was done earlier
+        */
+        static const uint32_t kFrameLatency = 4;
+
+        struct Node
+        {
+            std::string name;
+            uint32_t parent = kInvalidNode;
+            std::vector<uint32_t> children;
+            uint32_t depth = 0;
+
+            float cpuTime = 0;          ///< Milliseconds spent in the events of the last resolved frame
+            float gpuTime = 0;
+            uint32_t callCount = 0;     ///< Number of events in the last resolved frame
+
+            float cpuTimeAverage = 0;   ///< Average over the history
+            float gpuTimeAverage = 0;
+        };
+
+        ~Profiler();
+
+        /** Create a new profiler.
+            \param[in] maxEventsPerFrame Events past the limit are dropped.
+            \param[in] historySize Number of frames the averages are computed over.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint32_t maxEventsPerFrame = 1024, uint32_t historySize = 60);
+
+        /** Open an event. Events must be closed in reverse order.
+        */
+        void startEvent(CopyContext* pContext, const std::string& name);
+
+        /** Close the last opened event
+        */
+        void endEvent(CopyContext* pContext);
+
+        /** Close the frame and read the frames the GPU is done with. Call it before the last flush of the frame, the device does it in present().
+            All the events must be closed.
+        */
+        void endFrame(CopyContext* pContext);
+
+        /** Enable or disable the profiler. Takes effect at the next endFrame(). A disabled profiler doesn't record anything.
+        */
+        void setEnabled(bool enabled) { mEnableRequested = enabled; }
+        bool isEnabled() const { return mEnabled; }
+
+        /** Get the event tree. Node 0 is the root and covers the whole frame.
+        */
+        const std::vector<Node>& getNodes() const { return mNodes; }
+
+        /** Get the tree as text, one node per line with the last and average times
+        */
+        std::string getReport() const;
+
+        /** Start keeping the resolved events for export. Any previous capture is discarded.
+        */
+        void startCapture();
+        void endCapture() { mCapturing = false; }
+        bool isCapturing() const { return mCapturing; }
+
+        /** Export the captured events in the Chrome trace event format (chrome://tracing, Perfetto). CPU and GPU events are on separate tracks, GPU times are converted to the CPU clock.
+        */
+        std::string toChromeTrace() const;
+
+        /** Write the Chrome trace to a file.
+            \return true on success, false if the file couldn't be opened.
+        */
+        bool dumpChromeTrace(const std::string& filename) const;
+
+        /** RAII helper recording an event for the lifetime of the object. Does nothing if pProfiler is nullptr.
+        */
+        class ScopedEvent
+        {
+        public:
+            ScopedEvent(Profiler* pProfiler, CopyContext* pContext, const std::string& name) : mpProfiler(pProfiler), mpContext(pContext)
+            {
+                if (mpProfiler) mpProfiler->startEvent(mpContext, name);
+            }
+            ~ScopedEvent()
+            {
+                if (mpProfiler) mpProfiler->endEvent(mpContext);
+            }
+        private:
+            Profiler* mpProfiler;
+            CopyContext* mpContext;
+        };
+
+    private:
+        Profiler(uint32_t maxEventsPerFrame, uint32_t historySize);
+
+        struct Event
+        {
+            uint32_t node;
+            uint64_t cpuStart;          // CPU clock ticks
+            uint64_t cpuEnd;
+        };
+
+        struct Frame
+        {
+            std::vector<Event> events;  // Event i uses the timestamps 2i and 2i+1 of the frame's range. Event 0 is the root
+            uint64_t fenceValue = 0;    // The frame's timestamps are available once the context's fence reaches this value
+            GpuFence::SharedPtr pFence;
+            uint64_t frameID = 0;
+            uint64_t calibrationGpu = 0;    // Matching GPU and CPU clocks, sampled when the frame ended
+            uint64_t calibrationCpu = 0;
+            bool pending = false;
+        };
+
+        struct CapturedEvent
+        {
+            uint32_t node;
+            uint64_t frameID;
+            double start;               // Microseconds on the CPU clock, relative to the capture start
+            double duration;
+            bool gpu;
+        };
+
+        void beginFrame(CopyContext* pContext);
+        void resolveFrame(uint32_t frameIndex);
+        uint32_t findOrCreateNode(uint32_t parent, const std::string& name);
+        uint32_t getQueryIndex(uint32_t frameIndex, uint32_t eventIndex) const { return (frameIndex * mMaxEventsPerFrame + eventIndex) * 2; }
+
+        // API specific
+        void apiInit();
+        void apiShutdown();
+        void writeTimestamp(CopyContext* pContext, uint32_t queryIndex);
+        void resolveTimestamps(CopyContext* pContext, uint32_t frameIndex, uint32_t eventCount);
+        void sampleClocks(CopyContext* pContext, uint64_t& gpuTimestamp, uint64_t& cpuTimestamp);
+
+        static uint64_t getCpuTicks();
+        static double getCpuTicksPerSecond();
+
+        uint32_t mMaxEventsPerFrame;
+        uint32_t mHistorySize;
+        bool mEnabled = true;
+        bool mEnableRequested = true;
+
+        std::weak_ptr<QueryHeap> mpQueryHeap;       // kFrameLatency ranges of 2 * mMaxEventsPerFrame timestamps
+        Buffer::SharedPtr mpReadbackBuffer;         // Same layout as the query heap
+        const uint64_t* mpTimestamps = nullptr;     // Persistently mapped readback buffer
+
+        Frame mFrames[kFrameLatency];
+        uint32_t mFrameIndex = 0;
+        uint64_t mFrameID = 0;
+        uint64_t mResolvedFrameCount = 0;
+        bool mFrameStarted = false;
+        std::vector<uint32_t> mEventStack;          // Open events, kInvalidNode for dropped events
+
+        std::vector<Node> mNodes;
+        std::vector<float> mCpuHistory;             // mHistorySize entries per node, in node order
+        std::vector<float> mGpuHistory;
+
+        bool mCapturing = false;
+        uint64_t mCaptureStart = 0;                 // CPU clock ticks
+        uint64_t mCaptureFirstFrame = 0;
+        std::vector<CapturedEvent> mCapturedEvents;
+    };
+}
+
+#define WIP_PROFILE_CONCAT_(a_, b_) a_##b_
+#define WIP_PROFILE_CONCAT(a_, b_) WIP_PROFILE_CONCAT_(a_, b_)
+
+/** Profile the rest of the current scope with the device's profiler
+*/
+#define PROFILE(pContext_, name_) WIP3D::Profiler::ScopedEvent WIP_PROFILE_CONCAT(profileEvent_, __LINE__)(WIP3D::gpDevice ? WIP3D::gpDevice->getProfiler().get() : nullptr, pContext_, name_)
@@ -0,0 +1,84 @@
+#include "ResourceStateTracker.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        static_assert((uint32_t)Resource::State::Undefined == SubresourceStates::kUndefined, "Resource::State::Undefined must map to SubresourceStates::kUndefined");
+        static_assert(ResourceStateTracker::kAllSubresources == SubresourceStates::kAllSubresources, "kAllSubresources mismatch");
+
+        void appendTransitions(const Resource* pResource, const std::vector<SubresourceStates::Transition>& src, std::vector<ResourceStateTracker::Transition>& dst)
+        {
+            for (const auto& t : src)
+            {
+                dst.push_back({ pResource, t.subresource, (Resource::State)t.before, (Resource::State)t.after });
+            }
+        }
+    }
+
+    ResourceStateTracker::SharedPtr ResourceStateTracker::create()
+    {
+        return SharedPtr(new ResourceStateTracker());
+    }
+
+    void ResourceStateTracker::transition(const Resource* pResource, Resource::State newState, const ResourceViewInfo* pViewInfo, std::vector<Transition>& transitions)
+    {
+        const Texture* pTexture = dynamic_cast<const Texture*>(pResource);
+        auto it = mEntries.find(pResource);
+        if (it == mEntries.end())
+        {
+            SubresourceStates states = pTexture ? SubresourceStates(pTexture->getMipCount(), pTexture->getArraySize()) : SubresourceStates();
+            it = mEntries.emplace(pResource, std::move(states)).first;
+        }
+
+        // View ranges only apply to textures, buffers have a single subresource
+        SubresourceStates::Range range;
+        const SubresourceStates::Range* pRange = nullptr;
+        if (pViewInfo && pTexture)
+        {
+            range = { pViewInfo->mostDetailedMip, pViewInfo->mipCount, pViewInfo->firstArraySlice, pViewInfo->arraySize };
+            pRange = &range;
+        }
+
+        mScratch.clear();
+        it->second.transition((uint32_t)newState, pRange, mScratch);
+        appendTransitions(pResource, mScratch, transitions);
+    }
+
+    void ResourceStateTracker::resolve(std::vector<Transition>& fixups)
+    {
+        for (const auto& it : mEntries)
+        {
+            const Resource* pResource = it.first;
+            const SubresourceStates& states = it.second;
+            uint32_t subresourceCount = states.getSubresourceCount();
+
+            // The fix-ups only touch the subresources the list uses
+            mGlobalStates.resize(subresourceCount);
+            for (uint32_t i = 0; i < subresourceCount; i++)
+            {
+                mGlobalStates[i] = (uint32_t)(pResource->mState.isGlobal ? pResource->mState.global : pResource->mState.perSubresource[i]);
+            }
+            mScratch.clear();
+            states.getFixups(mGlobalStates.data(), mScratch);
+            appendTransitions(pResource, mScratch, fixups);
+
+            // Commit the final states
+            if (states.isFinalStateUniform())
+            {
+                pResource->setGlobalState((Resource::State)states.getCurrentState(0));
+            }
+            else
+            {
+                const Texture* pTexture = dynamic_cast<const Texture*>(pResource);
+                assert(pTexture);
+                for (uint32_t i = 0; i < subresourceCount; i++)
+                {
+                    if (states.isUsed(i) == false) continue;
+                    pResource->setSubresourceState(pTexture->getSubresourceArraySlice(i), pTexture->getSubresourceMipLevel(i), (Resource::State)states.getCurrentState(i));
+                }
+            }
+        }
+        mEntries.clear();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "GraphicsResource.h"
+#include "SubresourceStates.h"
+
+namespace WIP3D
+{
+    /** Resource states local to a single command list.
+        A context recording with a tracker doesn't read or write the global state of resources, so several contexts can record at the same time. The tracker remembers the state each subresource is expected to be in when the command list starts executing (its first use), and the state it's left in.
+        When the list is submitted, resolve() compares the expected states with the global ones, returns the fix-up transitions which must execute before the list, and commits the final states to the resources.
+        resolve() must be called in submission order, from the thread submitting the command lists.
+    */
+    class ResourceStateTracker
+    {
+    public:
+        using SharedPtr = std::shared_ptr<ResourceStateTracker>;
+        using SharedConstPtr = std::shared_ptr<const ResourceStateTracker>;
+
+        static const uint32_t kAllSubresources = (uint32_t)-1;
+
+        struct Transition
+        {
+            const Resource* pResource;
+            uint32_t subresource;           ///< Subresource index, or kAllSubresources
+            Resource::State before;
+            Resource::State after;
+        };
+
+        /** Create a new tracker.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create();
+
+        /** Move a resource, or the subresources in a view, to a new state.
+            Subresources used for the first time in this command list don't need a transition, their state is recorded as the expected state instead.
+            \param[in] pResource The resource.
+            \param[in] newState The new state.
+            \param[in] pViewInfo The subresources to transition, or nullptr for the entire resource.
+            \param[out] transitions The transitions to record in the command list are appended to it.
+        */
+        void transition(const Resource* pResource, Resource::State newState, const ResourceViewInfo* pViewInfo, std::vector<Transition>& transitions);
+
+        /** Compare the expected states with the global states and commit the final states to the resources. Clears the tracker.
+            \param[out] fixups The transitions that must execute before the command list are appended to it.
+        */
+        void resolve(std::vector<Transition>& fixups);
+
+        /** Drop all the tracked states without committing them
+        */
+        void reset() { mEntries.clear(); }
+
+        bool isEmpty() const { return mEntries.empty(); }
+
+    private:
+        ResourceStateTracker() = default;
+
+        std::unordered_map<const Resource*, SubresourceStates> mEntries;
+        std::vector<SubresourceStates::Transition> mScratch;
+        std::vector<uint32_t> mGlobalStates;
+    };
+}
@@ -0,0 +1,46 @@
+#include <cassert>
+#include <stdexcept>
+#include "RingAllocator.h"
+
+namespace WIP3D
+{
+    RingAllocator::SharedPtr RingAllocator::create(uint64_t capacity)
+    {
+        if (capacity == 0) throw std::invalid_argument("RingAllocator::create() - capacity must be greater than 0");
+        return SharedPtr(new RingAllocator(capacity));
+    }
+
+    uint64_t RingAllocator::allocate(uint64_t size, uint64_t alignment, uint64_t fenceValue)
+    {
+        assert(size > 0 && alignment > 0);
+        assert(mFrames.empty() || mFrames.back().fenceValue <= fenceValue);
+        if (size > mCapacity) return kInvalidOffset;
+
+        uint64_t offset = ((mHead + alignment - 1) / alignment) * alignment;
+        if (offset > mCapacity - size)
+        {
+            // Not enough room until the end of the ring, skip the tail and wrap around
+            offset = 0;
+        }
+        uint64_t consumed = (offset >= mHead) ? (offset + size - mHead) : (mCapacity - mHead + size);
+        if (consumed > mCapacity - mUsedSize) return kInvalidOffset;
+
+        if (mFrames.empty() || mFrames.back().fenceValue != fenceValue) mFrames.push_back({ fenceValue, 0 });
+        mFrames.back().size += consumed;
+        mUsedSize += consumed;
+        mHead = offset + size;
+        return offset;
+    }
+
+    void RingAllocator::retire(uint64_t completedValue)
+    {
+        while (mFrames.size() && mFrames.front().fenceValue <= completedValue)
+        {
+            mUsedSize -= mFrames.front().size;
+            mFrames.pop_front();
+        }
+
+        // The ring is empty, restart from the beginning so the next range doesn't skip a tail
+        if (mUsedSize == 0) mHead = 0;
+    }
+}
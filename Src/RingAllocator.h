@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace WIP3D
+{
+    /** Ring-buffer range allocator, the bookkeeping behind GpuMemoryHeap's Ring mode.
+        Manages offsets inside a ring of `capacity` units and doesn't touch any memory itself, so it has no graphics API dependencies.
+        Allocations are tagged with the fence value they retire with and can't be released one by one. retire() reclaims every frame the GPU finished in bulk.
+        allocate() is O(1) and retire() is O(1) per frame. There is no per-allocation bookkeeping, only one entry per fence value.
+    */
+    class RingAllocator
+    {
+    public:
+        using SharedPtr = std::shared_ptr<RingAllocator>;
+        using SharedConstPtr = std::shared_ptr<const RingAllocator>;
+
+        static const uint64_t kInvalidOffset = (uint64_t)-1;
+
+        /** Create a new allocator.
+            \param[in] capacity Size of the ring.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint64_t capacity);
+
+        /** Allocate a range. A range never wraps around the end of the ring, the tail is skipped instead.
+            \param[in] size Size of the range, must be greater than 0.
+            \param[in] alignment Alignment of the returned offset.
+            \param[in] fenceValue The fence value the range retires with. Must not decrease between calls.
+            \return The offset of the range, or kInvalidOffset if the ring is full. Retire the finished frames and try again.
+        */
+        uint64_t allocate(uint64_t size, uint64_t alignment, uint64_t fenceValue);
+
+        /** Reclaim the ranges of every fence value up to completedValue
+        */
+        void retire(uint64_t completedValue);
+
+        uint64_t getCapacity() const { return mCapacity; }
+
+        /** Get the size of the live ranges, including the skipped tails and alignment padding
+        */
+        uint64_t getUsedSize() const { return mUsedSize; }
+
+    private:
+        RingAllocator(uint64_t capacity) : mCapacity(capacity) {}
+
+        // Space consumed while the fence was at a given value
+        struct Frame
+        {
+            uint64_t fenceValue;
+            uint64_t size;
+        };
+
+        uint64_t mCapacity;
+        uint64_t mHead = 0;         // The live region ends here and is mUsedSize units long
+        uint64_t mUsedSize = 0;
+        std::deque<Frame> mFrames;
+    };
+}
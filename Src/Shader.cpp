@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "Common/Logger.h"
+#include "Shader.h"
+#include "WorkerPool.h"
+
+namespace WIP3D
+{
+    IDxcLibrary* D3DShaderCompiler::library = nullptr;
+    IDxcCompiler* D3DShaderCompiler::compiler = nullptr;
+    ShaderCache::SharedPtr D3DShaderCompiler::spCache;
+
+    namespace
+    {
+        uint32_t getCompilerVersion(IDxcCompiler* pCompiler)
+        {
+            ComPtr<IDxcVersionInfo> pVersionInfo;
+            if (FAILED(pCompiler->QueryInterface(IID_PPV_ARGS(pVersionInfo.writeRef())))) return 0;
+            UINT32 major = 0, minor = 0;
+            pVersionInfo->GetVersion(&major, &minor);
+            return (major << 16) | minor;
+        }
+    }
+
+    bool D3DShaderCompiler::compile(const wchar_t* name, const wchar_t* entry_point, const wchar_t* target_profile, std::vector<uint8_t>& bytecode, const std::vector<DxcDefine>& defines, const std::vector<LPCWSTR>& arguments)
+    {
+        return compileWith(library, compiler, name, entry_point, target_profile, bytecode, defines, arguments);
+    }
+
+    bool D3DShaderCompiler::compileWith(IDxcLibrary* pLibrary, IDxcCompiler* pCompiler, const wchar_t* name, const wchar_t* entry_point, const wchar_t* target_profile, std::vector<uint8_t>& bytecode, const std::vector<DxcDefine>& defines, const std::vector<LPCWSTR>& arguments)
+    {
+        uint32_t codePage = CP_UTF8;
+        ComPtr<IDxcBlobEncoding> pSource;
+        HRESULT hr = pLibrary->CreateBlobFromFile(name, &codePage, pSource.writeRef());
+        if (FAILED(hr))
+        {
+            _bstr_t nam_(name);
+            g_logger->debug_print(WIP_ERROR, "cannt open shader file %s .", (const char*)nam_);
+            return false;
+        }
+
+        ComPtr<IDxcIncludeHandler> pIncludeHandler;
+        pLibrary->CreateIncludeHandler(pIncludeHandler.writeRef());
+        LPCWSTR* pArguments = const_cast<LPCWSTR*>(arguments.data());
+
+        // The key uses the preprocessed source, so editing an included file invalidates the blob
+        uint64_t key = 0;
+        bool hasKey = false;
+        if (spCache)
+        {
+            ComPtr<IDxcOperationResult> pPreprocessed;
+            ComPtr<IDxcBlob> pPreprocessedSource;
+            hr = pCompiler->Preprocess(pSource, name, pArguments, (UINT32)arguments.size(), defines.data(), (UINT32)defines.size(), pIncludeHandler, pPreprocessed.writeRef());
+            if (SUCCEEDED(hr)) pPreprocessed->GetStatus(&hr);
+            if (SUCCEEDED(hr)) hr = pPreprocessed->GetResult(pPreprocessedSource.writeRef());
+
+            // A preprocessing error fails the compilation below, which reports it
+            if (SUCCEEDED(hr))
+            {
+                ShaderCache::KeyDesc keyDesc;
+                keyDesc.pSource = pPreprocessedSource->GetBufferPointer();
+                keyDesc.sourceSize = pPreprocessedSource->GetBufferSize();
+                keyDesc.entryPoint = entry_point;
+                keyDesc.targetProfile = target_profile;
+                for (const auto& define : defines) keyDesc.defines.push_back(std::wstring(define.Name) + L"=" + (define.Value ? define.Value : L""));
+                for (const auto& argument : arguments) keyDesc.arguments.push_back(argument);
+                keyDesc.compilerVersion = getCompilerVersion(pCompiler);
+                key = ShaderCache::computeKey(keyDesc);
+                hasKey = true;
+                if (spCache->find(key, bytecode)) return true;
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        ComPtr<IDxcOperationResult> pResult;
+        hr = pCompiler->Compile(pSource, name, entry_point, target_profile, pArguments, (UINT32)arguments.size(), defines.data(), (UINT32)defines.size(), pIncludeHandler, pResult.writeRef());
+        if (FAILED(hr)) return false;
+
+        pResult->GetStatus(&hr);
+        if (FAILED(hr))
+        {
+            ComPtr<IDxcBlobEncoding> pErrors;
+            if (SUCCEEDED(pResult->GetErrorBuffer(pErrors.writeRef())) && pErrors)
+            {
+                wprintf(L"Compilation failed with errors:\n%hs\n", (const char*)pErrors->GetBufferPointer());
+            }
+            return false;
+        }
+
+        ComPtr<IDxcBlob> pCode;
+        if (FAILED(pResult->GetResult(pCode.writeRef())) || pCode == nullptr) return false;
+        const uint8_t* pBytes = (const uint8_t*)pCode->GetBufferPointer();
+        bytecode.assign(pBytes, pBytes + pCode->GetBufferSize());
+
+        double compileTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (hasKey) spCache->store(key, bytecode.data(), bytecode.size(), compileTime);
+        return true;
+    }
+
+    uint32_t D3DShaderCompiler::compileBatch(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool, std::vector<BatchResult>& results)
+    {
+        return runBatch(entries, permutations, pPool, &results);
+    }
+
+    uint32_t D3DShaderCompiler::precompile(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool)
+    {
+        if (spCache == nullptr) LOG_WARN("D3DShaderCompiler::precompile() - there's no shader cache, the shaders will be compiled again when they are used");
+
+        ShaderCache::Stats startStats = spCache ? spCache->getStats() : ShaderCache::Stats();
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t failedCount = runBatch(entries, permutations, pPool, nullptr);
+        double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        ShaderCache::Stats stats = spCache ? spCache->getStats() : ShaderCache::Stats();
+        LOG_INFO("D3DShaderCompiler::precompile() - %u shaders in %.1f ms, %llu were already cached, %u failed",
+            (uint32_t)(entries.size() * std::max<size_t>(permutations.size(), 1)), time, stats.hitCount - startStats.hitCount, failedCount);
+        return failedCount;
+    }
+
+    uint32_t D3DShaderCompiler::runBatch(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool, std::vector<BatchResult>* pResults)
+    {
+        // No permutations means one compilation without defines per entry
+        const Permutation kNoDefines;
+        const size_t permutationCount = std::max<size_t>(permutations.size(), 1);
+        const uint32_t taskCount = (uint32_t)(entries.size() * permutationCount);
+        if (pResults) pResults->assign(taskCount, BatchResult());
+
+        struct Instance
+        {
+            ComPtr<IDxcLibrary> pLibrary;
+            ComPtr<IDxcCompiler> pCompiler;
+        };
+        std::mutex instanceMutex;
+        std::vector<Instance> freeInstances;
+        std::atomic<uint32_t> failedCount(0);
+
+        auto task = [&](uint32_t index)
+        {
+            const BatchEntry& entry = entries[index / permutationCount];
+            const Permutation& permutation = permutations.empty() ? kNoDefines : permutations[index % permutationCount];
+
+            // A thread only takes an instance while it runs a task, so there are never more instances than threads
+            Instance instance;
+            {
+                std::lock_guard<std::mutex> lock(instanceMutex);
+                if (freeInstances.size())
+                {
+                    instance = std::move(freeInstances.back());
+                    freeInstances.pop_back();
+                }
+            }
+            if (instance.pCompiler == nullptr)
+            {
+                if (FAILED(DxcCreateInstance(CLSID_DxcLibrary, IID_PPV_ARGS(instance.pLibrary.writeRef()))) || FAILED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(instance.pCompiler.writeRef()))))
+                {
+                    LOG_ERROR("D3DShaderCompiler::compileBatch() - can't create a dxc compiler instance");
+                    failedCount++;
+                    return;
+                }
+            }
+
+            std::vector<DxcDefine> defines;
+            for (const auto& define : permutation) defines.push_back({ define.first.c_str(), define.second.empty() ? nullptr : define.second.c_str() });
+            std::vector<LPCWSTR> arguments;
+            for (const auto& argument : entry.arguments) arguments.push_back(argument.c_str());
+
+            std::vector<uint8_t> bytecode;
+            std::vector<uint8_t>& dst = pResults ? (*pResults)[index].bytecode : bytecode;
+            bool success = compileWith(instance.pLibrary, instance.pCompiler, entry.file.c_str(), entry.entryPoint.c_str(), entry.targetProfile.c_str(), dst, defines, arguments);
+            if (pResults) (*pResults)[index].success = success;
+            if (success == false) failedCount++;
+
+            std::lock_guard<std::mutex> lock(instanceMutex);
+            freeInstances.push_back(std::move(instance));
+        };
+
+        if (pPool) pPool->parallelFor(taskCount, task);
+        else for (uint32_t i = 0; i < taskCount; i++) task(i);
+        return failedCount;
+    }
+}
@@ -8,11 +8,15 @@
 #include <initializer_list>
 #include <string>
 #include <iostream>
+#include <vector>
+#include "ShaderCache.h"
 
 struct ISlangBlob;
 
 namespace WIP3D
 {
+    class WorkerPool;
+
     /** Minimal smart pointer for working with COM objects.
     */
     template<typename T>
@@ -109,7 +113,7 @@ namespace WIP3D
         T* mpObject;
     };
 
-    void test()
+    inline void test()
     {
         IDxcLibrary* library;
         HRESULT hr = DxcCreateInstance(CLSID_DxcLibrary, IID_PPV_ARGS(&library));
@@ -197,73 +201,54 @@ namespace WIP3D
         }
 
     public:
-
-        static bool compile(const wchar_t* name, const wchar_t* entry_point, const wchar_t* target_profile)
+        /** A shader file and entry point, compiled with every permutation of a batch
+        */
+        struct BatchEntry
         {
-            uint32_t codePage = CP_UTF8;
-            IDxcBlobEncoding* sourceBlob = nullptr;
-            HRESULT hr = library->CreateBlobFromFile(name, &codePage, &sourceBlob);
-            if (FAILED(hr))
-            {
-                if (sourceBlob)
-                {
-                    sourceBlob->Release();
-                    sourceBlob = nullptr;
-                }
-                _bstr_t nam_(name);
-                g_logger->debug_print(WIP_ERROR, "cannt open shader file %s .", nam_);
-                return false;
-            }
+            std::wstring file;
+            std::wstring entryPoint;
+            std::wstring targetProfile;
+            std::vector<std::wstring> arguments;
+        };
 
-            IDxcOperationResult* result;
-            hr = compiler->Compile(
-                sourceBlob, // pSource
-                name, // pSourceName
-                entry_point, // pEntryPoint
-                target_profile, // pTargetProfile
-                NULL, 0, // pArguments, argCount
-                NULL, 0, // pDefines, defineCount
-                NULL, // pIncludeHandler
-                &result); // ppResult
-            if (SUCCEEDED(hr))
-                result->GetStatus(&hr);
-            else
-            {
-                return false;
-            }
-            if (FAILED(hr))
-            {
-                if (result)
-                {
-                    IDxcBlobEncoding* errorsBlob;
-                    hr = result->GetErrorBuffer(&errorsBlob);
-                    if (SUCCEEDED(hr) && errorsBlob)
-                    {
-                        wprintf(L"Compilation failed with errors:\n%hs\n",
-                            (const char*)errorsBlob->GetBufferPointer());
-                        errorsBlob->Release();
-                        return false;
-                    }
-                }
-                // Handle compilation error...
-            }
-            IDxcBlob* code;
-            result->GetResult(&code);
-
-            D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-            // (...)
-            psoDesc.PS.BytecodeLength = code->GetBufferSize();
-            psoDesc.PS.pShaderBytecode = code->GetBufferPointer();
-            ComPtr<ID3D12PipelineState> pso;
-            //hr = device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso));
-
-            code->Release();
-            code = nullptr;
-            result->Release();
-            result = nullptr;
-        }
+        /** Macro definitions as name/value pairs. An empty value defines the macro without a value.
+        */
+        using Permutation = std::vector<std::pair<std::wstring, std::wstring>>;
 
-        static bool load_compiler()
+        struct BatchResult
+        {
+            bool success = false;
+            std::vector<uint8_t> bytecode;
+        };
+
+        /** Compile a shader file.
+            If a ShaderCache is set, the file is preprocessed first, and the cache is looked up with the preprocessed source, the entry point, the profile, the defines, the arguments and the compiler version. A hit skips the compiler.
+            \param[in] name The source file.
+            \param[out] bytecode The compiled shader.
+            \return false if the file can't be opened or doesn't compile, true otherwise.
+        */
+        static bool compile(const wchar_t* name, const wchar_t* entry_point, const wchar_t* target_profile, std::vector<uint8_t>& bytecode, const std::vector<DxcDefine>& defines = {}, const std::vector<LPCWSTR>& arguments = {});
+
+        /** Compile every entry with every permutation, in parallel.
+            DXC compiler instances can't be used by two threads at once, so each thread takes its own instance from a free list. At most one instance per pool thread is created, and they are released before returning.
+            The results go through the ShaderCache, like compile().
+            \param[in] permutations The permutations to compile each entry with. If empty, each entry is compiled once without defines.
+            \param[in] pPool The pool running the compilations. If nullptr, they run on the calling thread.
+            \param[out] results One result per pair, entries[e] compiled with permutations[p] is in results[e * permutations.size() + p].
+            \return The number of compilations that failed.
+        */
+        static uint32_t compileBatch(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool, std::vector<BatchResult>& results);
+
+        /** Warm the ShaderCache with every entry and permutation, before the first frame.
+            Same as compileBatch(), but the bytecode is dropped once it's in the cache, so the later compile() calls are hits. The time and the number of hits are logged.
+            \return The number of compilations that failed.
+        */
+        static uint32_t precompile(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool);
+
+        /** Load the compiler.
+            \param[in] cachePath The shader cache store, see ShaderCache::create(). If empty, shaders are always compiled.
+        */
+        static bool load_compiler(const std::string& cachePath = "ShaderCache")
         {
             library = nullptr;
             compiler = nullptr;
@@ -273,13 +258,14 @@ namespace WIP3D
                 g_logger->debug_print(WIP_ERROR, "Can't create dxc library instance.");
                 return false;
             }
-            HRESULT hr = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
+            hr = DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
             if (FAILED(hr))
             {
                 g_logger->debug_print(WIP_ERROR, "Can't create dxc compiler instance.");
                 library->Release();
                 return false;
             }
+            spCache = cachePath.empty() ? nullptr : ShaderCache::create(cachePath);
             return true;
         }
 
@@ -295,9 +281,17 @@ namespace WIP3D
                 compiler->Release();
                 compiler = nullptr;
             }
+            spCache = nullptr;
         }
 
+        static const ShaderCache::SharedPtr& getCache() { return spCache; }
+
         static IDxcLibrary* library;
         static IDxcCompiler* compiler;
+        static ShaderCache::SharedPtr spCache;
+
+    private:
+        static bool compileWith(IDxcLibrary* pLibrary, IDxcCompiler* pCompiler, const wchar_t* name, const wchar_t* entry_point, const wchar_t* target_profile, std::vector<uint8_t>& bytecode, const std::vector<DxcDefine>& defines, const std::vector<LPCWSTR>& arguments);
+        static uint32_t runBatch(const std::vector<BatchEntry>& entries, const std::vector<Permutation>& permutations, WorkerPool* pPool, std::vector<BatchResult>* pResults);
     };
 }
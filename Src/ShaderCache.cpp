@@ -0,0 +1,201 @@
+#include <cstring>
+#include "Common.h"
+#include "Common/Logger.h"
+#include "ShaderCache.h"
+#include "StableHash.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        const uint32_t kIndexMagic = 0x53504957;   // 'WIPS'
+        const uint32_t kIndexVersion = 1;
+        const uint32_t kIndexHeader[] = { kIndexMagic, kIndexVersion };
+    }
+
+    ShaderCache::SharedPtr ShaderCache::create(const std::string& path)
+    {
+        return SharedPtr(new ShaderCache(path));
+    }
+
+    ShaderCache::ShaderCache(const std::string& path)
+        : mPath(path)
+    {
+        static_assert(sizeof(IndexRecord) == 24, "IndexRecord is written to disk as-is, it can't have padding");
+        if (mPath.size() && openStore() == false)
+        {
+            LOG_WARN(("ShaderCache - can't open " + mPath + ", shaders will only be cached in memory").c_str());
+            closeStore();
+        }
+    }
+
+    ShaderCache::~ShaderCache()
+    {
+        closeStore();
+    }
+
+    bool ShaderCache::openStore()
+    {
+        // Only one process can write to the store, the others fall back to memory
+        mDataFile = CreateFileA((mPath + ".bin").c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mDataFile == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(mDataFile, &fileSize) == FALSE) return false;
+        mDataSize = (uint64_t)fileSize.QuadPart;
+
+        std::vector<uint8_t> index;
+        {
+            std::ifstream fin(mPath + ".idx", std::ios::binary);
+            if (fin.is_open()) index.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        }
+
+        // Without a matching index the blobs can't be found, start over
+        if (index.size() < sizeof(kIndexHeader) || std::memcmp(index.data(), kIndexHeader, sizeof(kIndexHeader)) != 0)
+        {
+            if (resetStore() == false) return false;
+            mIndexFile.open(mPath + ".idx", std::ios::binary | std::ios::app);
+            return mIndexFile.is_open();
+        }
+
+        // Drop the records that point past the end of the blob file, and a partially written last record
+        size_t recordsSize = index.size() - sizeof(kIndexHeader);
+        bool dropped = (recordsSize % sizeof(IndexRecord)) != 0;
+        for (size_t i = 0; i < recordsSize / sizeof(IndexRecord); i++)
+        {
+            IndexRecord record;
+            std::memcpy(&record, index.data() + sizeof(kIndexHeader) + i * sizeof(IndexRecord), sizeof(IndexRecord));
+            if (record.offset + record.size > mDataSize)
+            {
+                dropped = true;
+                continue;
+            }
+            Entry& entry = mEntries[record.key];
+            entry.offset = record.offset;
+            entry.size = record.size;
+            entry.compileTime = record.compileTime;
+        }
+
+        if (mDataSize)
+        {
+            mMapping = CreateFileMappingA(mDataFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mMapping) mpMappedData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+            if (mpMappedData == nullptr) return false;
+            mMappedSize = mDataSize;
+        }
+
+        // Rewrite the index, so new records don't follow a partial one
+        if (dropped)
+        {
+            std::ofstream fout(mPath + ".idx", std::ios::binary | std::ios::trunc);
+            fout.write((const char*)kIndexHeader, sizeof(kIndexHeader));
+            for (const auto& e : mEntries)
+            {
+                IndexRecord record = { e.first, e.second.offset, e.second.size, e.second.compileTime };
+                fout.write((const char*)&record, sizeof(record));
+            }
+            if (fout.good() == false) return false;
+        }
+
+        for (const auto& e : mEntries) mStats.storedSize += e.second.size;
+        mIndexFile.open(mPath + ".idx", std::ios::binary | std::ios::app);
+        return mIndexFile.is_open();
+    }
+
+    bool ShaderCache::resetStore()
+    {
+        mEntries.clear();
+        LARGE_INTEGER zero = {};
+        if (SetFilePointerEx(mDataFile, zero, nullptr, FILE_BEGIN) == FALSE || SetEndOfFile(mDataFile) == FALSE) return false;
+        mDataSize = 0;
+
+        std::ofstream fout(mPath + ".idx", std::ios::binary | std::ios::trunc);
+        fout.write((const char*)kIndexHeader, sizeof(kIndexHeader));
+        return fout.good();
+    }
+
+    void ShaderCache::closeStore()
+    {
+        // The blobs that aren't in memory go away with the mapping
+        for (auto it = mEntries.begin(); it != mEntries.end();)
+        {
+            if (it->second.data.empty()) it = mEntries.erase(it);
+            else ++it;
+        }
+        if (mpMappedData) UnmapViewOfFile(mpMappedData);
+        mpMappedData = nullptr;
+        mMappedSize = 0;
+        if (mMapping) CloseHandle(mMapping);
+        if (mDataFile != INVALID_HANDLE_VALUE) CloseHandle(mDataFile);
+        mMapping = nullptr;
+        mDataFile = INVALID_HANDLE_VALUE;
+        mIndexFile.close();
+    }
+
+    uint64_t ShaderCache::computeKey(const KeyDesc& desc)
+    {
+        StableHash hash;
+        hash.add((uint64_t)desc.sourceSize).add(desc.pSource, desc.sourceSize);
+        hash.addString(desc.entryPoint).addString(desc.targetProfile);
+        hash.add((uint64_t)desc.defines.size());
+        for (const auto& define : desc.defines) hash.addString(define);
+        hash.add((uint64_t)desc.arguments.size());
+        for (const auto& argument : desc.arguments) hash.addString(argument);
+        hash.add(desc.compilerVersion);
+        return hash.get();
+    }
+
+    bool ShaderCache::find(uint64_t key, std::vector<uint8_t>& blob)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.lookupCount++;
+        auto it = mEntries.find(key);
+        if (it == mEntries.end()) return false;
+
+        const Entry& entry = it->second;
+        const uint8_t* pData = entry.data.size() ? entry.data.data() : mpMappedData + entry.offset;
+        blob.assign(pData, pData + entry.size);
+        mStats.hitCount++;
+        mStats.savedTime += entry.compileTime;
+        return true;
+    }
+
+    void ShaderCache::store(uint64_t key, const void* pData, size_t size, double compileTime)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mEntries.find(key) != mEntries.end()) return;
+
+        Entry& entry = mEntries[key];
+        entry.offset = 0;
+        entry.size = (uint32_t)size;
+        entry.compileTime = (float)compileTime;
+        entry.data.assign((const uint8_t*)pData, (const uint8_t*)pData + size);
+        mStats.storedSize += size;
+        mStats.compileTime += compileTime;
+        if (mDataFile == INVALID_HANDLE_VALUE) return;
+
+        // A failed write leaves at most some garbage past mDataSize, which the next blob overwrites
+        LARGE_INTEGER offset;
+        offset.QuadPart = (LONGLONG)mDataSize;
+        DWORD written = 0;
+        if (SetFilePointerEx(mDataFile, offset, nullptr, FILE_BEGIN) == FALSE || WriteFile(mDataFile, pData, (DWORD)size, &written, nullptr) == FALSE || written != size)
+        {
+            LOG_WARN("ShaderCache::store() - can't write the blob, it will only be cached in memory");
+            return;
+        }
+
+        IndexRecord record = { key, mDataSize, (uint32_t)size, (float)compileTime };
+        mIndexFile.write((const char*)&record, sizeof(record));
+        mIndexFile.flush();
+        entry.offset = mDataSize;
+        mDataSize += size;
+    }
+
+    ShaderCache::Stats ShaderCache::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Stats stats = mStats;
+        stats.entryCount = (uint32_t)mEntries.size();
+        return stats;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "windows.h"
+
+namespace WIP3D
+{
+    /** Content-addressed cache of compiled shader blobs.
+        Blobs are keyed by a hash of everything that affects the compiler output, see computeKey(). A hit returns the blob without invoking the compiler.
+        The store is two files: '<path>.bin' holds the blobs back to back, and '<path>.idx' holds one fixed-size record per blob (key, offset, size, compile time).
+        At startup, the index is read into a hash map and the blob file is memory-mapped. New blobs are appended to both files. The index record is only written after its blob, so an interrupted write can't produce a record that points to garbage.
+        If the files can't be opened, for example because another process uses them, the cache only lives in memory.
+        All functions are thread-safe.
+    */
+    class ShaderCache
+    {
+    public:
+        using SharedPtr = std::shared_ptr<ShaderCache>;
+        using SharedConstPtr = std::shared_ptr<const ShaderCache>;
+
+        struct Stats
+        {
+            uint64_t lookupCount = 0;
+            uint64_t hitCount = 0;
+            uint32_t entryCount = 0;
+            uint64_t storedSize = 0;    ///< Total size of the blobs
+            double compileTime = 0;     ///< Time spent compiling the blobs stored during this run, in ms
+            double savedTime = 0;       ///< Compile time of the blobs that were hit, as recorded when they were stored, in ms
+
+            float getHitRate() const { return lookupCount ? (float)hitCount / (float)lookupCount : 0.0f; }
+        };
+
+        /** Everything that affects the compiler output
+        */
+        struct KeyDesc
+        {
+            const void* pSource = nullptr;      ///< The preprocessed source, so the key changes when an included file does
+            size_t sourceSize = 0;
+            std::wstring entryPoint;
+            std::wstring targetProfile;
+            std::vector<std::wstring> defines;  ///< 'NAME=VALUE' strings, in the order they are passed to the compiler
+            std::vector<std::wstring> arguments;
+            uint32_t compilerVersion = 0;       ///< So a compiler update doesn't return stale blobs
+        };
+
+        /** Create a new cache.
+            \param[in] path Path of the store, without extension. If empty, the cache only lives in memory.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(const std::string& path);
+        ~ShaderCache();
+
+        static uint64_t computeKey(const KeyDesc& desc);
+
+        /** Look up a blob.
+            \param[in] key The key, see computeKey().
+            \param[out] blob The blob, if found.
+            \return true on a hit, false otherwise.
+        */
+        bool find(uint64_t key, std::vector<uint8_t>& blob);
+
+        /** Add a blob. Does nothing if the key is already in the cache.
+            \param[in] key The key, see computeKey().
+            \param[in] compileTime How long the compilation took, in ms. Hits on this blob add it to Stats::savedTime.
+        */
+        void store(uint64_t key, const void* pData, size_t size, double compileTime);
+
+        Stats getStats() const;
+        const std::string& getPath() const { return mPath; }
+
+    private:
+        ShaderCache(const std::string& path);
+        bool openStore();
+        bool resetStore();
+        void closeStore();
+
+        struct IndexRecord
+        {
+            uint64_t key;
+            uint64_t offset;
+            uint32_t size;
+            float compileTime;
+        };
+
+        struct Entry
+        {
+            uint64_t offset;
+            uint32_t size;
+            float compileTime;
+            std::vector<uint8_t> data;  // Only used by the blobs stored during this run, the others are read from the mapping
+        };
+
+        std::string mPath;
+        HANDLE mDataFile = INVALID_HANDLE_VALUE;
+        HANDLE mMapping = nullptr;
+        const uint8_t* mpMappedData = nullptr;
+        uint64_t mMappedSize = 0;
+        uint64_t mDataSize = 0;
+        std::ofstream mIndexFile;
+
+        mutable std::mutex mMutex;
+        std::unordered_map<uint64_t, Entry> mEntries;
+        Stats mStats;
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace WIP3D
+{
+    /** 64-bit FNV-1a hash builder.
+        Unlike std::hash, the result only depends on the bytes that were added, so it's the same on every run and can be used for keys that are persisted to disk.
+        Never add pointers or structs with padding, hash the fields one by one instead.
+    */
+    class StableHash
+    {
+    public:
+        StableHash& add(const void* pData, size_t size)
+        {
+            const uint8_t* pBytes = (const uint8_t*)pData;
+            for (size_t i = 0; i < size; i++)
+            {
+                mValue ^= pBytes[i];
+                mValue *= kPrime;
+            }
+            return *this;
+        }
+
+        template<typename T>
+        StableHash& add(const T& value)
+        {
+            static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "StableHash::add() - only scalar values can be hashed directly");
+            return add(&value, sizeof(T));
+        }
+
+        /** Add a string. The length is hashed too, so consecutive strings can't alias. nullptr is hashed like an empty string.
+        */
+        StableHash& addString(const char* str)
+        {
+            size_t length = str ? strlen(str) : 0;
+            add((uint64_t)length);
+            return add(str, length);
+        }
+
+        StableHash& addString(const std::string& str)
+        {
+            add((uint64_t)str.size());
+            return add(str.data(), str.size());
+        }
+
+        StableHash& addString(const std::wstring& str)
+        {
+            add((uint64_t)str.size());
+            return add(str.data(), str.size() * sizeof(wchar_t));
+        }
+
+        uint64_t get() const { return mValue; }
+
+    private:
+        static const uint64_t kOffsetBasis = 0xcbf29ce484222325ull;
+        static const uint64_t kPrime = 0x100000001b3ull;
+        uint64_t mValue = kOffsetBasis;
+    };
+}
@@ -0,0 +1,89 @@
+#include <cassert>
+#include "SubresourceStates.h"
+
+namespace WIP3D
+{
+    SubresourceStates::SubresourceStates(uint32_t mipCount, uint32_t arraySize)
+        : mMipCount(mipCount)
+        , mFirst(mipCount * arraySize, (uint32_t)kUndefined)
+        , mCurrent(mipCount * arraySize, (uint32_t)kUndefined)
+    {
+        assert(mipCount > 0 && arraySize > 0);
+    }
+
+    void SubresourceStates::transition(uint32_t newState, const Range* pRange, std::vector<Transition>& transitions)
+    {
+        assert(newState != kUndefined);
+        uint32_t subresourceCount = getSubresourceCount();
+        size_t firstTransition = transitions.size();
+        uint32_t changedCount = 0;
+        bool uniformBefore = true;
+        for (uint32_t i = 0; i < subresourceCount; i++)
+        {
+            if (pRange)
+            {
+                uint32_t mipLevel = i % mMipCount;
+                uint32_t arraySlice = i / mMipCount;
+                if (mipLevel - pRange->mostDetailedMip >= pRange->mipCount || mipLevel < pRange->mostDetailedMip) continue;
+                if (arraySlice - pRange->firstArraySlice >= pRange->arraySize || arraySlice < pRange->firstArraySlice) continue;
+            }
+
+            // First use, the fix-ups make sure the subresource is in this state when the list starts
+            if (mFirst[i] == kUndefined)
+            {
+                mFirst[i] = newState;
+                mCurrent[i] = newState;
+                continue;
+            }
+            if (mCurrent[i] == newState) continue;
+
+            uniformBefore = uniformBefore && (changedCount == 0 || mCurrent[i] == transitions.back().before);
+            transitions.push_back({ i, mCurrent[i], newState });
+            mCurrent[i] = newState;
+            changedCount++;
+        }
+
+        if (changedCount == subresourceCount && uniformBefore)
+        {
+            uint32_t before = transitions.back().before;
+            transitions.resize(firstTransition);
+            transitions.push_back({ kAllSubresources, before, newState });
+        }
+    }
+
+    void SubresourceStates::getFixups(const uint32_t* pBeforeStates, std::vector<Transition>& fixups) const
+    {
+        uint32_t subresourceCount = getSubresourceCount();
+        size_t firstFixup = fixups.size();
+        uint32_t changedCount = 0;
+        bool uniformBefore = true;
+        bool uniformAfter = true;
+        for (uint32_t i = 0; i < subresourceCount; i++)
+        {
+            if (mFirst[i] == kUndefined || mFirst[i] == pBeforeStates[i]) continue;
+            if (changedCount)
+            {
+                uniformBefore = uniformBefore && pBeforeStates[i] == fixups.back().before;
+                uniformAfter = uniformAfter && mFirst[i] == fixups.back().after;
+            }
+            fixups.push_back({ i, pBeforeStates[i], mFirst[i] });
+            changedCount++;
+        }
+
+        if (changedCount == subresourceCount && uniformBefore && uniformAfter)
+        {
+            Transition all = { kAllSubresources, fixups.back().before, fixups.back().after };
+            fixups.resize(firstFixup);
+            fixups.push_back(all);
+        }
+    }
+
+    bool SubresourceStates::isFinalStateUniform() const
+    {
+        for (uint32_t i = 0; i < getSubresourceCount(); i++)
+        {
+            if (mFirst[i] == kUndefined || mCurrent[i] != mCurrent[0]) return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace WIP3D
+{
+    /** The states of one resource's subresources inside a command list, the bookkeeping behind ResourceStateTracker.
+        Each subresource has the state it's expected to be in when the list starts executing (its first use) and the state it's currently in. States are opaque values, kUndefined marks a subresource the list hasn't used yet.
+        The subresource index is mip + arraySlice * mipCount, like Texture::getSubresourceIndex(). The class has no graphics API dependencies.
+    */
+    class SubresourceStates
+    {
+    public:
+        static const uint32_t kUndefined = 0;
+        static const uint32_t kAllSubresources = (uint32_t)-1;
+
+        struct Transition
+        {
+            uint32_t subresource;   ///< Subresource index, or kAllSubresources
+            uint32_t before;
+            uint32_t after;
+        };
+
+        /** A range of mips and array slices
+        */
+        struct Range
+        {
+            uint32_t mostDetailedMip;
+            uint32_t mipCount;
+            uint32_t firstArraySlice;
+            uint32_t arraySize;
+        };
+
+        SubresourceStates(uint32_t mipCount = 1, uint32_t arraySize = 1);
+
+        /** Move subresources to a new state.
+            Subresources used for the first time don't need a transition, the state is recorded as their expected state instead.
+            \param[in] newState The new state, can't be kUndefined.
+            \param[in] pRange The subresources to transition, or nullptr for all of them.
+            \param[out] transitions The transitions are appended to it. When the entire resource moves from one state, they are collapsed to a single kAllSubresources transition.
+        */
+        void transition(uint32_t newState, const Range* pRange, std::vector<Transition>& transitions);
+
+        /** Get the transitions from the states the subresources are in before the command list to the states the list expects.
+            \param[in] pBeforeStates The state of each subresource before the list.
+            \param[out] fixups The transitions are appended to it, collapsed like in transition(). Subresources the list doesn't use are left alone.
+        */
+        void getFixups(const uint32_t* pBeforeStates, std::vector<Transition>& fixups) const;
+
+        /** Check if the list uses every subresource and leaves all of them in the same state
+        */
+        bool isFinalStateUniform() const;
+
+        uint32_t getSubresourceCount() const { return (uint32_t)mCurrent.size(); }
+        uint32_t getMipCount() const { return mMipCount; }
+        bool isUsed(uint32_t subresource) const { return mFirst[subresource] != kUndefined; }
+        uint32_t getFirstState(uint32_t subresource) const { return mFirst[subresource]; }
+        uint32_t getCurrentState(uint32_t subresource) const { return mCurrent[subresource]; }
+
+    private:
+        uint32_t mMipCount;
+        std::vector<uint32_t> mFirst;
+        std::vector<uint32_t> mCurrent;
+    };
+}
@@ -0,0 +1,289 @@
+#include <cassert>
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "TLSFAllocator.h"
+
+namespace WIP3D
+{
+    namespace
+    {
+        uint32_t findMSB(uint64_t v)
+        {
+            assert(v);
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse64(&index, v);
+            return (uint32_t)index;
+#else
+            return 63 - (uint32_t)__builtin_clzll(v);
+#endif
+        }
+
+        uint32_t findLSB(uint64_t v)
+        {
+            assert(v);
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, v);
+            return (uint32_t)index;
+#else
+            return (uint32_t)__builtin_ctzll(v);
+#endif
+        }
+    }
+
+    TLSFAllocator::SharedPtr TLSFAllocator::create(uint64_t capacity, uint32_t maxAllocations)
+    {
+        if (capacity == 0 || maxAllocations == 0) throw std::invalid_argument("TLSFAllocator::create() - capacity and maxAllocations must be greater than 0");
+        return SharedPtr(new TLSFAllocator(capacity, maxAllocations));
+    }
+
+    TLSFAllocator::TLSFAllocator(uint64_t capacity, uint32_t maxAllocations)
+        : mCapacity(capacity)
+    {
+        for (auto& fl : mBins)
+        {
+            for (auto& bin : fl) bin = kInvalidNode;
+        }
+
+        // Every allocation can split its free block in up to 3 parts, but free blocks are never adjacent, so there are at most maxAllocations + 1 of them
+        uint64_t nodeLimit = (uint64_t)maxAllocations * 2 + 1;
+        mNodeLimit = (nodeLimit < kInvalidNode) ? (uint32_t)nodeLimit : kInvalidNode - 1;
+        growNodePool();
+
+        uint32_t node = newNode();
+        mNodes[node].offset = 0;
+        mNodes[node].size = capacity;
+        insertFreeNode(node);
+    }
+
+    void TLSFAllocator::getBin(uint64_t size, uint32_t& fl, uint32_t& sl)
+    {
+        if (size < kSLCount)
+        {
+            fl = 0;
+            sl = (uint32_t)size;
+            return;
+        }
+        uint32_t msb = findMSB(size);
+        fl = msb - kSLBits + 1;
+        sl = (uint32_t)(size >> (msb - kSLBits)) - kSLCount;
+    }
+
+    uint32_t TLSFAllocator::newNode()
+    {
+        assert(mFreeNodes.size());
+        uint32_t node = mFreeNodes.back();
+        mFreeNodes.pop_back();
+        mNodes[node] = Node();
+        return node;
+    }
+
+    bool TLSFAllocator::growNodePool()
+    {
+        uint32_t oldCount = (uint32_t)mNodes.size();
+        if (oldCount == mNodeLimit) return false;
+
+        uint32_t newCount = oldCount ? oldCount * 2 : kInitialNodeCount;
+        if (newCount > mNodeLimit || newCount < oldCount) newCount = mNodeLimit;
+        mNodes.resize(newCount);
+        mFreeNodes.reserve(newCount);
+        for (uint32_t i = newCount; i > oldCount; i--) mFreeNodes.push_back(i - 1);
+        return true;
+    }
+
+    void TLSFAllocator::insertFreeNode(uint32_t node)
+    {
+        uint32_t fl, sl;
+        getBin(mNodes[node].size, fl, sl);
+
+        uint32_t head = mBins[fl][sl];
+        mNodes[node].binPrev = kInvalidNode;
+        mNodes[node].binNext = head;
+        if (head != kInvalidNode) mNodes[head].binPrev = node;
+        mBins[fl][sl] = node;
+
+        mSLBitmaps[fl] |= 1u << sl;
+        mFLBitmap |= 1ull << fl;
+        mFreeBlockCount++;
+    }
+
+    void TLSFAllocator::removeFreeNode(uint32_t node)
+    {
+        Node& n = mNodes[node];
+        if (n.binPrev != kInvalidNode) mNodes[n.binPrev].binNext = n.binNext;
+        if (n.binNext != kInvalidNode) mNodes[n.binNext].binPrev = n.binPrev;
+
+        uint32_t fl, sl;
+        getBin(n.size, fl, sl);
+        if (mBins[fl][sl] == node)
+        {
+            mBins[fl][sl] = n.binNext;
+            if (n.binNext == kInvalidNode)
+            {
+                mSLBitmaps[fl] &= ~(1u << sl);
+                if (mSLBitmaps[fl] == 0) mFLBitmap &= ~(1ull << fl);
+            }
+        }
+        n.binPrev = n.binNext = kInvalidNode;
+        mFreeBlockCount--;
+    }
+
+    uint32_t TLSFAllocator::findFreeNode(uint64_t size, uint64_t alignment) const
+    {
+        // A block of size + alignment - 1 fits whatever its offset. Round that up to the next bin boundary, so that any block in the bin we find is large enough
+        uint64_t searchSize = size + alignment - 1;
+        uint64_t round = (searchSize >= kSLCount) ? (1ull << (findMSB(searchSize) - kSLBits)) - 1 : 0;
+        if (searchSize >= size && searchSize + round >= searchSize)
+        {
+            uint32_t fl, sl;
+            getBin(searchSize + round, fl, sl);
+
+            uint32_t slMap = mSLBitmaps[fl] & (~0u << sl);
+            if (slMap == 0)
+            {
+                uint64_t flMap = (fl + 1 < kFLCount) ? (mFLBitmap & (~0ull << (fl + 1))) : 0;
+                if (flMap)
+                {
+                    fl = findLSB(flMap);
+                    slMap = mSLBitmaps[fl];
+                }
+            }
+            if (slMap) return mBins[fl][findLSB(slMap)];
+        }
+
+        // The rounded search skips the request's own bin, which can still hold a block that fits, like the whole free capacity. Only the first block of the bin is checked, which keeps the search O(1)
+        uint32_t fl, sl;
+        getBin(size, fl, sl);
+        uint32_t node = mBins[fl][sl];
+        if (node == kInvalidNode) return kInvalidNode;
+        const Node& n = mNodes[node];
+        uint64_t alignedOffset = (n.offset + alignment - 1) & ~(alignment - 1);
+        return (alignedOffset - n.offset + size <= n.size) ? node : kInvalidNode;
+    }
+
+    TLSFAllocator::Allocation TLSFAllocator::allocate(uint64_t size, uint64_t alignment)
+    {
+        assert(size > 0);
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+        // A split needs up to 2 new nodes. Grow the pool before taking any node references, growing moves the nodes
+        while (mFreeNodes.size() < 2)
+        {
+            if (growNodePool() == false) return Allocation();
+        }
+
+        uint32_t nodeIndex = findFreeNode(size, alignment);
+        if (nodeIndex == kInvalidNode) return Allocation();
+        removeFreeNode(nodeIndex);
+
+        Node& node = mNodes[nodeIndex];
+        uint64_t alignedOffset = (node.offset + alignment - 1) & ~(alignment - 1);
+        uint64_t gap = alignedOffset - node.offset;
+        if (gap)
+        {
+            // Return the space skipped by the alignment as a free block in front of the allocation
+            uint32_t gapIndex = newNode();
+            Node& gapNode = mNodes[gapIndex];
+            gapNode.offset = node.offset;
+            gapNode.size = gap;
+            gapNode.neighborPrev = node.neighborPrev;
+            gapNode.neighborNext = nodeIndex;
+            if (node.neighborPrev != kInvalidNode) mNodes[node.neighborPrev].neighborNext = gapIndex;
+            node.neighborPrev = gapIndex;
+            node.offset = alignedOffset;
+            node.size -= gap;
+            insertFreeNode(gapIndex);
+        }
+
+        uint64_t remainder = node.size - size;
+        if (remainder)
+        {
+            uint32_t remainderIndex = newNode();
+            Node& remainderNode = mNodes[remainderIndex];
+            remainderNode.offset = alignedOffset + size;
+            remainderNode.size = remainder;
+            remainderNode.neighborPrev = nodeIndex;
+            remainderNode.neighborNext = node.neighborNext;
+            if (node.neighborNext != kInvalidNode) mNodes[node.neighborNext].neighborPrev = remainderIndex;
+            node.neighborNext = remainderIndex;
+            node.size = size;
+            insertFreeNode(remainderIndex);
+        }
+
+        node.used = true;
+        mUsedSize += size;
+        mAllocationCount++;
+
+        Allocation allocation;
+        allocation.offset = alignedOffset;
+        allocation.node = nodeIndex;
+        return allocation;
+    }
+
+    void TLSFAllocator::release(const Allocation& allocation)
+    {
+        assert(allocation.isValid());
+        uint32_t nodeIndex = allocation.node;
+        Node& node = mNodes[nodeIndex];
+        assert(node.used && node.offset == allocation.offset);
+
+        node.used = false;
+        mUsedSize -= node.size;
+        mAllocationCount--;
+
+        // Merge with the free neighbors
+        uint32_t prev = node.neighborPrev;
+        if (prev != kInvalidNode && mNodes[prev].used == false)
+        {
+            removeFreeNode(prev);
+            node.offset = mNodes[prev].offset;
+            node.size += mNodes[prev].size;
+            node.neighborPrev = mNodes[prev].neighborPrev;
+            if (node.neighborPrev != kInvalidNode) mNodes[node.neighborPrev].neighborNext = nodeIndex;
+            mFreeNodes.push_back(prev);
+        }
+
+        uint32_t next = node.neighborNext;
+        if (next != kInvalidNode && mNodes[next].used == false)
+        {
+            removeFreeNode(next);
+            node.size += mNodes[next].size;
+            node.neighborNext = mNodes[next].neighborNext;
+            if (node.neighborNext != kInvalidNode) mNodes[node.neighborNext].neighborPrev = nodeIndex;
+            mFreeNodes.push_back(next);
+        }
+
+        insertFreeNode(nodeIndex);
+    }
+
+    uint64_t TLSFAllocator::getAllocationSize(const Allocation& allocation) const
+    {
+        assert(allocation.isValid() && mNodes[allocation.node].used);
+        return mNodes[allocation.node].size;
+    }
+
+    TLSFAllocator::Stats TLSFAllocator::getStats() const
+    {
+        Stats stats;
+        stats.capacity = mCapacity;
+        stats.usedSize = mUsedSize;
+        stats.freeSize = mCapacity - mUsedSize;
+        stats.allocationCount = mAllocationCount;
+        stats.freeBlockCount = mFreeBlockCount;
+
+        if (mFLBitmap)
+        {
+            // The largest block is in the highest non-empty bin
+            uint32_t fl = findMSB(mFLBitmap);
+            uint32_t sl = findMSB(mSLBitmaps[fl]);
+            for (uint32_t node = mBins[fl][sl]; node != kInvalidNode; node = mNodes[node].binNext)
+            {
+                if (mNodes[node].size > stats.largestFreeBlock) stats.largestFreeBlock = mNodes[node].size;
+            }
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace WIP3D
+{
+    /** Two-level segregated fit (TLSF) range allocator.
+        Manages offsets inside a range of `capacity` units and doesn't touch any memory itself, so it has no graphics API dependencies.
+        Allocation and release are O(1). Free blocks are kept in 64 x 16 size-class bins, adjacent free blocks are merged on release.
+        Requests are rounded up to the next bin, so any block found is large enough. Only if that fails is the first block of the request's own bin checked, so a block that fits exactly, like the whole free capacity, can still be allocated without scanning the bin.
+        Block bookkeeping lives in a node pool that starts small and doubles on demand, up to the bound set by the maximum number of live allocations.
+    */
+    class TLSFAllocator
+    {
+    public:
+        using SharedPtr = std::shared_ptr<TLSFAllocator>;
+        using SharedConstPtr = std::shared_ptr<const TLSFAllocator>;
+
+        static const uint64_t kInvalidOffset = (uint64_t)-1;
+        static const uint32_t kInvalidNode = (uint32_t)-1;
+
+        struct Allocation
+        {
+            uint64_t offset = kInvalidOffset;
+            uint32_t node = kInvalidNode;
+            bool isValid() const { return node != kInvalidNode; }
+        };
+
+        struct Stats
+        {
+            uint64_t capacity = 0;
+            uint64_t usedSize = 0;              ///< Sum of the live allocation sizes
+            uint64_t freeSize = 0;              ///< capacity - usedSize, including alignment gaps
+            uint64_t largestFreeBlock = 0;
+            uint32_t allocationCount = 0;
+            uint32_t freeBlockCount = 0;
+
+            /** 0 when all the free space is one block, approaching 1 as free space is split into many small blocks
+            */
+            float getFragmentation() const { return freeSize ? 1.0f - (float)largestFreeBlock / (float)freeSize : 0.0f; }
+        };
+
+        /** Create a new allocator.
+            \param[in] capacity Size of the managed range.
+            \param[in] maxAllocations Maximum number of live allocations. Only bounds the node pool, which grows as allocations are made.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint64_t capacity, uint32_t maxAllocations = 64 * 1024);
+
+        /** Allocate a range.
+            \param[in] size Size of the range, must be greater than 0.
+            \param[in] alignment Alignment of the returned offset. Must be a power of two.
+            \return The allocation, or an invalid allocation if there is no free block large enough.
+        */
+        Allocation allocate(uint64_t size, uint64_t alignment = 1);
+
+        /** Release an allocation. The range can be reused immediately.
+        */
+        void release(const Allocation& allocation);
+
+        /** Get the size of a live allocation
+        */
+        uint64_t getAllocationSize(const Allocation& allocation) const;
+
+        uint64_t getCapacity() const { return mCapacity; }
+        Stats getStats() const;
+
+    private:
+        TLSFAllocator(uint64_t capacity, uint32_t maxAllocations);
+
+        static const uint32_t kSLBits = 4;
+        static const uint32_t kSLCount = 1 << kSLBits;
+        static const uint32_t kFLCount = 64;
+        static const uint32_t kInitialNodeCount = 1024;
+
+        struct Node
+        {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint32_t binPrev = kInvalidNode;
+            uint32_t binNext = kInvalidNode;
+            uint32_t neighborPrev = kInvalidNode;
+            uint32_t neighborNext = kInvalidNode;
+            bool used = false;
+        };
+
+        static void getBin(uint64_t size, uint32_t& fl, uint32_t& sl);
+        uint32_t newNode();
+        bool growNodePool();
+        void insertFreeNode(uint32_t node);
+        void removeFreeNode(uint32_t node);
+        uint32_t findFreeNode(uint64_t size, uint64_t alignment) const;
+
+        uint64_t mCapacity;
+        uint64_t mUsedSize = 0;
+        uint32_t mAllocationCount = 0;
+        uint32_t mFreeBlockCount = 0;
+
+        uint64_t mFLBitmap = 0;
+        uint32_t mSLBitmaps[kFLCount] = {};
+        uint32_t mBins[kFLCount][kSLCount];
+
+        std::vector<Node> mNodes;
+        std::vector<uint32_t> mFreeNodes;
+        uint32_t mNodeLimit;
+    };
+}
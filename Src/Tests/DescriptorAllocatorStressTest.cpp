@@ -0,0 +1,78 @@
+/** Multi-threaded stress test of DescriptorAllocator, which exercises the lock-free free lists and the locked TLSFAllocator path together.
+    Every thread allocates and releases random ranges and marks the entries it owns, an entry that is already owned means two live ranges overlap.
+    Run it under ThreadSanitizer to check the free lists for races, e.g. with gcc or clang:
+        g++ -std=c++14 -O1 -g -fsanitize=thread -pthread -ISrc Src/Tests/UnitTest.cpp Src/Tests/DescriptorAllocatorStressTest.cpp Src/DescriptorAllocator.cpp Src/TLSFAllocator.cpp -o WIP3DTests_tsan
+        ./WIP3DTests_tsan DescriptorAllocator_Concurrent
+*/
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "UnitTest.h"
+#include "../DescriptorAllocator.h"
+
+using namespace WIP3D;
+
+UNIT_TEST(DescriptorAllocator_ConcurrentAllocateRelease)
+{
+    const uint32_t descCount = 64 * 1024;
+    const uint32_t threadCount = 8;
+    const uint32_t iterations = 100000;
+
+    DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(descCount);
+    std::vector<std::atomic<uint32_t>> owners(descCount);
+    for (auto& owner : owners) owner.store(0);
+    std::atomic<uint32_t> overlapCount(0);
+    std::atomic<uint32_t> sizeMismatchCount(0);
+
+    auto worker = [&](uint32_t threadIndex)
+    {
+        const uint32_t owner = threadIndex + 1;
+        std::mt19937 rng(threadIndex);
+        std::vector<std::pair<DescriptorAllocator::Handle, uint32_t>> live;
+
+        auto release = [&](size_t i)
+        {
+            DescriptorAllocator::Handle h = live[i].first;
+            uint32_t count = live[i].second;
+            if (pAllocator->getRangeSize(h) != count) sizeMismatchCount++;
+            for (uint32_t e = 0; e < count; e++) owners[h + e].store(0, std::memory_order_relaxed);
+            pAllocator->release(h);
+            live[i] = live.back();
+            live.pop_back();
+        };
+
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            if (live.size() > 256 || (live.size() && rng() % 2))
+            {
+                release(rng() % live.size());
+                continue;
+            }
+
+            // Mostly descriptor-set sized ranges, some that take the locked path
+            uint32_t count = (rng() % 16) ? 1 + rng() % DescriptorAllocator::kCachedRangeSize : DescriptorAllocator::kCachedRangeSize + 1 + rng() % 512;
+            DescriptorAllocator::Handle h = pAllocator->allocate(count);
+            if (h == DescriptorAllocator::kInvalidHandle) continue;
+
+            for (uint32_t e = 0; e < count; e++)
+            {
+                uint32_t expected = 0;
+                if (owners[h + e].compare_exchange_strong(expected, owner, std::memory_order_relaxed) == false) overlapCount++;
+            }
+            live.emplace_back(h, count);
+        }
+        while (live.size()) release(live.size() - 1);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++) threads.emplace_back(worker, t);
+    for (auto& thread : threads) thread.join();
+
+    EXPECT(overlapCount == 0);
+    EXPECT(sizeMismatchCount == 0);
+    EXPECT(pAllocator->getUsedDescCount() == 0);
+
+    // Everything was released, so the whole heap can be allocated as one range again
+    EXPECT(pAllocator->allocate(descCount) == 0);
+}
@@ -0,0 +1,86 @@
+#include <stdexcept>
+#include <vector>
+#include "UnitTest.h"
+#include "../DescriptorAllocator.h"
+
+using namespace WIP3D;
+
+UNIT_TEST(DescriptorAllocator_CreateRejectsInvalidCount)
+{
+    uint32_t thrownCount = 0;
+    for (uint32_t descCount : { 0u, DescriptorAllocator::kMaxDescCount + 1 })
+    {
+        try { DescriptorAllocator::create(descCount); }
+        catch (const std::invalid_argument&) { thrownCount++; }
+    }
+    EXPECT(thrownCount == 2);
+}
+
+UNIT_TEST(DescriptorAllocator_RangeSizes)
+{
+    DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(1024);
+    DescriptorAllocator::Handle a = pAllocator->allocate(3);
+    DescriptorAllocator::Handle b = pAllocator->allocate(DescriptorAllocator::kCachedRangeSize + 1);
+    DescriptorAllocator::Handle c = pAllocator->allocate(1);
+    EXPECT(a != DescriptorAllocator::kInvalidHandle && b != DescriptorAllocator::kInvalidHandle && c != DescriptorAllocator::kInvalidHandle);
+    EXPECT(pAllocator->getRangeSize(a) == 3);
+    EXPECT(pAllocator->getRangeSize(b) == DescriptorAllocator::kCachedRangeSize + 1);
+    EXPECT(pAllocator->getRangeSize(c) == 1);
+    EXPECT(DescriptorAllocator::getBaseIndex(b) == 3 && DescriptorAllocator::getBaseIndex(c) == DescriptorAllocator::kCachedRangeSize + 4);
+    EXPECT(pAllocator->getUsedDescCount() == DescriptorAllocator::kCachedRangeSize + 5);
+
+    pAllocator->release(a);
+    pAllocator->release(b);
+    pAllocator->release(c);
+    EXPECT(pAllocator->getUsedDescCount() == 0);
+    EXPECT(pAllocator->getCachedDescCount() == 4);
+}
+
+UNIT_TEST(DescriptorAllocator_FreeListReuse)
+{
+    // A released small range goes to the free list of its size and is handed out again by the next allocation of that size
+    DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(1024);
+    DescriptorAllocator::Handle a = pAllocator->allocate(8);
+    DescriptorAllocator::Handle b = pAllocator->allocate(8);
+    pAllocator->release(a);
+    pAllocator->release(b);
+    EXPECT(pAllocator->allocate(4) == 16);
+    EXPECT(pAllocator->allocate(8) == b);
+    EXPECT(pAllocator->allocate(8) == a);
+    EXPECT(pAllocator->getCachedDescCount() == 0);
+}
+
+UNIT_TEST(DescriptorAllocator_DrainsFreeListsWhenExhausted)
+{
+    // The whole heap sits in the free lists, a large allocation only succeeds once the cached ranges are merged back
+    const uint32_t descCount = 256;
+    DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(descCount);
+    std::vector<DescriptorAllocator::Handle> handles;
+    for (uint32_t i = 0; i < descCount / 4; i++) handles.push_back(pAllocator->allocate(1 + i % 4));
+    while (true)
+    {
+        DescriptorAllocator::Handle h = pAllocator->allocate(1);
+        if (h == DescriptorAllocator::kInvalidHandle) break;
+        handles.push_back(h);
+    }
+    EXPECT(pAllocator->getUsedDescCount() == descCount);
+    for (auto h : handles) pAllocator->release(h);
+    EXPECT(pAllocator->getCachedDescCount() == descCount);
+
+    DescriptorAllocator::Handle all = pAllocator->allocate(descCount);
+    EXPECT(all == 0);
+    EXPECT(pAllocator->getCachedDescCount() == 0);
+    EXPECT(pAllocator->getUsedDescCount() == descCount);
+}
+
+UNIT_TEST(DescriptorAllocator_MillionSingleRanges)
+{
+    // Every entry of a bindless-sized heap can be a live range of its own
+    const uint32_t descCount = 1000000;
+    DescriptorAllocator::SharedPtr pAllocator = DescriptorAllocator::create(descCount);
+    bool allValid = true;
+    for (uint32_t i = 0; i < descCount; i++) allValid &= (pAllocator->allocate(1) == i);
+    EXPECT(allValid);
+    EXPECT(pAllocator->allocate(1) == DescriptorAllocator::kInvalidHandle);
+    EXPECT(pAllocator->getUsedDescCount() == descCount);
+}
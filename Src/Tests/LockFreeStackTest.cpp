@@ -0,0 +1,94 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "UnitTest.h"
+#include "../LockFreeStack.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    struct Node
+    {
+        uint32_t id = 0;
+        std::atomic<bool> held { false };
+        Node* pNext = nullptr;
+    };
+
+    uint32_t countNodes(Node* pNode)
+    {
+        uint32_t count = 0;
+        for (; pNode; pNode = pNode->pNext) count++;
+        return count;
+    }
+}
+
+UNIT_TEST(LockFreeStack_PushPop)
+{
+    Node nodes[4];
+    for (uint32_t i = 0; i < 4; i++) nodes[i].id = i;
+
+    LockFreeStack<Node> stack;
+    EXPECT(stack.isEmpty() && stack.pop() == nullptr);
+    stack.push(&nodes[0]);
+    nodes[1].pNext = &nodes[2];
+    stack.push(&nodes[1], &nodes[2]);
+    stack.push(&nodes[3]);
+
+    // Pop takes the top node and leaves the rest in order
+    Node* pNode = stack.pop();
+    EXPECT(pNode == &nodes[3] && pNode->pNext == nullptr);
+    EXPECT(stack.pop() == &nodes[1]);
+
+    Node* pAll = stack.takeAll();
+    EXPECT(stack.isEmpty());
+    EXPECT(pAll == &nodes[2] && pAll->pNext == &nodes[0] && countNodes(pAll) == 2);
+}
+
+UNIT_TEST(LockFreeStack_ConcurrentLease)
+{
+    // Threads lease nodes from a free stack and hand them back, like thread allocators leasing pages. A node must never be held by two threads
+    const uint32_t nodeCount = 64;
+    const uint32_t threadCount = 4;
+    const uint32_t iterations = 50000;
+    std::vector<Node> nodes(nodeCount);
+    LockFreeStack<Node> freeStack;
+    for (auto& node : nodes) freeStack.push(&node);
+
+    std::atomic<uint32_t> doubleLeaseCount(0);
+    auto worker = [&]()
+    {
+        std::vector<Node*> held;
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            if (held.size() < 4)
+            {
+                Node* pNode = freeStack.pop();
+                if (pNode == nullptr) continue;
+                if (pNode->held.exchange(true)) doubleLeaseCount++;
+                held.push_back(pNode);
+            }
+            else
+            {
+                for (Node* pNode : held)
+                {
+                    pNode->held = false;
+                    freeStack.push(pNode);
+                }
+                held.clear();
+            }
+        }
+        for (Node* pNode : held)
+        {
+            pNode->held = false;
+            freeStack.push(pNode);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++) threads.emplace_back(worker);
+    for (auto& thread : threads) thread.join();
+
+    EXPECT(doubleLeaseCount == 0);
+    EXPECT(countNodes(freeStack.takeAll()) == nodeCount);
+}
@@ -0,0 +1,98 @@
+#include <cstring>
+#include <random>
+#include <vector>
+#include "UnitTest.h"
+#include "../PitchedCopy.h"
+#include "../WorkerPool.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint8_t kPadding = 0xcd;
+
+    // Pick a pitch, equal to the packed size half the time so the row and slice merging gets exercised
+    size_t randomPitch(std::mt19937& rng, size_t packedSize)
+    {
+        return (rng() & 1) ? packedSize : packedSize + 1 + rng() % 300;
+    }
+
+    /** Run a copy through copyPitched() and through a naive row-by-row reference, and compare the whole destination buffer, padding included
+    */
+    bool checkCopy(std::mt19937& rng, size_t rowSize, uint32_t rowCount, uint32_t sliceCount, bool writeCombined, WorkerPool* pPool)
+    {
+        PitchedCopyDesc desc;
+        desc.rowSize = rowSize;
+        desc.rowCount = rowCount;
+        desc.sliceCount = sliceCount;
+        desc.srcRowPitch = randomPitch(rng, rowSize);
+        desc.dstRowPitch = randomPitch(rng, rowSize);
+        desc.srcSlicePitch = randomPitch(rng, desc.srcRowPitch * rowCount);
+        desc.dstSlicePitch = randomPitch(rng, desc.dstRowPitch * rowCount);
+        desc.writeCombinedDst = writeCombined;
+
+        // Odd offsets inside the allocations, so the streaming path sees unaligned destinations
+        size_t srcOffset = rng() % 16;
+        size_t dstOffset = rng() % 16;
+        std::vector<uint8_t> src(srcOffset + desc.srcSlicePitch * sliceCount);
+        for (auto& b : src) b = (uint8_t)rng();
+        std::vector<uint8_t> dst(dstOffset + desc.dstSlicePitch * sliceCount + 16, kPadding);
+        std::vector<uint8_t> expected = dst;
+
+        for (uint32_t z = 0; z < sliceCount; z++)
+        {
+            for (uint32_t y = 0; y < rowCount; y++)
+            {
+                memcpy(expected.data() + dstOffset + z * desc.dstSlicePitch + y * desc.dstRowPitch, src.data() + srcOffset + z * desc.srcSlicePitch + y * desc.srcRowPitch, rowSize);
+            }
+        }
+
+        desc.pSrc = src.data() + srcOffset;
+        desc.pDst = dst.data() + dstOffset;
+        copyPitched(desc, pPool);
+        return dst == expected;
+    }
+}
+
+UNIT_TEST(PitchedCopy_RandomLayouts)
+{
+    std::mt19937 rng(42);
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        size_t rowSize = 1 + rng() % 700;
+        uint32_t rowCount = 1 + rng() % 32;
+        uint32_t sliceCount = 1 + rng() % 4;
+        EXPECT(checkCopy(rng, rowSize, rowCount, sliceCount, (i & 1) != 0, nullptr));
+    }
+}
+
+UNIT_TEST(PitchedCopy_ParallelLayouts)
+{
+    // Copies above kParallelPitchedCopySize are split across the pool, including a single large row with a tail
+    WorkerPool::SharedPtr pPool = WorkerPool::create(4);
+    std::mt19937 rng(7);
+    for (uint32_t i = 0; i < 24; i++)
+    {
+        bool singleRow = (i % 3) == 0;
+        size_t rowSize = singleRow ? kParallelPitchedCopySize + 1 + rng() % 100000 : 1024 + rng() % 8192;
+        uint32_t rowCount = singleRow ? 1 : 256 + rng() % 512;
+        uint32_t sliceCount = singleRow ? 1 : 1 + rng() % 4;
+        EXPECT(checkCopy(rng, rowSize, rowCount, sliceCount, (i & 1) != 0, pPool.get()));
+    }
+}
+
+UNIT_TEST(PitchedCopy_EmptyCopies)
+{
+    uint8_t src[16] = {};
+    uint8_t dst[16];
+    memset(dst, kPadding, sizeof(dst));
+    PitchedCopyDesc desc;
+    desc.pSrc = src;
+    desc.pDst = dst;
+    desc.rowSize = 0;
+    copyPitched(desc);
+    desc.rowSize = 16;
+    desc.rowCount = 0;
+    copyPitched(desc);
+    EXPECT(dst[0] == kPadding && dst[15] == kPadding);
+}
@@ -0,0 +1,94 @@
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "UnitTest.h"
+#include "../RingAllocator.h"
+
+using namespace WIP3D;
+
+UNIT_TEST(RingAllocator_CreateRejectsEmptyRing)
+{
+    bool thrown = false;
+    try { RingAllocator::create(0); }
+    catch (const std::invalid_argument&) { thrown = true; }
+    EXPECT(thrown);
+}
+
+UNIT_TEST(RingAllocator_AlignmentAndWrap)
+{
+    RingAllocator::SharedPtr pRing = RingAllocator::create(1024);
+    EXPECT(pRing->allocate(400, 1, 1) == 0);
+    EXPECT(pRing->allocate(400, 256, 1) == 512);
+    EXPECT(pRing->getUsedSize() == 912);
+
+    // The tail is too small and the front is still live
+    EXPECT(pRing->allocate(300, 1, 2) == RingAllocator::kInvalidOffset);
+    EXPECT(pRing->allocate(2000, 1, 2) == RingAllocator::kInvalidOffset);
+
+    // Retiring everything restarts the ring, the next range doesn't skip the tail
+    pRing->retire(1);
+    EXPECT(pRing->getUsedSize() == 0);
+    EXPECT(pRing->allocate(300, 1, 2) == 0);
+    EXPECT(pRing->allocate(724, 1, 2) == 300);
+    EXPECT(pRing->getUsedSize() == 1024);
+}
+
+UNIT_TEST(RingAllocator_RetireByFence)
+{
+    RingAllocator::SharedPtr pRing = RingAllocator::create(1000);
+    EXPECT(pRing->allocate(300, 1, 1) == 0);
+    EXPECT(pRing->allocate(300, 1, 2) == 300);
+    EXPECT(pRing->allocate(300, 1, 3) == 600);
+
+    // Only frame 1 is done, the next range skips the 100 unit tail and takes its space
+    pRing->retire(1);
+    EXPECT(pRing->getUsedSize() == 600);
+    EXPECT(pRing->allocate(300, 1, 4) == 0);
+    EXPECT(pRing->getUsedSize() == 1000);
+    EXPECT(pRing->allocate(1, 1, 4) == RingAllocator::kInvalidOffset);
+
+    // The skipped tail belongs to frame 4 until it retires
+    pRing->retire(3);
+    EXPECT(pRing->getUsedSize() == 400);
+    EXPECT(pRing->allocate(700, 1, 5) == RingAllocator::kInvalidOffset);
+    EXPECT(pRing->allocate(600, 1, 5) == 300);
+}
+
+UNIT_TEST(RingAllocator_RandomAgainstReference)
+{
+    // Frames of random allocations with a few frames in flight. Every unit of the ring is owned by at most one live range
+    const uint64_t capacity = 4096;
+    RingAllocator::SharedPtr pRing = RingAllocator::create(capacity);
+    std::vector<uint64_t> owner(capacity, 0);     // Fence value of the range covering each unit, 0 if free
+    std::mt19937 rng(7);
+    bool overlap = false;
+    bool outOfRange = false;
+
+    for (uint64_t frame = 1; frame <= 2000; frame++)
+    {
+        uint64_t completed = (frame > 3) ? frame - 3 : 0;
+        pRing->retire(completed);
+        for (auto& o : owner) if (o && o <= completed) o = 0;
+
+        uint32_t count = rng() % 32;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t size = 1 + rng() % 128;
+            uint64_t alignment = 1ull << (rng() % 6);
+            uint64_t offset = pRing->allocate(size, alignment, frame);
+            if (offset == RingAllocator::kInvalidOffset) continue;
+
+            outOfRange |= (offset % alignment) != 0 || offset + size > capacity;
+            for (uint64_t u = offset; u < offset + size && u < capacity; u++)
+            {
+                overlap |= owner[u] != 0;
+                owner[u] = frame;
+            }
+        }
+    }
+    EXPECT(overlap == false);
+    EXPECT(outOfRange == false);
+
+    pRing->retire(2000);
+    EXPECT(pRing->getUsedSize() == 0);
+}
@@ -0,0 +1,99 @@
+#include <vector>
+#include "UnitTest.h"
+#include "../SubresourceStates.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    const uint32_t kCopyDest = 1;
+    const uint32_t kShaderResource = 2;
+    const uint32_t kRenderTarget = 3;
+}
+
+UNIT_TEST(SubresourceStates_FirstUseRecordsExpectedState)
+{
+    SubresourceStates states(4, 2);
+    std::vector<SubresourceStates::Transition> transitions;
+    states.transition(kCopyDest, nullptr, transitions);
+    EXPECT(transitions.empty());
+    for (uint32_t i = 0; i < states.getSubresourceCount(); i++)
+    {
+        EXPECT(states.isUsed(i));
+        EXPECT(states.getFirstState(i) == kCopyDest);
+    }
+
+    // Moving the entire resource from one state collapses to a single transition
+    states.transition(kShaderResource, nullptr, transitions);
+    EXPECT(transitions.size() == 1);
+    EXPECT(transitions[0].subresource == SubresourceStates::kAllSubresources);
+    EXPECT(transitions[0].before == kCopyDest && transitions[0].after == kShaderResource);
+    EXPECT(states.getFirstState(0) == kCopyDest);
+    EXPECT(states.isFinalStateUniform());
+}
+
+UNIT_TEST(SubresourceStates_RangeTransitions)
+{
+    SubresourceStates states(4, 2);
+    std::vector<SubresourceStates::Transition> transitions;
+    states.transition(kShaderResource, nullptr, transitions);
+
+    // Mip 1 of both slices
+    SubresourceStates::Range range = { 1, 1, 0, 2 };
+    states.transition(kRenderTarget, &range, transitions);
+    EXPECT(transitions.size() == 2);
+    EXPECT(transitions[0].subresource == 1 && transitions[1].subresource == 5);
+    EXPECT(states.isFinalStateUniform() == false);
+
+    // Back to a uniform state, the transition only covers the subresources which changed
+    transitions.clear();
+    states.transition(kShaderResource, nullptr, transitions);
+    EXPECT(transitions.size() == 2);
+    EXPECT(transitions[0].before == kRenderTarget && transitions[0].after == kShaderResource);
+    EXPECT(states.isFinalStateUniform());
+}
+
+UNIT_TEST(SubresourceStates_MixedBeforeStatesDontCollapse)
+{
+    SubresourceStates states(2, 1);
+    std::vector<SubresourceStates::Transition> transitions;
+    SubresourceStates::Range mip0 = { 0, 1, 0, 1 };
+    SubresourceStates::Range mip1 = { 1, 1, 0, 1 };
+    states.transition(kCopyDest, &mip0, transitions);
+    states.transition(kRenderTarget, &mip1, transitions);
+    states.transition(kShaderResource, nullptr, transitions);
+    EXPECT(transitions.size() == 2);
+    EXPECT(transitions[0].subresource == 0 && transitions[0].before == kCopyDest);
+    EXPECT(transitions[1].subresource == 1 && transitions[1].before == kRenderTarget);
+}
+
+UNIT_TEST(SubresourceStates_Fixups)
+{
+    SubresourceStates states(2, 2);
+    std::vector<SubresourceStates::Transition> transitions;
+    std::vector<SubresourceStates::Transition> fixups;
+
+    // Unused subresources don't get fix-ups and keep the final state from being uniform
+    SubresourceStates::Range slice1 = { 0, 2, 1, 1 };
+    states.transition(kShaderResource, &slice1, transitions);
+    std::vector<uint32_t> global = { kCopyDest, kCopyDest, kCopyDest, kShaderResource };
+    states.getFixups(global.data(), fixups);
+    EXPECT(fixups.size() == 1);
+    EXPECT(fixups[0].subresource == 2 && fixups[0].before == kCopyDest && fixups[0].after == kShaderResource);
+    EXPECT(states.isFinalStateUniform() == false);
+
+    // Every subresource from one state to one state collapses
+    states.transition(kShaderResource, nullptr, transitions);
+    fixups.clear();
+    std::vector<uint32_t> uniform(4, kRenderTarget);
+    states.getFixups(uniform.data(), fixups);
+    EXPECT(fixups.size() == 1);
+    EXPECT(fixups[0].subresource == SubresourceStates::kAllSubresources);
+    EXPECT(fixups[0].before == kRenderTarget && fixups[0].after == kShaderResource);
+
+    // Nothing to fix when the global states already match
+    fixups.clear();
+    std::vector<uint32_t> matching(4, kShaderResource);
+    states.getFixups(matching.data(), fixups);
+    EXPECT(fixups.empty());
+}
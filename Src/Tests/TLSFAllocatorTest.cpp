@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include "UnitTest.h"
+#include "../TLSFAllocator.h"
+
+using namespace WIP3D;
+
+namespace
+{
+    bool isAligned(uint64_t offset, uint64_t alignment) { return (offset & (alignment - 1)) == 0; }
+}
+
+UNIT_TEST(TLSFAllocator_CreateRejectsEmptyRange)
+{
+    bool thrown = false;
+    try { TLSFAllocator::create(0); }
+    catch (const std::invalid_argument&) { thrown = true; }
+    EXPECT(thrown);
+}
+
+UNIT_TEST(TLSFAllocator_ExactFitOfWholeCapacity)
+{
+    // The rounded search can't find the only block when it fits exactly, the request's own bin is checked too
+    for (uint64_t capacity : { 15ull, 1000ull, 1024ull, 1000000ull, 1ull << 40 })
+    {
+        TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(capacity);
+        TLSFAllocator::Allocation allocation = pAllocator->allocate(capacity);
+        EXPECT(allocation.isValid());
+        EXPECT(allocation.offset == 0);
+        EXPECT(pAllocator->getStats().freeSize == 0);
+        EXPECT(pAllocator->allocate(1).isValid() == false);
+        pAllocator->release(allocation);
+        EXPECT(pAllocator->getStats().largestFreeBlock == capacity);
+    }
+
+    // Also when the request is aligned, since the block starts at an aligned offset
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(4096);
+    TLSFAllocator::Allocation allocation = pAllocator->allocate(4096, 256);
+    EXPECT(allocation.isValid() && allocation.offset == 0);
+}
+
+UNIT_TEST(TLSFAllocator_AlignmentAndGapReuse)
+{
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(1 << 20);
+    TLSFAllocator::Allocation a = pAllocator->allocate(100);
+    TLSFAllocator::Allocation b = pAllocator->allocate(1000, 4096);
+    EXPECT(a.isValid() && b.isValid());
+    EXPECT(isAligned(b.offset, 4096));
+    EXPECT(b.offset >= a.offset + 100);
+
+    // The space skipped by the alignment is a free block. Once the tail is taken, it's the only block left and fits exactly
+    TLSFAllocator::Allocation tail = pAllocator->allocate((1 << 20) - b.offset - 1000);
+    EXPECT(tail.isValid());
+    TLSFAllocator::Allocation c = pAllocator->allocate(b.offset - 100);
+    EXPECT(c.isValid());
+    EXPECT(c.offset == 100);
+    EXPECT(pAllocator->getAllocationSize(c) == b.offset - 100);
+}
+
+UNIT_TEST(TLSFAllocator_ReleaseMergesNeighbors)
+{
+    const uint64_t capacity = 1 << 16;
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(capacity);
+    TLSFAllocator::Allocation allocations[8];
+    for (auto& a : allocations)
+    {
+        a = pAllocator->allocate(capacity / 8);
+        EXPECT(a.isValid());
+    }
+    EXPECT(pAllocator->getStats().freeBlockCount == 0);
+
+    // Release every other block, then the rest. Each release merges with both neighbors
+    for (uint32_t i = 0; i < 8; i += 2) pAllocator->release(allocations[i]);
+    EXPECT(pAllocator->getStats().freeBlockCount == 4);
+    EXPECT(pAllocator->getStats().getFragmentation() > 0.5f);
+    for (uint32_t i = 1; i < 8; i += 2) pAllocator->release(allocations[i]);
+
+    TLSFAllocator::Stats stats = pAllocator->getStats();
+    EXPECT(stats.freeBlockCount == 1);
+    EXPECT(stats.largestFreeBlock == capacity);
+    EXPECT(stats.getFragmentation() == 0.0f);
+    EXPECT(stats.allocationCount == 0 && stats.usedSize == 0);
+}
+
+UNIT_TEST(TLSFAllocator_MaxAllocations)
+{
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(1 << 20, 4);
+    std::vector<TLSFAllocator::Allocation> allocations;
+    for (uint32_t i = 0; i < 4; i++) allocations.push_back(pAllocator->allocate(16));
+    for (const auto& a : allocations) EXPECT(a.isValid());
+
+    // Running out of nodes fails the allocation, it doesn't corrupt the allocator
+    while (true)
+    {
+        TLSFAllocator::Allocation a = pAllocator->allocate(16);
+        if (a.isValid() == false) break;
+        allocations.push_back(a);
+    }
+    for (const auto& a : allocations) pAllocator->release(a);
+    EXPECT(pAllocator->getStats().freeBlockCount == 1);
+}
+
+UNIT_TEST(TLSFAllocator_NodePoolGrows)
+{
+    // Far more live allocations than the initial node pool holds
+    const uint32_t count = 100000;
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(count, count);
+    std::vector<TLSFAllocator::Allocation> allocations;
+    for (uint32_t i = 0; i < count; i++) allocations.push_back(pAllocator->allocate(1));
+    for (uint32_t i = 0; i < count; i++) EXPECT(allocations[i].isValid() && allocations[i].offset == i);
+    EXPECT(pAllocator->getStats().freeSize == 0);
+
+    for (uint32_t i = 0; i < count; i += 2) pAllocator->release(allocations[i]);
+    for (uint32_t i = 1; i < count; i += 2) pAllocator->release(allocations[i]);
+    EXPECT(pAllocator->getStats().freeBlockCount == 1);
+    EXPECT(pAllocator->allocate(count).isValid());
+}
+
+UNIT_TEST(TLSFAllocator_RandomAgainstReference)
+{
+    // Random allocations and releases, checked against a map of the live ranges
+    const uint64_t capacity = 1 << 24;
+    TLSFAllocator::SharedPtr pAllocator = TLSFAllocator::create(capacity, 4096);
+    std::map<uint64_t, std::pair<uint64_t, TLSFAllocator::Allocation>> live;   // Offset -> size, allocation
+    std::mt19937 rng(1234);
+    uint64_t usedSize = 0;
+
+    for (uint32_t i = 0; i < 100000; i++)
+    {
+        bool doAllocate = live.empty() || (rng() % 100) < 55;
+        if (doAllocate)
+        {
+            uint64_t size = 1 + (rng() % ((rng() % 8) ? 4096 : 262144));
+            uint64_t alignment = 1ull << (rng() % 9);
+            TLSFAllocator::Allocation a = pAllocator->allocate(size, alignment);
+            if (a.isValid() == false) continue;
+
+            EXPECT(isAligned(a.offset, alignment));
+            EXPECT(a.offset + size <= capacity);
+            auto next = live.lower_bound(a.offset);
+            if (next != live.end()) EXPECT(a.offset + size <= next->first);
+            if (next != live.begin()) EXPECT(std::prev(next)->first + std::prev(next)->second.first <= a.offset);
+            live[a.offset] = { size, a };
+            usedSize += size;
+        }
+        else
+        {
+            auto it = live.begin();
+            std::advance(it, rng() % live.size());
+            EXPECT(pAllocator->getAllocationSize(it->second.second) == it->second.first);
+            pAllocator->release(it->second.second);
+            usedSize -= it->second.first;
+            live.erase(it);
+        }
+        EXPECT(pAllocator->getStats().usedSize == usedSize);
+    }
+
+    for (const auto& it : live) pAllocator->release(it.second.second);
+    TLSFAllocator::Stats stats = pAllocator->getStats();
+    EXPECT(stats.freeBlockCount == 1 && stats.largestFreeBlock == capacity);
+}
@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <cstring>
+#include "UnitTest.h"
+
+namespace WIP3D
+{
+    UnitTest::Registrar::Registrar(const char* name, Func func)
+    {
+        getRegistry().push_back({ name, func });
+    }
+
+    std::vector<UnitTest::Entry>& UnitTest::getRegistry()
+    {
+        static std::vector<Entry> registry;
+        return registry;
+    }
+
+    uint32_t UnitTest::runAll(const char* filter)
+    {
+        uint32_t runCount = 0;
+        uint32_t failCount = 0;
+        for (const Entry& entry : getRegistry())
+        {
+            if (filter && strstr(entry.name, filter) == nullptr) continue;
+
+            UnitTest test;
+            entry.func(test);
+            runCount++;
+            if (test.hasFailed()) failCount++;
+            printf("[%s] %s\n", test.hasFailed() ? "FAIL" : " OK ", entry.name);
+        }
+        printf("%u/%u tests passed\n", runCount - failCount, runCount);
+        return failCount;
+    }
+
+    void UnitTest::fail(const char* file, int line, const char* expression)
+    {
+        // Only report the first few failures of a test, a broken invariant inside a loop would flood the output
+        if (mFailCount++ < 8) printf("    %s(%d): EXPECT(%s) failed\n", file, line, expression);
+    }
+}
+
+/** Usage: WIP3DTests [filter]
+*/
+int main(int argc, char** argv)
+{
+    return WIP3D::UnitTest::runAll(argc > 1 ? argv[1] : nullptr) ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WIP3D
+{
+    /** Minimal test runner for the device-free cores, the tests are built into WIP3DTests.
+        Tests register themselves with UNIT_TEST(). A failed EXPECT() marks the test as failed and the test keeps running, so one run reports every broken check.
+    */
+    class UnitTest
+    {
+    public:
+        using Func = void(*)(UnitTest& test);
+
+        struct Registrar
+        {
+            Registrar(const char* name, Func func);
+        };
+
+        /** Run the registered tests.
+            \param[in] filter Only run the tests whose name contains this string. nullptr runs every test.
+            \return The number of failed tests.
+        */
+        static uint32_t runAll(const char* filter);
+
+        /** Record a failed check. Called by EXPECT().
+        */
+        void fail(const char* file, int line, const char* expression);
+
+        bool hasFailed() const { return mFailCount > 0; }
+
+    private:
+        struct Entry
+        {
+            const char* name;
+            Func func;
+        };
+        static std::vector<Entry>& getRegistry();
+
+        uint32_t mFailCount = 0;
+    };
+}
+
+#define UNIT_TEST(name_) \
+    static void name_(WIP3D::UnitTest& test_); \
+    static WIP3D::UnitTest::Registrar name_##Registrar(#name_, name_); \
+    static void name_(WIP3D::UnitTest& test_)
+
+#define EXPECT(cond_) do { if (!(cond_)) test_.fail(__FILE__, __LINE__, #cond_); } while (0)
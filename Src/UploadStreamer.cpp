@@ -0,0 +1,114 @@
+#include "UploadStreamer.h"
+
+namespace WIP3D
+{
+    UploadStreamer::SharedPtr UploadStreamer::create(CommandQueueHandle queue, size_t submitThreshold)
+    {
+        if (queue == nullptr) throw std::exception("UploadStreamer::create() - queue can't be nullptr");
+        return SharedPtr(new UploadStreamer(queue, submitThreshold));
+    }
+
+    UploadStreamer::UploadStreamer(CommandQueueHandle queue, size_t submitThreshold)
+        : mSubmitThreshold(submitThreshold)
+    {
+        mpContext = CopyContext::create(queue);
+        mpFence = mpContext->getLowLevelData()->getFence();
+
+        // Track the states locally. The resources' states are only written when a batch is resolved, which happens under mMutex, while the streamer owns them
+        mpContext->setStateTracker(ResourceStateTracker::create());
+    }
+
+    UploadStreamer::~UploadStreamer()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mpContext->flush(true);
+    }
+
+    UploadStreamer::Ticket UploadStreamer::uploadTexture(const Texture::SharedPtr& pTexture, const void* pData, const Callback& onComplete)
+    {
+        assert(pTexture && pData);
+        assert(pTexture->isStateGlobal() && pTexture->getGlobalState() == Resource::State::Common);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mpContext->updateTextureData(pTexture.get(), pData);
+        mpContext->resourceBarrier(pTexture.get(), Resource::State::Common);
+        return addJob(pTexture, pTexture->getSize(), onComplete);
+    }
+
+    UploadStreamer::Ticket UploadStreamer::uploadBuffer(const Buffer::SharedPtr& pBuffer, const void* pData, size_t offset, size_t numBytes, const Callback& onComplete)
+    {
+        assert(pBuffer && pData);
+        assert(pBuffer->getGlobalState() == Resource::State::Common);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mpContext->updateBuffer(pBuffer.get(), pData, offset, numBytes);
+        mpContext->resourceBarrier(pBuffer.get(), Resource::State::Common);
+        return addJob(pBuffer, numBytes ? numBytes : pBuffer->getSize() - offset, onComplete);
+    }
+
+    UploadStreamer::Ticket UploadStreamer::addJob(const Resource::SharedConstPtr& pResource, size_t size, const Callback& onComplete)
+    {
+        // The commands are submitted with the next signal
+        Ticket ticket = mpFence->getCpuValue();
+        mJobs.push_back({ ticket, pResource, onComplete });
+
+        mPendingBytes += size;
+        if (mPendingBytes >= mSubmitThreshold)
+        {
+            mpContext->flush();
+            mPendingBytes = 0;
+        }
+        return ticket;
+    }
+
+    void UploadStreamer::submit()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPendingBytes == 0) return;
+        mpContext->flush();
+        mPendingBytes = 0;
+    }
+
+    void UploadStreamer::submitIfNeeded(Ticket ticket)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (ticket < mpFence->getCpuValue()) return;
+        mpContext->flush();
+        mPendingBytes = 0;
+    }
+
+    void UploadStreamer::waitOnGpu(CommandQueueHandle queue, Ticket ticket)
+    {
+        if (isComplete(ticket)) return;
+        submitIfNeeded(ticket);
+        mpFence->syncGpu(queue, ticket);
+    }
+
+    void UploadStreamer::waitOnCpu(Ticket ticket)
+    {
+        if (isComplete(ticket)) return;
+        submitIfNeeded(ticket);
+        mpFence->syncCpu(ticket);
+    }
+
+    void UploadStreamer::executeCallbacks()
+    {
+        std::vector<Callback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            uint64_t gpuVal = mpFence->getGpuValue();
+            while (mJobs.size() && mJobs.front().ticket <= gpuVal)
+            {
+                if (mJobs.front().onComplete) callbacks.push_back(std::move(mJobs.front().onComplete));
+                mJobs.pop_front();
+            }
+        }
+
+        // Outside the lock, so callbacks can add new jobs
+        for (const auto& callback : callbacks) callback();
+    }
+
+    uint32_t UploadStreamer::getPendingJobCount() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return (uint32_t)mJobs.size();
+    }
+}
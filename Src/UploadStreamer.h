@@ -0,0 +1,92 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "GraphicsContext.h"
+
+namespace WIP3D
+{
+    /** Streams texture and buffer uploads through a copy-queue CopyContext, so loading assets doesn't stall the direct queue.
+        Jobs can be added from any thread. The data is staged in the context's upload ring and the copies are batched, a batch is submitted once it grows past a threshold or when submit() is called.
+        Every job returns a ticket, the value the streamer's fence reaches once the job's copies are done. A queue that needs the data waits on that value only, see waitOnGpu().
+        The destination resource must be in the Common state when the job is added, and is left in the Common state. Other copy queues can't record fix-up barriers from other states.
+        From the upload call until the job is complete, the streamer owns the resource's state: the thread that flushes the streamer writes it back when the copy list is resolved. Other threads must not use the resource, or read or change its state, in the meantime.
+    */
+    class UploadStreamer
+    {
+    public:
+        using SharedPtr = std::shared_ptr<UploadStreamer>;
+        using SharedConstPtr = std::shared_ptr<const UploadStreamer>;
+
+        using Ticket = uint64_t;
+        using Callback = std::function<void()>;
+
+        ~UploadStreamer();
+
+        /** Create a new streamer.
+            \param[in] queue The command queue to submit the copies to. Should be a copy queue.
+            \param[in] submitThreshold Number of staged bytes after which a batch is submitted.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(CommandQueueHandle queue, size_t submitThreshold = 4 * 1024 * 1024);
+
+        /** Upload the data of an entire texture. The data layout matches CopyContext::updateTextureData().
+            \param[in] onComplete Optional. Called by executeCallbacks() once the job is complete.
+            \return The job's ticket.
+        */
+        Ticket uploadTexture(const Texture::SharedPtr& pTexture, const void* pData, const Callback& onComplete = nullptr);
+
+        /** Upload a range of a buffer. If numBytes is 0, the range extends to the end of the buffer.
+            \param[in] onComplete Optional. Called by executeCallbacks() once the job is complete.
+            \return The job's ticket.
+        */
+        Ticket uploadBuffer(const Buffer::SharedPtr& pBuffer, const void* pData, size_t offset = 0, size_t numBytes = 0, const Callback& onComplete = nullptr);
+
+        /** Submit the jobs added since the last submission
+        */
+        void submit();
+
+        /** Check if a job is complete
+        */
+        bool isComplete(Ticket ticket) const { return ticket <= mpFence->getGpuValue(); }
+
+        /** Make a queue wait for a job before executing the commands submitted after this call. The job is submitted first if needed.
+        */
+        void waitOnGpu(CommandQueueHandle queue, Ticket ticket);
+
+        /** Block the calling thread until a job is complete. The job is submitted first if needed.
+        */
+        void waitOnCpu(Ticket ticket);
+
+        /** Release the resources of the completed jobs and call their completion callbacks. The callbacks run on the calling thread.
+        */
+        void executeCallbacks();
+
+        const GpuFence::SharedPtr& getFence() const { return mpFence; }
+
+        /** Get the number of jobs which are not complete yet
+        */
+        uint32_t getPendingJobCount() const;
+
+    private:
+        UploadStreamer(CommandQueueHandle queue, size_t submitThreshold);
+
+        Ticket addJob(const Resource::SharedConstPtr& pResource, size_t size, const Callback& onComplete);
+        void submitIfNeeded(Ticket ticket);
+
+        struct Job
+        {
+            Ticket ticket;
+            Resource::SharedConstPtr pResource;     // Kept alive until the copies are done
+            Callback onComplete;
+        };
+
+        mutable std::mutex mMutex;
+        CopyContext::SharedPtr mpContext;
+        GpuFence::SharedPtr mpFence;
+        size_t mSubmitThreshold;
+        size_t mPendingBytes = 0;
+        std::deque<Job> mJobs;
+    };
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include "WorkerPool.h"
+
+namespace WIP3D
+{
+    WorkerPool::SharedPtr WorkerPool::create(uint32_t threadCount)
+    {
+        if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        return SharedPtr(new WorkerPool(threadCount));
+    }
+
+    WorkerPool::WorkerPool(uint32_t threadCount)
+    {
+        // The calling thread is one of the workers
+        for (uint32_t i = 1; i < threadCount; i++) mThreads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTerminate = true;
+        }
+        mJobStarted.notify_all();
+        for (auto& t : mThreads) t.join();
+    }
+
+    void WorkerPool::runTasks(const Task* pTask, uint32_t taskCount)
+    {
+        for (uint32_t i = mNextTask.fetch_add(1); i < taskCount; i = mNextTask.fetch_add(1))
+        {
+            try
+            {
+                (*pTask)(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (!mpException) mpException = std::current_exception();
+            }
+        }
+    }
+
+    void WorkerPool::workerLoop()
+    {
+        uint64_t lastJobID = 0;
+        while (true)
+        {
+            const Task* pTask;
+            uint32_t taskCount;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mJobStarted.wait(lock, [&]() { return mTerminate || mJobID != lastJobID; });
+                if (mTerminate) return;
+                lastJobID = mJobID;
+
+                // Woke up after the job was done
+                if (mpTask == nullptr) continue;
+                pTask = mpTask;
+                taskCount = mTaskCount;
+                mBusyThreads++;
+            }
+
+            runTasks(pTask, taskCount);
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mBusyThreads--;
+            }
+            mJobFinished.notify_all();
+        }
+    }
+
+    void WorkerPool::parallelFor(uint32_t taskCount, const Task& task)
+    {
+        if (taskCount == 0) return;
+
+        // Not worth waking up the workers
+        if (taskCount == 1 || mThreads.empty())
+        {
+            for (uint32_t i = 0; i < taskCount; i++) task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mpTask = &task;
+            mTaskCount = taskCount;
+            mNextTask.store(0);
+            mpException = nullptr;
+            mJobID++;
+        }
+        mJobStarted.notify_all();
+
+        runTasks(&task, taskCount);
+
+        // Wait for the workers which picked up a task. Workers that wake up late find no task left
+        std::exception_ptr pException;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobFinished.wait(lock, [this]() { return mBusyThreads == 0; });
+            mpTask = nullptr;
+            mTaskCount = 0;
+            pException = mpException;
+            mpException = nullptr;
+        }
+        if (pException) std::rethrow_exception(pException);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WIP3D
+{
+    /** Fixed set of worker threads running parallel-for jobs.
+        One job runs at a time. The thread calling parallelFor() takes part in the job and returns once every task is done.
+    */
+    class WorkerPool
+    {
+    public:
+        using SharedPtr = std::shared_ptr<WorkerPool>;
+        using SharedConstPtr = std::shared_ptr<const WorkerPool>;
+
+        using Task = std::function<void(uint32_t index)>;
+
+        ~WorkerPool();
+
+        /** Create a new pool.
+            \param[in] threadCount Number of threads running the tasks, including the calling thread. 0 uses one thread per hardware thread.
+            \return A new object, or throws an exception if creation failed.
+        */
+        static SharedPtr create(uint32_t threadCount = 0);
+
+        /** Run task(i) for every i in [0, taskCount) and wait for all of them.
+            Tasks are picked in index order, but can complete in any order. If a task throws, the first exception is rethrown once the other tasks are done.
+        */
+        void parallelFor(uint32_t taskCount, const Task& task);
+
+        /** Get the number of threads running the tasks, including the calling thread
+        */
+        uint32_t getThreadCount() const { return (uint32_t)mThreads.size() + 1; }
+
+    private:
+        WorkerPool(uint32_t threadCount);
+        void workerLoop();
+        void runTasks(const Task* pTask, uint32_t taskCount);
+
+        std::vector<std::thread> mThreads;
+        std::mutex mMutex;
+        std::condition_variable mJobStarted;
+        std::condition_variable mJobFinished;
+        bool mTerminate = false;
+
+        // Current job
+        const Task* mpTask = nullptr;
+        uint32_t mTaskCount = 0;
+        uint64_t mJobID = 0;
+        uint32_t mBusyThreads = 0;
+        std::atomic<uint32_t> mNextTask { 0 };
+        std::exception_ptr mpException;
+    };
+}